@@ -0,0 +1,249 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "lrr-channel-assignment-helper.h"
+
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/lrr-device-impl.h"
+#include "ns3/lrr-mac.h"
+#include <algorithm>
+#include <functional>
+#include <set>
+
+NS_LOG_COMPONENT_DEFINE ("LrrChannelAssignmentHelper");
+
+namespace ns3 {
+
+LrrChannelAssignmentHelper::LrrChannelAssignmentHelper () :
+  m_conflicts (0)
+{
+}
+
+LrrChannelAssignmentHelper::~LrrChannelAssignmentHelper ()
+{
+  m_channels.clear ();
+  m_assignment.clear ();
+}
+
+void
+LrrChannelAssignmentHelper::AddChannel (Ptr<SpectrumValue> txPsd, Ptr<SpectrumValue> rxFilter)
+{
+  Channel channel;
+  channel.txPsd = txPsd;
+  channel.rxFilter = rxFilter;
+  m_channels.push_back (channel);
+}
+
+uint32_t
+LrrChannelAssignmentHelper::GetNChannels () const
+{
+  return m_channels.size ();
+}
+
+Ptr<lrr::Phy>
+LrrChannelAssignmentHelper::GetPhy (Ptr<NetDevice> device)
+{
+  Ptr<lrr::NeighborAwareDeviceImpl> dev = device->GetObject<lrr::NeighborAwareDeviceImpl> ();
+  if (dev == 0)
+    {
+      return 0;
+    }
+  return dev->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+}
+
+void
+LrrChannelAssignmentHelper::Tune (Ptr<NetDevice> device, uint32_t channel)
+{
+  Ptr<lrr::Phy> phy = GetPhy (device);
+  phy->SetTxPowerSpectralDensity (m_channels[channel].txPsd);
+  phy->SetRxFilter (m_channels[channel].rxFilter);
+  m_assignment[device] = channel;
+}
+
+uint32_t
+LrrChannelAssignmentHelper::Assign (NodeContainer nodes)
+{
+  NS_ASSERT_MSG (!m_channels.empty (), "you forgot to call LrrChannelAssignmentHelper::AddChannel ()");
+  m_assignment.clear ();
+  m_conflicts = 0;
+  // 1. Radios of each node, all tuned to the first channel to see the whole topology:
+  std::map<Ptr<Node>, uint32_t> nodeIndexes;
+  std::vector<std::vector<Ptr<NetDevice> > > radios;
+  for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+    {
+      std::vector<Ptr<NetDevice> > nodeRadios;
+      for (uint32_t j = 0; j < (*i)->GetNDevices (); j++)
+        {
+          if (GetPhy ((*i)->GetDevice (j)) != 0)
+            {
+              nodeRadios.push_back ((*i)->GetDevice (j));
+              Tune ((*i)->GetDevice (j), 0);
+            }
+        }
+      if (!nodeRadios.empty ())
+        {
+          nodeIndexes[*i] = radios.size ();
+          radios.push_back (nodeRadios);
+        }
+    }
+  // 2. Links (communication neighbors) and interference neighbors of each node by its first radio:
+  std::vector<std::pair<uint32_t, uint32_t> > links;
+  std::vector<std::set<uint32_t> > interference (radios.size ());
+  for (uint32_t n = 0; n < radios.size (); n++)
+    {
+      Ptr<lrr::Phy> phy = GetPhy (radios[n][0]);
+      std::vector<Ptr<NetDevice> > neighbors = phy->GetCommunicationNeighbors ();
+      // A neighbor node may be heard by several of its radios:
+      std::set<uint32_t> neighborNodes;
+      for (std::vector<Ptr<NetDevice> >::const_iterator i = neighbors.begin (); i != neighbors.end (); ++i)
+        {
+          std::map<Ptr<Node>, uint32_t>::const_iterator m = nodeIndexes.find ((*i)->GetNode ());
+          // Each link once, radios of the same node are not links:
+          if ((m != nodeIndexes.end ()) && (m->second > n))
+            {
+              neighborNodes.insert (m->second);
+            }
+        }
+      for (std::set<uint32_t>::const_iterator m = neighborNodes.begin (); m != neighborNodes.end (); ++m)
+        {
+          links.push_back (std::make_pair (n, *m));
+        }
+      interference[n].insert (n);
+      neighbors = phy->GetInterferenceNeighbors ();
+      for (std::vector<Ptr<NetDevice> >::const_iterator i = neighbors.begin (); i != neighbors.end (); ++i)
+        {
+          std::map<Ptr<Node>, uint32_t>::const_iterator m = nodeIndexes.find ((*i)->GetNode ());
+          if (m != nodeIndexes.end ())
+            {
+              interference[n].insert (m->second);
+            }
+        }
+    }
+  // 3. Conflict graph of links:
+  std::vector<std::vector<uint32_t> > nodeLinks (radios.size ());
+  for (uint32_t l = 0; l < links.size (); l++)
+    {
+      nodeLinks[links[l].first].push_back (l);
+      nodeLinks[links[l].second].push_back (l);
+    }
+  std::vector<std::vector<uint32_t> > conflicts (links.size ());
+  for (uint32_t l = 0; l < links.size (); l++)
+    {
+      std::set<uint32_t> conflicting;
+      std::set<uint32_t> area = interference[links[l].first];
+      area.insert (interference[links[l].second].begin (), interference[links[l].second].end ());
+      for (std::set<uint32_t>::const_iterator n = area.begin (); n != area.end (); ++n)
+        {
+          conflicting.insert (nodeLinks[*n].begin (), nodeLinks[*n].end ());
+        }
+      conflicting.erase (l);
+      conflicts[l].assign (conflicting.begin (), conflicting.end ());
+    }
+  // 4. Greedy coloring, the most conflicting links first:
+  std::vector<std::pair<uint32_t, uint32_t> > order;
+  for (uint32_t l = 0; l < links.size (); l++)
+    {
+      order.push_back (std::make_pair (conflicts[l].size (), l));
+    }
+  std::sort (order.begin (), order.end (), std::greater<std::pair<uint32_t, uint32_t> > ());
+  const uint32_t noChannel = m_channels.size ();
+  std::vector<uint32_t> linkChannels (links.size (), noChannel);
+  std::vector<std::set<uint32_t> > nodeChannels (radios.size ());
+  uint32_t unassigned = 0;
+  for (std::vector<std::pair<uint32_t, uint32_t> >::const_iterator i = order.begin (); i != order.end (); ++i)
+    {
+      uint32_t l = i->second;
+      uint32_t a = links[l].first;
+      uint32_t b = links[l].second;
+      bool freeA = nodeChannels[a].size () < radios[a].size ();
+      bool freeB = nodeChannels[b].size () < radios[b].size ();
+      std::vector<uint32_t> load (m_channels.size (), 0);
+      for (std::vector<uint32_t>::const_iterator k = conflicts[l].begin (); k != conflicts[l].end (); ++k)
+        {
+          if (linkChannels[*k] != noChannel)
+            {
+              load[linkChannels[*k]]++;
+            }
+        }
+      // Least loaded channel, then the one taking less new radios:
+      uint32_t best = noChannel;
+      uint32_t bestNewRadios = 0;
+      for (uint32_t c = 0; c < m_channels.size (); c++)
+        {
+          bool hasA = nodeChannels[a].count (c) != 0;
+          bool hasB = nodeChannels[b].count (c) != 0;
+          if ((!hasA && !freeA) || (!hasB && !freeB))
+            {
+              continue;
+            }
+          uint32_t newRadios = (hasA ? 0 : 1) + (hasB ? 0 : 1);
+          if ((best == noChannel) || (load[c] < load[best]) || ((load[c] == load[best]) && (newRadios < bestNewRadios)))
+            {
+              best = c;
+              bestNewRadios = newRadios;
+            }
+        }
+      if (best == noChannel)
+        {
+          unassigned++;
+          continue;
+        }
+      linkChannels[l] = best;
+      nodeChannels[a].insert (best);
+      nodeChannels[b].insert (best);
+      m_conflicts += load[best];
+    }
+  // 5. Tune radios, spare ones go to channels not used by the node:
+  for (std::map<Ptr<Node>, uint32_t>::const_iterator i = nodeIndexes.begin (); i != nodeIndexes.end (); ++i)
+    {
+      uint32_t n = i->second;
+      std::vector<uint32_t> channels (nodeChannels[n].begin (), nodeChannels[n].end ());
+      for (uint32_t c = 0; (c < m_channels.size ()) && (channels.size () < radios[n].size ()); c++)
+        {
+          if (nodeChannels[n].count (c) == 0)
+            {
+              channels.push_back (c);
+            }
+        }
+      for (uint32_t r = 0; r < radios[n].size (); r++)
+        {
+          Tune (radios[n][r], channels[r % channels.size ()]);
+        }
+    }
+  NS_LOG_DEBUG ("links = " << links.size () << "\tunassigned = " << unassigned << "\tconflicts = " << m_conflicts);
+  return unassigned;
+}
+
+uint32_t
+LrrChannelAssignmentHelper::GetChannel (Ptr<NetDevice> device) const
+{
+  std::map<Ptr<NetDevice>, uint32_t>::const_iterator i = m_assignment.find (device);
+  NS_ASSERT (i != m_assignment.end ());
+  return i->second;
+}
+
+uint32_t
+LrrChannelAssignmentHelper::GetConflicts () const
+{
+  return m_conflicts;
+}
+
+} // namespace ns3
@@ -0,0 +1,81 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#ifndef LRR_CHANNEL_ASSIGNMENT_HELPER_H_
+#define LRR_CHANNEL_ASSIGNMENT_HELPER_H_
+
+#include "ns3/spectrum-value.h"
+#include "ns3/net-device.h"
+#include "ns3/node-container.h"
+#include "ns3/lrr-phy.h"
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \brief Assigns frequency channels to LRR radios of multi-interface nodes.
+ *
+ * A channel is a TX-PSD and RX filter pair, radios with different RX filters are not communication
+ * neighbors (see Phy::NeighborRxFilterEquals), so each channel carries its own share of traffic.
+ *
+ * Assignment is link based: links are communication neighbor node pairs, two links conflict if they
+ * share a node or a node of one link is an interference neighbor of a node of the other one. Links are
+ * processed in the order of decreasing conflict degree (greedy coloring), each one gets a channel
+ * both nodes can still tune a radio to (or have already tuned), used by the least number of
+ * conflicting links. A node has as many channels as radios, so a link may be left without a channel
+ * and is routed around.
+ *
+ * Neighbors are obtained with all radios tuned to the first channel, so adjacent channel interference
+ * is not taken into account. Assignment must be done before routing is installed.
+ */
+class LrrChannelAssignmentHelper
+{
+public:
+  LrrChannelAssignmentHelper ();
+  ~LrrChannelAssignmentHelper ();
+  /// Add a channel, radios tuned to it transmit with \param txPsd and receive with \param rxFilter
+  void AddChannel (Ptr<SpectrumValue> txPsd, Ptr<SpectrumValue> rxFilter);
+  uint32_t GetNChannels () const;
+  /**
+   * \brief Tune all LRR radios of \param nodes
+   * \return the number of links left without a common channel
+   */
+  uint32_t Assign (NodeContainer nodes);
+  /// \return channel index of a radio after Assign
+  uint32_t GetChannel (Ptr<NetDevice> device) const;
+  /// \return the number of conflicting link pairs sharing a channel after Assign
+  uint32_t GetConflicts () const;
+private:
+  struct Channel
+  {
+    Ptr<SpectrumValue> txPsd;
+    Ptr<SpectrumValue> rxFilter;
+  };
+  static Ptr<lrr::Phy> GetPhy (Ptr<NetDevice> device);
+  void Tune (Ptr<NetDevice> device, uint32_t channel);
+private:
+  std::vector<Channel> m_channels;
+  std::map<Ptr<NetDevice>, uint32_t> m_assignment;
+  uint32_t m_conflicts;
+};
+
+} // namespace ns3
+#endif // LRR_CHANNEL_ASSIGNMENT_HELPER_H_
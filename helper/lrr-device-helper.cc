@@ -25,10 +25,13 @@
 #include "ns3/string.h"
 #include "ns3/names.h"
 #include "ns3/queue.h"
+#include "ns3/net-device-queue-interface.h"
 
 #include "ns3/lrr-channel.h"
 #include "ns3/lrr-range-error-model.h"
 #include "ns3/lrr-phy.h"
+#include "ns3/lrr-mac-impl.h"
+#include "ns3/lrr-mac-access-manager.h"
 namespace ns3
 {
 
@@ -79,6 +82,48 @@ NeighborAwareDeviceHelper::SetType (std::string type,
   m_mac.Set (n7, v7);
 }
 
+void
+NeighborAwareDeviceHelper::SetQueue (std::string type,
+                                     std::string n0, const AttributeValue &v0,
+                                     std::string n1, const AttributeValue &v1,
+                                     std::string n2, const AttributeValue &v2,
+                                     std::string n3, const AttributeValue &v3)
+{
+  m_queue.SetTypeId (type);
+  m_queue.Set (n0, v0);
+  m_queue.Set (n1, v1);
+  m_queue.Set (n2, v2);
+  m_queue.Set (n3, v3);
+}
+
+uint32_t
+NeighborAwareDeviceHelper::AddTrafficClass (uint32_t priority, uint32_t quantum)
+{
+  m_trafficClasses.push_back (std::make_pair (priority, quantum));
+  return m_trafficClasses.size ();
+}
+
+void
+NeighborAwareDeviceHelper::SetProtocolClass (uint16_t protocol, uint32_t trafficClass)
+{
+  NS_ASSERT (trafficClass <= m_trafficClasses.size ());
+  m_protocolClass[protocol] = trafficClass;
+}
+
+void
+NeighborAwareDeviceHelper::SetDscpClass (uint8_t dscp, uint32_t trafficClass)
+{
+  NS_ASSERT (trafficClass <= m_trafficClasses.size ());
+  m_dscpClass[dscp] = trafficClass;
+}
+
+void
+NeighborAwareDeviceHelper::AddRate (DataRate rate, double marginDb)
+{
+  NS_ASSERT (marginDb >= 0);
+  m_rateLadder[marginDb] = rate;
+}
+
 Ptr<lrr::NeighborAwareDevice>
 NeighborAwareDeviceHelper::CreateDevice (Ptr<Node> node, Address address)
 {
@@ -97,6 +142,25 @@ NeighborAwareDeviceHelper::CreateDevice (Ptr<Node> node, Address address)
 
   mac->SetPhy (phy);
   mac->SetQueue (queue);
+  if (!m_trafficClasses.empty () || !m_protocolClass.empty () || !m_dscpClass.empty ())
+    {
+      Ptr<lrr::CollisionFreeMacImpl> cfMac = mac->GetObject<lrr::CollisionFreeMacImpl> ();
+      NS_ASSERT_MSG (cfMac != 0, "Traffic classes are supported by CollisionFreeMacImpl only");
+      Ptr<lrr::AccessManager> manager = cfMac->GetAccessManager ();
+      for (std::vector<std::pair<uint32_t, uint32_t> >::const_iterator i = m_trafficClasses.begin ();
+           i != m_trafficClasses.end (); ++i)
+        {
+          manager->AddTrafficClass (m_queue.Create<Queue<Packet> > (), i->first, i->second);
+        }
+      for (std::map<uint16_t, uint32_t>::const_iterator i = m_protocolClass.begin (); i != m_protocolClass.end (); ++i)
+        {
+          manager->SetProtocolClass (i->first, i->second);
+        }
+      for (std::map<uint8_t, uint32_t>::const_iterator i = m_dscpClass.begin (); i != m_dscpClass.end (); ++i)
+        {
+          manager->SetDscpClass (i->first, i->second);
+        }
+    }
 
   dev->SetMac (mac);
   dev->SetAddress (address);
@@ -109,8 +173,14 @@ NeighborAwareDeviceHelper::CreateDevice (Ptr<Node> node, Address address)
   phy->SetNoisePowerSpectralDensity (m_noisePsd);
   phy->SetGenericPhyRxEndOkCallback (MakeCallback (&lrr::Mac::Receive, mac));
   phy->SetErrorModel (CreateObject<lrr::RangeSpectrumErrorModel> ());
+  for (std::map<double, DataRate>::const_iterator i = m_rateLadder.begin (); i != m_rateLadder.end (); ++i)
+    {
+      phy->AddRate (i->second, i->first);
+    }
 
   m_channel->AddRx (phy);
+  // Let traffic control layer see the MAC queue state:
+  dev->AggregateObject (CreateObject<NetDeviceQueueInterface> ());
   node->AddDevice (dev);
   return dev;
 }
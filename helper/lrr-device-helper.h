@@ -27,6 +27,9 @@
 #include "ns3/lrr-mac.h"
 #include "ns3/net-device-container.h"
 #include "ns3/node-container.h"
+#include "ns3/data-rate.h"
+#include <map>
+#include <vector>
 namespace ns3
 {
 class NeighborAwareDeviceHelper
@@ -45,6 +48,18 @@ public:
                 std::string n5 = "", const AttributeValue &v5 = EmptyAttributeValue (),
                 std::string n6 = "", const AttributeValue &v6 = EmptyAttributeValue (),
                 std::string n7 = "", const AttributeValue &v7 = EmptyAttributeValue ());
+  ///\name MAC queues: each traffic class gets a queue of the same type
+  ///\{
+  void SetQueue (std::string type,
+                 std::string n0 = "", const AttributeValue &v0 = EmptyAttributeValue (),
+                 std::string n1 = "", const AttributeValue &v1 = EmptyAttributeValue (),
+                 std::string n2 = "", const AttributeValue &v2 = EmptyAttributeValue (),
+                 std::string n3 = "", const AttributeValue &v3 = EmptyAttributeValue ());
+  /// Add a traffic class besides the default one (class 0 of priority 0), see AccessManager. \return class index
+  uint32_t AddTrafficClass (uint32_t priority, uint32_t quantum = 1500);
+  void SetProtocolClass (uint16_t protocol, uint32_t trafficClass);
+  void SetDscpClass (uint8_t dscp, uint32_t trafficClass);
+  ///\}
   /// Install radio device to a given nofe with a given channel ID, standard and address:
   Ptr<lrr::NeighborAwareDevice> CreateDevice (Ptr<Node> node, Address address);
   ///\name TX-power and noise of a device:
@@ -53,6 +68,8 @@ public:
   void SetNoisePowerSpectralDensity (Ptr<SpectrumValue> noisePsd);
   void SetRxFilter (Ptr<SpectrumValue> rxFilter);
   ///\}
+  /// Rate ladder of each PHY: \param rate is used for links with at least \param marginDb, see lrr::Phy::AddRate
+  void AddRate (DataRate rate, double marginDb);
   ///\name Set attributes:
   ///\{
   void SetPhyAttribute (std::string name, const AttributeValue &v);
@@ -69,6 +86,12 @@ private:
   ObjectFactory m_mac;
   ObjectFactory m_queue;
   ObjectFactory m_device;
+  /// (priority, quantum) of additional traffic classes
+  std::vector<std::pair<uint32_t, uint32_t> > m_trafficClasses;
+  std::map<uint16_t, uint32_t> m_protocolClass;
+  std::map<uint8_t, uint32_t> m_dscpClass;
+  /// Rates by required link margin in dB
+  std::map<double, DataRate> m_rateLadder;
   Ptr<lrr::NeighborAwareSpectrumChannel> m_channel;
   Ptr<SpectrumValue> m_txPsd;
   Ptr<SpectrumValue> m_noisePsd;
@@ -20,10 +20,19 @@
 
 #include "ns3/simulator.h"
 #include "ns3/mobility-model.h"
+#include "ns3/node.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/constant-position-mobility-model.h"
 #include "ns3/log.h"
 #include "lrr-channel.h"
 #include "lrr-device-impl.h"
 #include "lrr-mac.h"
+#include "lrr-phy.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <thread>
 
 NS_LOG_COMPONENT_DEFINE ("LrrNeighborAwareSpectrumChannel");
 
@@ -32,12 +41,29 @@ namespace lrr {
 
 NS_OBJECT_ENSURE_REGISTERED (NeighborAwareSpectrumChannel);
 
+const uint32_t NeighborAwareSpectrumChannel::NO_RECEIVER;
+const uint32_t NeighborAwareSpectrumChannel::NO_FILTER_CLASS;
+const uint32_t NeighborAwareSpectrumChannel::NO_NODE;
+const uint32_t NeighborAwareSpectrumChannel::UNRESOLVED_NODE;
+
 TypeId
 NeighborAwareSpectrumChannel::GetTypeId ()
 {
   static TypeId tid = TypeId ("ns3::lrr::NeighborAwareSpectrumChannel")
     .SetParent<Channel> ()
     .AddConstructor<NeighborAwareSpectrumChannel> ()
+    .AddAttribute ("PositionSnapshot",
+                   "Take positions of all PHYs once per timestamp for deterministic loss and delay. Loss and "
+                   "delay models get constant position models then, so keep it disabled for models keyed by "
+                   "mobility identity or aggregated objects.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&NeighborAwareSpectrumChannel::m_positionSnapshot),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AdjacencyThreads",
+                   "Number of threads calculating adjacency of all PHYs with built-in distance loss models",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&NeighborAwareSpectrumChannel::m_adjacencyThreads),
+                   MakeUintegerChecker<uint32_t> (1))
   ;
   return tid;
 }
@@ -48,7 +74,15 @@ NeighborAwareSpectrumChannel::NeighborAwareSpectrumChannel () :
   m_stochasticLoss (0),
   m_stochasticSpectrumLoss (0),
   m_delayModel (0),
-  m_phyList (PhyList ())
+  m_phyList (PhyList ()),
+  m_positionSnapshot (false),
+  m_snapshotValid (false),
+  m_snapshotTime (Seconds (0)),
+  m_nBatchGains (0),
+  m_adjacencyThreads (1),
+  m_staticPositions (true),
+  m_adjacencyValid (false),
+  m_adjacencyTime (Seconds (0))
 {
 }
 
@@ -60,6 +94,10 @@ NeighborAwareSpectrumChannel::~NeighborAwareSpectrumChannel ()
   m_stochasticSpectrumLoss = 0;
   m_delayModel = 0;
   m_phyList.clear ();
+  m_lrrPhys.clear ();
+  m_devices.clear ();
+  m_mobilities.clear ();
+  m_nodeIds.clear ();
 }
 
 void
@@ -71,6 +109,34 @@ NeighborAwareSpectrumChannel::DoDispose ()
   m_stochasticSpectrumLoss = 0;
   m_delayModel = 0;
   m_phyList.clear ();
+  m_lrrPhys.clear ();
+  m_devices.clear ();
+  for (std::vector<Ptr<MobilityModel> >::const_iterator k = m_mobilities.begin (); k != m_mobilities.end (); ++k)
+    {
+      if (*k != 0)
+        {
+          (*k)->TraceDisconnectWithoutContext ("CourseChange", MakeCallback (&NeighborAwareSpectrumChannel::InvalidatePositionSnapshot, this));
+        }
+    }
+  m_mobilities.clear ();
+  m_nodeIds.clear ();
+  m_x.clear ();
+  m_y.clear ();
+  m_z.clear ();
+  m_snapshotMobilities.clear ();
+  m_lossBatch = PathLossBatch ();
+  m_rxX.clear ();
+  m_rxY.clear ();
+  m_rxZ.clear ();
+  m_adjacency = Adjacency ();
+  m_adjacencyValid = false;
+  m_timeoutEnd.clear ();
+  m_transmissions.clear ();
+  m_filterClasses.clear ();
+  m_filterClassIndex.clear ();
+  m_phyFilterClass.clear ();
+  m_unclassifiedPhys.clear ();
+  m_filterCoupling.clear ();
 }
 
 void
@@ -81,6 +147,7 @@ NeighborAwareSpectrumChannel::SetDeterministicPropagationLossModel (Ptr<Propagat
       NS_FATAL_ERROR ("You have already set determinisitc loss model!");
     }
   m_deterministicLoss = loss;
+  m_adjacencyValid = false;
 }
 
 void
@@ -91,6 +158,7 @@ NeighborAwareSpectrumChannel::SetDeterministicSpectrumPropagationLossModel (Ptr<
       NS_FATAL_ERROR ("You have already set determinisitc loss model!");
     }
   m_deterministicSpectrumLoss = loss;
+  m_adjacencyValid = false;
 }
 
 void
@@ -122,30 +190,689 @@ NeighborAwareSpectrumChannel::SetPropagationDelayModel (Ptr<PropagationDelayMode
 void
 NeighborAwareSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
 {
+  Ptr<Phy> lrrPhy = phy->GetObject<Phy> ();
+  if (lrrPhy != 0)
+    {
+      lrrPhy->SetChannelIndex (m_phyList.size ());
+    }
   m_phyList.push_back (phy);
+  m_lrrPhys.push_back (lrrPhy);
+  Ptr<Object> device = phy->GetDevice ();
+  m_devices.push_back ((device != 0) ? device->GetObject<NeighborAwareDevice> () : 0);
+  m_mobilities.push_back (phy->GetMobility ());
+  m_nodeIds.push_back ((device != 0) ? UNRESOLVED_NODE : NO_NODE);
+  m_x.push_back (0);
+  m_y.push_back (0);
+  m_z.push_back (0);
+  m_snapshotMobilities.push_back (CreateObject<ConstantPositionMobilityModel> ());
+  m_snapshotValid = false;
+  m_staticPositions = m_staticPositions && (DynamicCast<ConstantPositionMobilityModel> (phy->GetMobility ()) != 0);
+  m_adjacencyValid = false;
+  if (phy->GetMobility () != 0)
+    {
+      phy->GetMobility ()->TraceConnectWithoutContext ("CourseChange", MakeCallback (&NeighborAwareSpectrumChannel::InvalidatePositionSnapshot, this));
+    }
+  m_timeoutEnd.push_back (Seconds (0));
+  m_phyFilterClass.push_back (NO_FILTER_CLASS);
+  m_unclassifiedPhys.push_back (m_phyList.size () - 1);
+  UpdateFilterClass (m_phyList.size () - 1);
   phy->SetChannel (this);
 }
 
+void
+NeighborAwareSpectrumChannel::UpdateFilterClass (uint32_t phyIndex)
+{
+  NS_ASSERT (phyIndex < m_phyList.size ());
+  Ptr<Phy> phy = m_lrrPhys[phyIndex];
+  uint32_t oldClass = m_phyFilterClass[phyIndex];
+  uint32_t newClass = NO_FILTER_CLASS;
+  bool couplingChanged = false;
+  // RX filter or TX-PSD has changed:
+  m_adjacencyValid = false;
+  if ((phy != 0) && (phy->GetRxFilter () != 0))
+    {
+      Ptr<const SpectrumValue> filter = phy->GetRxFilter ();
+      uint64_t hash = HashFilter (filter);
+      typedef std::unordered_multimap<uint64_t, uint32_t>::const_iterator ClassIterator;
+      std::pair<ClassIterator, ClassIterator> range = m_filterClassIndex.equal_range (hash);
+      for (ClassIterator i = range.first; i != range.second; ++i)
+        {
+          if (FilterEquals (m_filterClasses[i->second].rxFilter, filter))
+            {
+              newClass = i->second;
+              break;
+            }
+        }
+      if (newClass == NO_FILTER_CLASS)
+        {
+          newClass = m_filterClasses.size ();
+          FilterClass filterClass;
+          filterClass.rxFilter = filter;
+          filterClass.txSupport.assign (filter->GetSpectrumModel ()->GetNumBands (), false);
+          filterClass.foreignTx = false;
+          m_filterClasses.push_back (filterClass);
+          m_filterClassIndex.insert (std::make_pair (hash, newClass));
+          couplingChanged = true;
+        }
+      // Support of a class only grows, so coupling stays conservative when PHYs are retuned:
+      couplingChanged |= AddTxSupport (newClass, phy->GetTxPowerSpectralDensity ());
+    }
+  if (oldClass != newClass)
+    {
+      std::vector<uint32_t> & oldPhys = (oldClass == NO_FILTER_CLASS) ? m_unclassifiedPhys : m_filterClasses[oldClass].phys;
+      oldPhys.erase (std::lower_bound (oldPhys.begin (), oldPhys.end (), phyIndex));
+      std::vector<uint32_t> & newPhys = (newClass == NO_FILTER_CLASS) ? m_unclassifiedPhys : m_filterClasses[newClass].phys;
+      newPhys.insert (std::lower_bound (newPhys.begin (), newPhys.end (), phyIndex), phyIndex);
+      m_phyFilterClass[phyIndex] = newClass;
+    }
+  if (couplingChanged)
+    {
+      UpdateCoupling ();
+    }
+}
+
+uint32_t
+NeighborAwareSpectrumChannel::GetFilterClass (uint32_t phyIndex) const
+{
+  NS_ASSERT (phyIndex < m_phyFilterClass.size ());
+  return m_phyFilterClass[phyIndex];
+}
+
+bool
+NeighborAwareSpectrumChannel::IsCoupled (uint32_t from, uint32_t to) const
+{
+  if ((from == NO_FILTER_CLASS) || (to == NO_FILTER_CLASS))
+    {
+      return true;
+    }
+  NS_ASSERT ((from < m_filterCoupling.size ()) && (to < m_filterCoupling.size ()));
+  return m_filterCoupling[from][to];
+}
+
+uint64_t
+NeighborAwareSpectrumChannel::HashFilter (Ptr<const SpectrumValue> filter)
+{
+  // FNV-1a over spectrum model UID and indexes of non-zero bands
+  uint64_t hash = 14695981039346656037ULL;
+  hash = (hash ^ filter->GetSpectrumModelUid ()) * 1099511628211ULL;
+  uint64_t band = 0;
+  for (Values::const_iterator i = filter->ConstValuesBegin (); i != filter->ConstValuesEnd (); ++i, ++band)
+    {
+      if (*i != 0)
+        {
+          hash = (hash ^ band) * 1099511628211ULL;
+        }
+    }
+  return hash;
+}
+
+bool
+NeighborAwareSpectrumChannel::FilterEquals (Ptr<const SpectrumValue> filter, Ptr<const SpectrumValue> other)
+{
+  // We can not compare doubles, so some tolerance is needed
+  static double tolerance = 0.01;
+  if (filter->GetSpectrumModelUid () != other->GetSpectrumModelUid ())
+    {
+      return false;
+    }
+  Values::const_iterator myIt = filter->ConstValuesBegin ();
+  Values::const_iterator otherIt = other->ConstValuesBegin ();
+  for (; myIt != filter->ConstValuesEnd (); myIt++, otherIt++)
+    {
+      if ((*otherIt == 0) && (std::abs (*myIt) > tolerance))
+        {
+          return false;
+        }
+      if (std::abs (*myIt / *otherIt - 1) > tolerance)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+bool
+NeighborAwareSpectrumChannel::AddTxSupport (uint32_t filterClass, Ptr<const SpectrumValue> txPsd)
+{
+  FilterClass & fc = m_filterClasses[filterClass];
+  if (txPsd == 0)
+    {
+      return false;
+    }
+  if (txPsd->GetSpectrumModelUid () != fc.rxFilter->GetSpectrumModelUid ())
+    {
+      bool changed = !fc.foreignTx;
+      fc.foreignTx = true;
+      return changed;
+    }
+  bool changed = false;
+  uint32_t band = 0;
+  for (Values::const_iterator i = txPsd->ConstValuesBegin (); i != txPsd->ConstValuesEnd (); ++i, ++band)
+    {
+      if ((*i != 0) && !fc.txSupport[band])
+        {
+          fc.txSupport[band] = true;
+          changed = true;
+        }
+    }
+  return changed;
+}
+
+void
+NeighborAwareSpectrumChannel::UpdateCoupling ()
+{
+  uint32_t n = m_filterClasses.size ();
+  // Classes of different spectrum models are coupled, since PHY converts received signal:
+  m_filterCoupling.assign (n, std::vector<bool> (n, true));
+  for (uint32_t from = 0; from < n; from++)
+    {
+      const FilterClass & tx = m_filterClasses[from];
+      if (tx.foreignTx)
+        {
+          continue;
+        }
+      for (uint32_t to = 0; to < n; to++)
+        {
+          const FilterClass & rx = m_filterClasses[to];
+          if (tx.rxFilter->GetSpectrumModelUid () != rx.rxFilter->GetSpectrumModelUid ())
+            {
+              continue;
+            }
+          bool coupled = false;
+          Values::const_iterator value = rx.rxFilter->ConstValuesBegin ();
+          for (uint32_t band = 0; (band < tx.txSupport.size ()) && !coupled; ++band, ++value)
+            {
+              coupled = tx.txSupport[band] && (*value != 0);
+            }
+          m_filterCoupling[from][to] = coupled;
+        }
+    }
+}
+
+std::vector<uint32_t>
+NeighborAwareSpectrumChannel::GetCoupledPhys (uint32_t phyIndex) const
+{
+  std::vector<uint32_t> retval;
+  uint32_t senderClass = (phyIndex < m_phyFilterClass.size ()) ? m_phyFilterClass[phyIndex] : NO_FILTER_CLASS;
+  if (senderClass == NO_FILTER_CLASS)
+    {
+      for (uint32_t i = 0; i < m_phyList.size (); i++)
+        {
+          retval.push_back (i);
+        }
+      return retval;
+    }
+  for (uint32_t c = 0; c < m_filterClasses.size (); c++)
+    {
+      if (m_filterCoupling[senderClass][c])
+        {
+          retval.insert (retval.end (), m_filterClasses[c].phys.begin (), m_filterClasses[c].phys.end ());
+        }
+    }
+  retval.insert (retval.end (), m_unclassifiedPhys.begin (), m_unclassifiedPhys.end ());
+  return retval;
+}
+
+void
+NeighborAwareSpectrumChannel::SetTimeoutEnd (uint32_t phyIndex, Time timeoutEnd)
+{
+  NS_ASSERT (phyIndex < m_timeoutEnd.size ());
+  m_timeoutEnd[phyIndex] = timeoutEnd;
+}
+
+Time
+NeighborAwareSpectrumChannel::GetMaxTimeoutEnd (const std::vector<uint32_t> & phyIndexes, Time start) const
+{
+  Time retval = start;
+  for (std::vector<uint32_t>::const_iterator i = phyIndexes.begin (); i != phyIndexes.end (); ++i)
+    {
+      NS_ASSERT (*i < m_timeoutEnd.size ());
+      if (retval < m_timeoutEnd[*i])
+        {
+          retval = m_timeoutEnd[*i];
+        }
+    }
+  return retval;
+}
+
+void
+NeighborAwareSpectrumChannel::AddTransmission (uint32_t sender, uint32_t receiver, Time start, Time end, uint32_t powerLevel)
+{
+  NS_ASSERT ((sender < m_phyList.size ()) && ((receiver < m_phyList.size ()) || (receiver == NO_RECEIVER)));
+  RemoveFinishedTransmissions ();
+  Transmission transmission;
+  transmission.sender = sender;
+  transmission.receiver = receiver;
+  transmission.start = start;
+  transmission.end = end;
+  transmission.powerLevel = powerLevel;
+  m_transmissions.push_back (transmission);
+}
+
+std::vector<NeighborAwareSpectrumChannel::Transmission>
+NeighborAwareSpectrumChannel::GetTransmissions (Time start, Time end)
+{
+  RemoveFinishedTransmissions ();
+  std::vector<Transmission> retval;
+  for (std::vector<Transmission>::const_iterator i = m_transmissions.begin (); i != m_transmissions.end (); ++i)
+    {
+      if ((i->start < end) && (start < i->end))
+        {
+          retval.push_back (*i);
+        }
+    }
+  return retval;
+}
+
+void
+NeighborAwareSpectrumChannel::RemoveFinishedTransmissions ()
+{
+  Time now = Simulator::Now ();
+  std::vector<Transmission>::iterator last = m_transmissions.begin ();
+  for (std::vector<Transmission>::const_iterator i = m_transmissions.begin (); i != m_transmissions.end (); ++i)
+    {
+      if (i->end > now)
+        {
+          *last++ = *i;
+        }
+    }
+  m_transmissions.erase (last, m_transmissions.end ());
+}
+
+Ptr<SpectrumValue>
+NeighborAwareSpectrumChannel::GetAverageRxPsd (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver) const
+{
+  return CalcLoss (txPsd, sender, receiver, true /*Deterministic only*/);
+}
+
+Ptr<SpectrumValue>
+NeighborAwareSpectrumChannel::GetAverageRxPsd (Ptr<const SpectrumValue> txPsd, uint32_t sender, uint32_t receiver) const
+{
+  return CalcLoss (txPsd, sender, receiver, true /*Deterministic only*/);
+}
+
+uint32_t
+NeighborAwareSpectrumChannel::GetPhyIndex (Ptr<const SpectrumPhy> phy) const
+{
+  Ptr<const Phy> lrrPhy = phy->GetObject<Phy> ();
+  if ((lrrPhy != 0) && (lrrPhy->GetNeighborAwareChannel () == this))
+    {
+      return lrrPhy->GetChannelIndex ();
+    }
+  PhyList::const_iterator i = std::find (m_phyList.begin (), m_phyList.end (), phy);
+  NS_ASSERT_MSG (i != m_phyList.end (), "PHY is not attached to this channel");
+  return i - m_phyList.begin ();
+}
+
+void
+NeighborAwareSpectrumChannel::UpdatePositionSnapshot () const
+{
+  Time now = Simulator::Now ();
+  if (!m_positionSnapshot || (m_snapshotValid && (m_snapshotTime == now)))
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < m_mobilities.size (); i++)
+    {
+      NS_ASSERT (m_mobilities[i] != 0);
+      Vector position = m_mobilities[i]->GetPosition ();
+      m_x[i] = position.x;
+      m_y[i] = position.y;
+      m_z[i] = position.z;
+      m_snapshotMobilities[i]->SetPosition (position);
+    }
+  m_snapshotTime = now;
+  m_snapshotValid = true;
+}
+
+Ptr<MobilityModel>
+NeighborAwareSpectrumChannel::GetSnapshotMobility (uint32_t phyIndex) const
+{
+  NS_ASSERT (phyIndex < m_mobilities.size ());
+  if (!m_positionSnapshot)
+    {
+      return m_mobilities[phyIndex];
+    }
+  UpdatePositionSnapshot ();
+  return m_snapshotMobilities[phyIndex];
+}
+
+void
+NeighborAwareSpectrumChannel::UpdatePositions () const
+{
+  if (m_positionSnapshot)
+    {
+      UpdatePositionSnapshot ();
+      return;
+    }
+  // Current positions for one pass, they are not kept as a snapshot:
+  for (uint32_t i = 0; i < m_mobilities.size (); i++)
+    {
+      NS_ASSERT (m_mobilities[i] != 0);
+      Vector position = m_mobilities[i]->GetPosition ();
+      m_x[i] = position.x;
+      m_y[i] = position.y;
+      m_z[i] = position.z;
+    }
+  m_snapshotValid = false;
+}
+
+Vector
+NeighborAwareSpectrumChannel::GetPhyPosition (uint32_t phyIndex) const
+{
+  NS_ASSERT (phyIndex < m_mobilities.size ());
+  if (!m_positionSnapshot)
+    {
+      return m_mobilities[phyIndex]->GetPosition ();
+    }
+  UpdatePositionSnapshot ();
+  return Vector (m_x[phyIndex], m_y[phyIndex], m_z[phyIndex]);
+}
+
+void
+NeighborAwareSpectrumChannel::InvalidatePositionSnapshot (Ptr<const MobilityModel> mobility)
+{
+  m_snapshotValid = false;
+  m_adjacencyValid = false;
+}
+
+const NeighborAwareSpectrumChannel::Adjacency &
+NeighborAwareSpectrumChannel::GetAdjacency () const
+{
+  if (!m_adjacencyValid || (!m_staticPositions && (m_adjacencyTime != Simulator::Now ())))
+    {
+      ComputeAdjacency ();
+    }
+  return m_adjacency;
+}
+
+bool
+NeighborAwareSpectrumChannel::IsAdjacencyPreferred () const
+{
+  return m_staticPositions || (m_adjacencyValid && (m_adjacencyTime == Simulator::Now ()));
+}
+
+void
+NeighborAwareSpectrumChannel::InvalidateAdjacency ()
+{
+  m_adjacencyValid = false;
+}
+
+bool
+NeighborAwareSpectrumChannel::AdjacencyLink::operator< (const AdjacencyLink & other) const
+{
+  if (from != other.from)
+    {
+      return from < other.from;
+    }
+  if (to != other.to)
+    {
+      return to < other.to;
+    }
+  return communication < other.communication;
+}
+
+void
+NeighborAwareSpectrumChannel::ComputeAdjacency () const
+{
+  uint32_t n = m_phyList.size ();
+  AdjacencyInput input;
+  input.active.assign (n, false);
+  input.filterClass = m_phyFilterClass;
+  input.txGroup.assign (n, 0);
+  input.rxGroup.assign (n, 0);
+  input.communicationThresholdMw.assign (n, 0);
+  input.sensitivityThresholdMw.assign (n, 0);
+  // RX filter is applied in the spectrum model of TX-PSD of a receiver, so it is a part of RX group:
+  std::map<const SpectrumValue *, uint32_t> txGroups;
+  std::map<std::pair<const SpectrumValue *, SpectrumModelUid_t>, uint32_t> rxGroups;
+  std::vector<uint32_t> txRepresentatives;
+  std::vector<uint32_t> rxRepresentatives;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Ptr<Phy> phy = m_lrrPhys[i];
+      if ((phy == 0) || (m_devices[i] == 0) || (phy->GetTxPowerSpectralDensity () == 0) || (phy->GetRxFilter () == 0))
+        {
+          continue;
+        }
+      input.active[i] = true;
+      input.communicationThresholdMw[i] = std::pow (10, phy->GetNeighborDetectionThresholdDbm () / 10);
+      input.sensitivityThresholdMw[i] = std::pow (10, phy->GetSensitivityThresholdDbm () / 10);
+      std::pair<std::map<const SpectrumValue *, uint32_t>::iterator, bool> tx =
+        txGroups.insert (std::make_pair (PeekPointer (phy->GetTxPowerSpectralDensity ()), txRepresentatives.size ()));
+      if (tx.second)
+        {
+          txRepresentatives.push_back (i);
+        }
+      input.txGroup[i] = tx.first->second;
+      std::pair<std::map<std::pair<const SpectrumValue *, SpectrumModelUid_t>, uint32_t>::iterator, bool> rx =
+        rxGroups.insert (std::make_pair (std::make_pair (PeekPointer (phy->GetRxFilter ()), phy->GetTxPowerSpectralDensity ()->GetSpectrumModelUid ()),
+                                         rxRepresentatives.size ()));
+      if (rx.second)
+        {
+          rxRepresentatives.push_back (i);
+        }
+      input.rxGroup[i] = rx.first->second;
+    }
+  input.nRxGroups = rxRepresentatives.size ();
+  input.filteredTxMw.assign (txRepresentatives.size () * input.nRxGroups, 0);
+  for (uint32_t t = 0; t < txRepresentatives.size (); t++)
+    {
+      for (uint32_t r = 0; r < input.nRxGroups; r++)
+        {
+          input.filteredTxMw[t * input.nRxGroups + r] = m_lrrPhys[rxRepresentatives[r]]->GetFilteredPowerMw (m_lrrPhys[txRepresentatives[t]]->GetTxPowerSpectralDensity ());
+        }
+    }
+  // Batch loss of built-in models is symmetric, GetDeterministicGains checks the model for one pair first:
+  bool batch = false;
+  if ((m_deterministicLoss != 0) && (n > 1))
+    {
+      std::vector<double> probe;
+      GetDeterministicGains (0, std::vector<uint32_t> (1, 1), probe);
+      batch = m_lossBatch.IsSupported ();
+    }
+  std::vector<AdjacencyLink> links;
+  if (batch)
+    {
+      UpdatePositions ();
+      uint32_t nThreads = std::min (m_adjacencyThreads, n);
+      std::vector<std::vector<AdjacencyLink> > threadLinks (nThreads);
+      std::vector<std::thread> threads;
+      for (uint32_t t = 1; t < nThreads; t++)
+        {
+          threads.push_back (std::thread (&NeighborAwareSpectrumChannel::ComputeAdjacencyRows, this, &input, t, nThreads, &threadLinks[t]));
+        }
+      ComputeAdjacencyRows (&input, 0, nThreads, &threadLinks[0]);
+      for (std::vector<std::thread>::iterator t = threads.begin (); t != threads.end (); ++t)
+        {
+          t->join ();
+        }
+      for (uint32_t t = 0; t < nThreads; t++)
+        {
+          links.insert (links.end (), threadLinks[t].begin (), threadLinks[t].end ());
+        }
+      for (uint32_t i = 0; i + 1 < n; i++)
+        {
+          m_nBatchGains += input.active[i] ? (n - i - 1) : 0;
+        }
+    }
+  else
+    {
+      for (uint32_t i = 0; i < n; i++)
+        {
+          if (!input.active[i])
+            {
+              continue;
+            }
+          std::vector<uint32_t> receivers;
+          for (uint32_t j = 0; j < n; j++)
+            {
+              if (input.active[j] && (j != i) && IsCoupled (input.filterClass[i], input.filterClass[j]))
+                {
+                  receivers.push_back (j);
+                }
+            }
+          Ptr<const SpectrumValue> txPsd = m_lrrPhys[i]->GetTxPowerSpectralDensity ();
+          std::vector<double> gains;
+          if (m_deterministicLoss != 0)
+            {
+              GetDeterministicGains (i, receivers, gains);
+            }
+          for (uint32_t k = 0; k < receivers.size (); k++)
+            {
+              Ptr<SpectrumValue> rxPsd = (m_deterministicLoss != 0) ? Create<SpectrumValue> ((*txPsd) * gains[k]) : CalcLoss (txPsd, i, receivers[k], true /*Deterministic only*/);
+              AddAdjacencyLinks (input, i, receivers[k], m_lrrPhys[receivers[k]]->GetFilteredPowerMw (rxPsd), links);
+            }
+        }
+    }
+  std::sort (links.begin (), links.end ());
+  m_adjacency.communication.assign (n, std::vector<uint32_t> ());
+  m_adjacency.communicationRxPowerMw.assign (n, std::vector<double> ());
+  m_adjacency.sensitivity.assign (n, std::vector<uint32_t> ());
+  for (std::vector<AdjacencyLink>::const_iterator i = links.begin (); i != links.end (); ++i)
+    {
+      if (i->communication)
+        {
+          m_adjacency.communication[i->from].push_back (i->to);
+          m_adjacency.communicationRxPowerMw[i->from].push_back (i->rxPowerMw);
+        }
+      else
+        {
+          m_adjacency.sensitivity[i->from].push_back (i->to);
+        }
+    }
+  m_adjacencyValid = true;
+  m_adjacencyTime = Simulator::Now ();
+  NS_LOG_DEBUG ("Adjacency of " << n << " PHYs: " << links.size () << " links, " << (batch ? "batch" : "per pair"));
+}
+
+void
+NeighborAwareSpectrumChannel::ComputeAdjacencyRows (const AdjacencyInput * input, uint32_t first, uint32_t step, std::vector<AdjacencyLink> * links) const
+{
+  uint32_t n = input->active.size ();
+  std::vector<double> gains (n);
+  for (uint32_t i = first; i + 1 < n; i += step)
+    {
+      if (!input->active[i])
+        {
+          continue;
+        }
+      uint32_t count = n - i - 1;
+      m_lossBatch.CalcGains (Vector (m_x[i], m_y[i], m_z[i]), &m_x[i + 1], &m_y[i + 1], &m_z[i + 1], count, &gains[0]);
+      for (uint32_t k = 0; k < count; k++)
+        {
+          uint32_t j = i + 1 + k;
+          if (!input->active[j])
+            {
+              continue;
+            }
+          AddAdjacencyLinks (*input, i, j, gains[k] * input->filteredTxMw[input->txGroup[i] * input->nRxGroups + input->rxGroup[j]], *links);
+          AddAdjacencyLinks (*input, j, i, gains[k] * input->filteredTxMw[input->txGroup[j] * input->nRxGroups + input->rxGroup[i]], *links);
+        }
+    }
+}
+
+void
+NeighborAwareSpectrumChannel::AddAdjacencyLinks (const AdjacencyInput & input, uint32_t from, uint32_t to, double rxPowerMw, std::vector<AdjacencyLink> & links) const
+{
+  // The same conditions as Phy::GetSensitivityNeighbors and Phy::GetCommunicationNeighbors:
+  if ((rxPowerMw == 0) || !IsCoupled (input.filterClass[from], input.filterClass[to]))
+    {
+      return;
+    }
+  AdjacencyLink link;
+  link.from = from;
+  link.to = to;
+  link.rxPowerMw = rxPowerMw;
+  if (rxPowerMw > input.sensitivityThresholdMw[from])
+    {
+      link.communication = false;
+      links.push_back (link);
+    }
+  if ((input.filterClass[from] != NO_FILTER_CLASS) && (input.filterClass[from] == input.filterClass[to]) && (rxPowerMw > input.communicationThresholdMw[from]))
+    {
+      link.communication = true;
+      links.push_back (link);
+    }
+}
+
+Ptr<SpectrumPhy>
+NeighborAwareSpectrumChannel::GetPhy (uint32_t phyIndex) const
+{
+  NS_ASSERT (phyIndex < m_phyList.size ());
+  return m_phyList[phyIndex];
+}
+
+Ptr<NeighborAwareDevice>
+NeighborAwareSpectrumChannel::GetNeighborAwareDevice (uint32_t phyIndex) const
+{
+  NS_ASSERT (phyIndex < m_devices.size ());
+  return m_devices[phyIndex];
+}
+
+Time
+NeighborAwareSpectrumChannel::GetMaxPropagationDelay (uint32_t phyIndex, const std::vector<uint32_t> & phyIndexes) const
+{
+  Time retval = Seconds (0);
+  if (m_delayModel == 0)
+    {
+      return retval;
+    }
+  NS_ASSERT (phyIndex < m_phyList.size ());
+  Ptr<MobilityModel> mobility = GetSnapshotMobility (phyIndex);
+  for (std::vector<uint32_t>::const_iterator i = phyIndexes.begin (); i != phyIndexes.end (); ++i)
+    {
+      NS_ASSERT (*i < m_phyList.size ());
+      Time delay = m_delayModel->GetDelay (mobility, GetSnapshotMobility (*i));
+      if (retval < delay)
+        {
+          retval = delay;
+        }
+    }
+  return retval;
+}
+
 NeighborAwareSpectrumChannel::NeighborList
 NeighborAwareSpectrumChannel::GetAllNeighbors (Ptr<NeighborAwareDevice> sender, Ptr<const SpectrumValue> txPsd) const
 {
   NS_ASSERT (sender->GetObject<NeighborAwareDeviceImpl>() != 0);
-  Ptr<MobilityModel> senderMobility = sender->GetObject<NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetMobility ();
-  NS_ASSERT (senderMobility != 0);
+  uint32_t senderIndex = GetPhyIndex (sender->GetObject<NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ());
   NeighborList retval;
-  for (PhyList::const_iterator rxPhyIterator = m_phyList.begin (); rxPhyIterator != m_phyList.end (); ++rxPhyIterator)
+  // txPsd is TX-PSD of the sender or its attenuation, so it does not leave TX support of the sender class:
+  retval.reserve (m_phyList.size ());
+  std::vector<uint32_t> coupled = GetCoupledPhys (senderIndex);
+  std::vector<uint32_t> receivers;
+  receivers.reserve (coupled.size ());
+  for (std::vector<uint32_t>::const_iterator i = coupled.begin (); i != coupled.end (); ++i)
     {
-      Ptr<NeighborAwareDevice> device = (*rxPhyIterator)->GetDevice ()->GetObject<NeighborAwareDevice> ();
       // We may deal with self or with some other device type
-      if ((device == 0) || (sender == device))
+      if ((m_devices[*i] == 0) || (sender == m_devices[*i]))
         {
           continue;
         }
-      Ptr<MobilityModel> receiverMobility = (*rxPhyIterator)->GetMobility ();
-      NS_ASSERT (receiverMobility != 0);
-
-      Ptr<SpectrumValue> rxPsd = CalcLoss (txPsd, senderMobility, receiverMobility, true /*Deterministic only*/);
-      retval.push_back (std::make_pair (device, rxPsd));
+      NS_ASSERT (m_mobilities[*i] != 0);
+      receivers.push_back (*i);
+    }
+  // Simple deterministic model is flat, so gains of all receivers are calculated in one pass:
+  std::vector<double> gains;
+  if (m_deterministicLoss != 0)
+    {
+      GetDeterministicGains (senderIndex, receivers, gains);
+    }
+  for (uint32_t k = 0; k < receivers.size (); k++)
+    {
+      Neighbor neighbor;
+      neighbor.device = m_devices[receivers[k]];
+      neighbor.phy = m_lrrPhys[receivers[k]];
+      if (m_deterministicLoss != 0)
+        {
+          neighbor.rxPsd = Create<SpectrumValue> ((*txPsd) * gains[k]);
+        }
+      else
+        {
+          neighbor.rxPsd = CalcLoss (txPsd, senderIndex, receivers[k], true /*Deterministic only*/);
+        }
+      retval.push_back (neighbor);
     }
   return retval;
 }
@@ -174,6 +901,67 @@ NeighborAwareSpectrumChannel::GetNDevices () const
   return m_phyList.size ();
 }
 
+uint64_t
+NeighborAwareSpectrumChannel::GetNBatchGains () const
+{
+  return m_nBatchGains;
+}
+
+void
+NeighborAwareSpectrumChannel::GetDeterministicGains (uint32_t sender, const std::vector<uint32_t> & receivers, std::vector<double> & gains) const
+{
+  NS_ASSERT (m_deterministicLoss != 0);
+  NS_ASSERT (sender < m_mobilities.size ());
+  gains.resize (receivers.size ());
+  if (receivers.empty ())
+    {
+      return;
+    }
+  Ptr<MobilityModel> senderMobility = GetSnapshotMobility (sender);
+  if (!m_lossBatch.IsConfiguredFor (m_deterministicLoss))
+    {
+      m_lossBatch.Configure (m_deterministicLoss);
+    }
+  // Batch models need only positions, so they do not depend on the snapshot mobility models:
+  if (m_lossBatch.IsSupported ())
+    {
+      uint32_t n = receivers.size ();
+      m_rxX.resize (n);
+      m_rxY.resize (n);
+      m_rxZ.resize (n);
+      for (uint32_t k = 0; k < n; k++)
+        {
+          NS_ASSERT (receivers[k] < m_mobilities.size ());
+          Vector position = GetPhyPosition (receivers[k]);
+          m_rxX[k] = position.x;
+          m_rxY[k] = position.y;
+          m_rxZ[k] = position.z;
+        }
+      Vector tx = GetPhyPosition (sender);
+      // Attributes of the model may have been changed after it was configured, so the first receiver is checked:
+      double probe = pow (10, m_deterministicLoss->CalcRxPower (0, senderMobility, GetSnapshotMobility (receivers[0])) / 10.0);
+      for (uint32_t attempt = 0; attempt < 2; attempt++)
+        {
+          m_lossBatch.CalcGains (tx, &m_rxX[0], &m_rxY[0], &m_rxZ[0], n, &gains[0]);
+          if (std::abs (gains[0] - probe) <= 1e-6 * probe)
+            {
+              m_nBatchGains += n;
+              return;
+            }
+          if (!m_lossBatch.Configure (m_deterministicLoss))
+            {
+              break;
+            }
+        }
+      NS_LOG_WARN ("Batch path loss does not match the model, it is called per receiver");
+      m_lossBatch.Reject ();
+    }
+  for (uint32_t k = 0; k < receivers.size (); k++)
+    {
+      gains[k] = pow (10, m_deterministicLoss->CalcRxPower (0, senderMobility, GetSnapshotMobility (receivers[k])) / 10.0);
+    }
+}
+
 Ptr<SpectrumValue>
 NeighborAwareSpectrumChannel::CalcLoss (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver, bool deterministicOnly) const
 {
@@ -192,6 +980,23 @@ NeighborAwareSpectrumChannel::CalcLoss (Ptr<const SpectrumValue> txPsd, Ptr<Mobi
     {
       return rxPsd;
     }
+  return CalcStochasticLoss (rxPsd, sender, receiver);
+}
+
+Ptr<SpectrumValue>
+NeighborAwareSpectrumChannel::CalcLoss (Ptr<const SpectrumValue> txPsd, uint32_t sender, uint32_t receiver, bool deterministicOnly) const
+{
+  Ptr<SpectrumValue> rxPsd = CalcLoss (txPsd, GetSnapshotMobility (sender), GetSnapshotMobility (receiver), true /*Deterministic only*/);
+  if (deterministicOnly)
+    {
+      return rxPsd;
+    }
+  return CalcStochasticLoss (rxPsd, m_mobilities[sender], m_mobilities[receiver]);
+}
+
+Ptr<SpectrumValue>
+NeighborAwareSpectrumChannel::CalcStochasticLoss (Ptr<SpectrumValue> rxPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver) const
+{
   if (m_stochasticLoss != 0)
     {
       rxPsd = DoCalcLoss (rxPsd, sender, receiver, m_stochasticLoss);
@@ -234,40 +1039,64 @@ NeighborAwareSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
   NS_ASSERT_MSG (txParams->psd, "NULL txPsd");
   NS_ASSERT_MSG (txParams->txPhy, "NULL txPhy");
 
-  Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility ();
-
-  for (PhyList::const_iterator rxPhyIterator = m_phyList.begin (); rxPhyIterator != m_phyList.end (); ++rxPhyIterator)
+  // Only PHYs of classes coupled with the sender class hear it:
+  uint32_t senderIndex = GetPhyIndex (txParams->txPhy);
+  NS_ASSERT (m_mobilities[senderIndex] != 0);
+  NS_ASSERT (m_deterministicLoss != 0);
+  std::vector<uint32_t> coupled = GetCoupledPhys (senderIndex);
+  std::vector<uint32_t> receivers;
+  receivers.reserve (coupled.size ());
+  for (std::vector<uint32_t>::const_iterator i = coupled.begin (); i != coupled.end (); ++i)
     {
-      if ((*rxPhyIterator) == txParams->txPhy)
+      if (m_phyList[*i] != txParams->txPhy)
         {
-          continue;
+          receivers.push_back (*i);
         }
-      Time delay = MicroSeconds (0);
+    }
+  std::vector<double> gains;
+  GetDeterministicGains (senderIndex, receivers, gains);
+  for (uint32_t k = 0; k < receivers.size (); k++)
+    {
+      StartPropagation (txParams, senderIndex, receivers[k], gains[k]);
+    }
+}
 
-      Ptr<MobilityModel> receiverMobility = (*rxPhyIterator)->GetMobility ();
-      NS_ASSERT (senderMobility != 0);
-      NS_ASSERT (receiverMobility != 0);
-      NS_ASSERT (m_deterministicLoss != 0);
-      Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
-      rxParams->psd = CalcLoss (txParams->psd, senderMobility, receiverMobility, false /*Not determinisic only*/);
-      if (m_delayModel)
-        {
-          delay = m_delayModel->GetDelay (senderMobility, receiverMobility);
-        }
-      Ptr<Object> netDevObj = (*rxPhyIterator)->GetDevice ();
-      if (netDevObj)
-        {
-          // the receiver has a NetDevice, so we expect that it is attached to a Node
-          uint32_t dstNode = netDevObj->GetObject<NetDevice> ()->GetNode ()->GetId ();
-          Simulator::ScheduleWithContext (dstNode, delay, &NeighborAwareSpectrumChannel::StartRx, this, rxParams,
-                                          *rxPhyIterator);
-        }
-      else
-        {
-          // the receiver is not attached to a NetDevice, so we cannot assume that it is attached to a node
-          Simulator::Schedule (delay, &NeighborAwareSpectrumChannel::StartRx, this, rxParams, *rxPhyIterator);
-        }
+void
+NeighborAwareSpectrumChannel::StartPropagation (Ptr<SpectrumSignalParameters> txParams, uint32_t senderIndex, uint32_t receiverIndex, double gain)
+{
+  Time delay = MicroSeconds (0);
+  NS_ASSERT (m_mobilities[receiverIndex] != 0);
+  Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
+  // Stochastic loss is applied with real mobility models, as in CalcLoss:
+  Ptr<SpectrumValue> rxPsd = Create<SpectrumValue> ((*txParams->psd) * gain);
+  rxParams->psd = CalcStochasticLoss (rxPsd, m_mobilities[senderIndex], m_mobilities[receiverIndex]);
+  if (m_delayModel)
+    {
+      delay = m_delayModel->GetDelay (GetSnapshotMobility (senderIndex), GetSnapshotMobility (receiverIndex));
+    }
+  uint32_t dstNode = GetNodeId (receiverIndex);
+  if (dstNode != NO_NODE)
+    {
+      // the receiver has a NetDevice, so we expect that it is attached to a Node
+      Simulator::ScheduleWithContext (dstNode, delay, &NeighborAwareSpectrumChannel::StartRx, this, rxParams, m_phyList[receiverIndex]);
+    }
+  else
+    {
+      // the receiver is not attached to a NetDevice, so we cannot assume that it is attached to a node
+      Simulator::Schedule (delay, &NeighborAwareSpectrumChannel::StartRx, this, rxParams, m_phyList[receiverIndex]);
+    }
+}
+
+uint32_t
+NeighborAwareSpectrumChannel::GetNodeId (uint32_t phyIndex)
+{
+  if (m_nodeIds[phyIndex] == UNRESOLVED_NODE)
+    {
+      Ptr<Node> node = m_phyList[phyIndex]->GetDevice ()->GetObject<NetDevice> ()->GetNode ();
+      NS_ASSERT_MSG (node != 0, "Device must be added to a node before transmissions start");
+      m_nodeIds[phyIndex] = node->GetId ();
     }
+  return m_nodeIds[phyIndex];
 }
 
 void
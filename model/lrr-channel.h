@@ -28,10 +28,13 @@
 #include "ns3/propagation-loss-model.h"
 #include "ns3/spectrum-propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
+#include "ns3/lrr-path-loss-batch.h"
+#include <unordered_map>
 
 namespace ns3 {
 namespace lrr {
 class NeighborAwareDevice;
+class Phy;
 /**
  * \ingroup lrr
  * \brief Is a wrapper for channel. Calculates communication and interference neighbors, needed
@@ -46,16 +49,65 @@ class NeighborAwareDevice;
  *
  * This channel does not apply any spectrum converters. PHY converts received signal if needed.
  * This channel may operate with any type of spectrum PHY regardless of Communication/Interference neighbors support.
+ *
+ * LRR PHYs are grouped into filter classes of equal RX filters (found by a hash of the spectrum model and
+ * non-zero bands when a filter is set). Class-to-class coupling tells whether TX-PSD of any PHY of one class
+ * overlaps RX filter of the other one, so transmissions and neighbor queries skip PHYs of non-coupled classes.
+ * A filter joins a class if it equals the filter of the first PHY of the class within 1% per band. This is
+ * not transitive: two members may differ by up to 2%, and which class a filter joins depends on the order
+ * in which PHYs were tuned. Filters of real channels differ far more than that.
+ *
+ * Device, LRR PHY and mobility of each attached PHY are resolved once at AddRx and kept in arrays indexed by
+ * PHY ordinal, so per-pair loops do no aggregation lookups. PHY must have its device and mobility before AddRx.
+ *
+ * Built-in distance loss models depend only on positions, so they are calculated in batch over position arrays
+ * in any case. With PositionSnapshot enabled, positions of all PHYs are taken into a snapshot at most once per
+ * timestamp (and again after a course change), deterministic loss and propagation delay read positions from it.
+ * Loss and delay models then see constant position models instead of the PHY ones, so the snapshot is off by
+ * default: models keyed by mobility identity (e.g. MatrixPropagationLossModel) or by objects aggregated to it
+ * would silently lose their state. Stochastic loss always gets real mobility models, since it may keep a state
+ * per pair of them.
  */
 class NeighborAwareSpectrumChannel : public SpectrumChannel
 {
 public:
   /**
-   * \brief Neighbor list is associated with a sender device and represents a pointer to a device and average
+   * \brief Neighbor list is associated with a sender device and represents a pointer to a device, its PHY and average
    * RX-power spectral density received by a neighbor at Simulator::Now ().
    * This neighbor list is requested by PHY and needed to calculate.
    */
-  typedef std::vector<std::pair<Ptr<NeighborAwareDevice>, Ptr<const SpectrumValue> > > NeighborList;
+  struct Neighbor
+  {
+    Ptr<NeighborAwareDevice> device;
+    /// LRR PHY of the device (zero for other PHY types)
+    Ptr<Phy> phy;
+    Ptr<const SpectrumValue> rxPsd;
+  };
+  typedef std::vector<Neighbor> NeighborList;
+  /// Receiver of a group transmission
+  static const uint32_t NO_RECEIVER = 0xffffffff;
+  /// Class of PHYs without RX filter and of other PHY types, coupled with all classes
+  static const uint32_t NO_FILTER_CLASS = 0xffffffff;
+  /// Scheduled transmission: PHY ordinals of the sender and the receiver and its airtime
+  struct Transmission
+  {
+    uint32_t sender;
+    uint32_t receiver;
+    Time start;
+    Time end;
+    /// TX power level of the sender (see Phy TxPowerLevels)
+    uint32_t powerLevel;
+  };
+  /// Communication and sensitivity neighbors of all LRR PHYs at full TX power indexed by PHY ordinal
+  struct Adjacency
+  {
+    /// Communication neighbors in ascending order: the same filter class and RX power above neighbor detection threshold of the sender
+    std::vector<std::vector<uint32_t> > communication;
+    /// Average RX power after RX filter of each communication neighbor
+    std::vector<std::vector<double> > communicationRxPowerMw;
+    /// Sensitivity neighbors in ascending order: RX power above sensitivity threshold of the sender
+    std::vector<std::vector<uint32_t> > sensitivity;
+  };
 public:
   static TypeId GetTypeId ();
 
@@ -86,18 +138,154 @@ public:
   ///\}
   /// Get all pairs of devices in this channel and average RX-PSD for each device.
   NeighborList GetAllNeighbors (Ptr<NeighborAwareDevice> sender, Ptr<const SpectrumValue> txPsd) const;
+  /// Average RX-PSD due to deterministic loss only
+  Ptr<SpectrumValue> GetAverageRxPsd (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver) const;
+  /// The same between PHYs with given ordinals, positions are taken from the snapshot
+  Ptr<SpectrumValue> GetAverageRxPsd (Ptr<const SpectrumValue> txPsd, uint32_t sender, uint32_t receiver) const;
+  /**
+   * \brief Deterministic gains (received to transmitted power ratio) from a PHY to given PHYs in one pass.
+   * Built-in distance models depend only on positions, so they are calculated in batch with or without the
+   * position snapshot, others call the model per receiver. Needs a simple (not spectrum) deterministic model.
+   */
+  void GetDeterministicGains (uint32_t sender, const std::vector<uint32_t> & receivers, std::vector<double> & gains) const;
+  /// \return number of gains calculated in batch so far (statistics)
+  uint64_t GetNBatchGains () const;
+  ///\name Adjacency of all PHYs
+  ///\{
+  /**
+   * \brief Adjacency is calculated in one symmetric pass over PHY pairs (i < j), the loss between them is
+   * taken once for both directions, rows are shared by AdjacencyThreads threads. Models not supported by batch
+   * calculation are evaluated per directed pair in one thread. Adjacency is kept until positions, filters or
+   * thresholds change and until the next timestamp if some PHY has not a constant position model
+   */
+  const Adjacency & GetAdjacency () const;
+  /// \return true if adjacency is up to date or positions are static, so it is cheaper than a scan of the channel
+  bool IsAdjacencyPreferred () const;
+  /// Called by PHYs when their neighbor thresholds change
+  void InvalidateAdjacency ();
+  ///\}
+  /// PHY by its ordinal
+  Ptr<SpectrumPhy> GetPhy (uint32_t phyIndex) const;
+  /// LRR device of a PHY by its ordinal resolved at AddRx (zero for other device types), no aggregation lookup
+  Ptr<NeighborAwareDevice> GetNeighborAwareDevice (uint32_t phyIndex) const;
+  /// \return max propagation delay from a PHY to given PHYs (zero without delay model)
+  Time GetMaxPropagationDelay (uint32_t phyIndex, const std::vector<uint32_t> & phyIndexes) const;
+  ///\name Reservation table: medium timeout end of each PHY indexed by PHY ordinal (order of AddRx)
+  ///\{
+  void SetTimeoutEnd (uint32_t phyIndex, Time timeoutEnd);
+  /// \return max of \param start and timeout ends of given PHYs
+  Time GetMaxTimeoutEnd (const std::vector<uint32_t> & phyIndexes, Time start) const;
+  ///\}
+  ///\name Registry of scheduled transmissions, needed for spatial reuse admission
+  ///\{
+  void AddTransmission (uint32_t sender, uint32_t receiver, Time start, Time end, uint32_t powerLevel = 0);
+  /// \return transmissions overlapping [start, end), finished ones are removed
+  std::vector<Transmission> GetTransmissions (Time start, Time end);
+  ///\}
+  ///\name Filter classes of PHYs
+  ///\{
+  /// Reassign a class of a PHY, called by PHY when its RX filter or TX-PSD has changed
+  void UpdateFilterClass (uint32_t phyIndex);
+  uint32_t GetFilterClass (uint32_t phyIndex) const;
+  /// \return true if transmission of class \param from passes RX filter of class \param to
+  bool IsCoupled (uint32_t from, uint32_t to) const;
+  ///\}
 private:
   typedef std::vector<Ptr<SpectrumPhy> > PhyList;
+  ///\name Node ID of a PHY without device and of a PHY, whose device is not added to a node yet
+  ///\{
+  static const uint32_t NO_NODE = 0xffffffff;
+  static const uint32_t UNRESOLVED_NODE = 0xfffffffe;
+  ///\}
+  struct FilterClass
+  {
+    /// RX filter of the first PHY of a class, filters of other PHYs are compared with it only
+    Ptr<const SpectrumValue> rxFilter;
+    /// Bands, where TX-PSD of any PHY of a class is non-zero
+    std::vector<bool> txSupport;
+    /// TX-PSD of some PHY has another spectrum model, so coupling is not checked
+    bool foreignTx;
+    /// PHY ordinals in ascending order
+    std::vector<uint32_t> phys;
+  };
+  /// Directed link found by the adjacency pass
+  struct AdjacencyLink
+  {
+    uint32_t from;
+    uint32_t to;
+    bool communication;
+    double rxPowerMw;
+    bool operator< (const AdjacencyLink & other) const;
+  };
+  /// Inputs of the adjacency pass indexed by PHY ordinal, plain values to be shared by threads
+  struct AdjacencyInput
+  {
+    /// LRR PHYs with a device, TX-PSD and RX filter
+    std::vector<bool> active;
+    std::vector<uint32_t> filterClass;
+    ///\name PHYs sharing TX-PSD (RX filter) objects are grouped, so filtered TX power is taken once per group pair
+    ///\{
+    std::vector<uint32_t> txGroup;
+    std::vector<uint32_t> rxGroup;
+    uint32_t nRxGroups;
+    /// Filtered TX power by TX group and RX group
+    std::vector<double> filteredTxMw;
+    ///\}
+    std::vector<double> communicationThresholdMw;
+    std::vector<double> sensitivityThresholdMw;
+  };
 private:
   void DoDispose ();
   ///\name Helper method to calculate loss between the receiver and the transmitter
   ///\{
   Ptr<SpectrumValue> CalcLoss (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver, bool deterministicOnly) const;
+  /// Loss between PHYs with given ordinals, deterministic loss uses the position snapshot
+  Ptr<SpectrumValue> CalcLoss (Ptr<const SpectrumValue> txPsd, uint32_t sender, uint32_t receiver, bool deterministicOnly) const;
+  Ptr<SpectrumValue> CalcStochasticLoss (Ptr<SpectrumValue> rxPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver) const;
   Ptr<SpectrumValue> DoCalcLoss (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver, Ptr<PropagationLossModel> loss) const;
   Ptr<SpectrumValue> DoCalcSpectrumLoss (Ptr<const SpectrumValue> txPsd, Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver, Ptr<SpectrumPropagationLossModel> loss) const;
   ///\}
   /// For devices without node
   void StartRx (Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver);
+  /// Keep transmissions which are not finished yet
+  void RemoveFinishedTransmissions ();
+  /// Apply deterministic \param gain and stochastic loss, calculate delay and schedule StartRx at a receiver with a given ordinal
+  void StartPropagation (Ptr<SpectrumSignalParameters> txParams, uint32_t senderIndex, uint32_t receiverIndex, double gain);
+  /// \return ordinal of a PHY attached to this channel
+  uint32_t GetPhyIndex (Ptr<const SpectrumPhy> phy) const;
+  ///\name Position snapshot
+  ///\{
+  /// Take positions of all PHYs unless they are taken at this timestamp already
+  void UpdatePositionSnapshot () const;
+  /// Mobility model reporting snapshot position of a PHY (or its own one if snapshot is disabled)
+  Ptr<MobilityModel> GetSnapshotMobility (uint32_t phyIndex) const;
+  /// Take positions of all PHYs into position arrays for a batch pass: the snapshot or current positions if snapshot is disabled
+  void UpdatePositions () const;
+  /// Snapshot position of a PHY (or its current position if snapshot is disabled)
+  Vector GetPhyPosition (uint32_t phyIndex) const;
+  void InvalidatePositionSnapshot (Ptr<const MobilityModel> mobility);
+  ///\}
+  /// \return ID of the node of a given PHY or NO_NODE, resolved at first use since devices are added to nodes after AddRx
+  uint32_t GetNodeId (uint32_t phyIndex);
+  ///\name Filter classes
+  ///\{
+  /// Filters equal with tolerance have the same spectrum model and the same zero bands, so hash is taken of them
+  static uint64_t HashFilter (Ptr<const SpectrumValue> filter);
+  static bool FilterEquals (Ptr<const SpectrumValue> filter, Ptr<const SpectrumValue> other);
+  /// Extend TX support of a class by \param txPsd, \return true if it has grown
+  bool AddTxSupport (uint32_t filterClass, Ptr<const SpectrumValue> txPsd);
+  void UpdateCoupling ();
+  /// \return ordinals of PHYs, which may receive a transmission of a PHY with a given ordinal
+  std::vector<uint32_t> GetCoupledPhys (uint32_t phyIndex) const;
+  ///\}
+  ///\name Adjacency
+  ///\{
+  void ComputeAdjacency () const;
+  /// Batch pass over rows first, first + step, ... of the upper triangle of PHY pairs
+  void ComputeAdjacencyRows (const AdjacencyInput * input, uint32_t first, uint32_t step, std::vector<AdjacencyLink> * links) const;
+  /// Add communication and sensitivity links from \param from to \param to with a given RX power after RX filter
+  void AddAdjacencyLinks (const AdjacencyInput & input, uint32_t from, uint32_t to, double rxPowerMw, std::vector<AdjacencyLink> & links) const;
+  ///\}
 private:
   /**
    * \name Deterministic models:
@@ -120,8 +308,62 @@ private:
   ///\}
   /// Propagation-delay model:
   Ptr<PropagationDelayModel> m_delayModel;
-  /// Attached devices:
+  ///\name Registry of attached PHYs indexed by PHY ordinal (order of AddRx)
+  ///\{
   PhyList m_phyList;
+  /// LRR PHYs, zero for other PHY types
+  std::vector<Ptr<Phy> > m_lrrPhys;
+  /// LRR devices, zero for other device types
+  std::vector<Ptr<NeighborAwareDevice> > m_devices;
+  std::vector<Ptr<MobilityModel> > m_mobilities;
+  /// Node IDs used as a context of receive events
+  std::vector<uint32_t> m_nodeIds;
+  ///\}
+  ///\name Position snapshot indexed by PHY ordinal, position arrays are also filled for a batch pass without snapshot
+  ///\{
+  bool m_positionSnapshot;
+  mutable bool m_snapshotValid;
+  mutable Time m_snapshotTime;
+  mutable std::vector<double> m_x;
+  mutable std::vector<double> m_y;
+  mutable std::vector<double> m_z;
+  /// Constant position models reporting snapshot positions to loss and delay models
+  std::vector<Ptr<MobilityModel> > m_snapshotMobilities;
+  ///\}
+  ///\name Batch path loss
+  ///\{
+  mutable PathLossBatch m_lossBatch;
+  /// Receiver positions gathered from the snapshot or from mobility models
+  mutable std::vector<double> m_rxX;
+  mutable std::vector<double> m_rxY;
+  mutable std::vector<double> m_rxZ;
+  mutable uint64_t m_nBatchGains;
+  ///\}
+  ///\name Adjacency
+  ///\{
+  uint32_t m_adjacencyThreads;
+  /// All PHYs have constant position models, which report every move as a course change
+  bool m_staticPositions;
+  mutable Adjacency m_adjacency;
+  mutable bool m_adjacencyValid;
+  mutable Time m_adjacencyTime;
+  ///\}
+  /// Reservation table, kept contiguous for a fast gather
+  std::vector<Time> m_timeoutEnd;
+  /// Transmissions which are not finished yet
+  std::vector<Transmission> m_transmissions;
+  ///\name Filter classes
+  ///\{
+  std::vector<FilterClass> m_filterClasses;
+  /// Filter hash to class
+  std::unordered_multimap<uint64_t, uint32_t> m_filterClassIndex;
+  /// Class of each PHY indexed by PHY ordinal
+  std::vector<uint32_t> m_phyFilterClass;
+  /// Ordinals of PHYs without class
+  std::vector<uint32_t> m_unclassifiedPhys;
+  /// Coupling from one class (first index) to another
+  std::vector<std::vector<bool> > m_filterCoupling;
+  ///\}
 };
 } // namespace lrr
 } // namespace ns3
@@ -68,6 +68,7 @@ NeighborAwareDeviceImpl::DoDispose ()
   NS_LOG_FUNCTION (this);
   m_node = 0;
   m_mac = 0;
+  m_queueInterface = 0;
   m_forwardUp = MakeNullCallback <bool,Ptr<NetDevice>,Ptr<const Packet>,uint16_t,const Address &> ();
   m_promiscRx = MakeNullCallback<bool, Ptr<NetDevice>, Ptr<const Packet>, uint16_t, const Address &, const Address &, enum PacketType> ();
   // chain up.
@@ -79,6 +80,34 @@ NeighborAwareDeviceImpl::SetMac (Ptr<Mac> mac)
 {
   m_mac = mac;
   m_mac->SetForwardUpCallback (MakeCallback (&NeighborAwareDeviceImpl::ForwardUp, this));
+  if (m_queueInterface != 0)
+    {
+      m_mac->SetQueueInterface (m_queueInterface);
+    }
+}
+
+void
+NeighborAwareDeviceImpl::NotifyNewAggregate ()
+{
+  if (m_queueInterface == 0)
+    {
+      Ptr<NetDeviceQueueInterface> ndqi = GetObject<NetDeviceQueueInterface> ();
+      if (ndqi != 0)
+        {
+          m_queueInterface = ndqi;
+          if (m_queueInterface->GetNTxQueues () == 0)
+            {
+              // Single TX queue: MAC classifies packets itself
+              m_queueInterface->SetTxQueuesN (1);
+              m_queueInterface->CreateTxQueues ();
+            }
+          if (m_mac != 0)
+            {
+              m_mac->SetQueueInterface (m_queueInterface);
+            }
+        }
+    }
+  NetDevice::NotifyNewAggregate ();
 }
 
 Ptr<Mac>
@@ -201,8 +230,7 @@ bool
 NeighborAwareDeviceImpl::Send (Ptr<Packet> packet, const Address& dest, uint16_t protocolNumber)
 {
   NS_LOG_FUNCTION (this << dest);
-  m_mac->Enqueue (packet, dest, m_mac->GetAddress (), protocolNumber);
-  return true;
+  return m_mac->Enqueue (packet, dest, m_mac->GetAddress (), protocolNumber);
 }
 
 bool
@@ -25,6 +25,7 @@
 #include "ns3/lrr-device.h"
 #include "ns3/node.h"
 #include "ns3/lrr-mac.h"
+#include "ns3/net-device-queue-interface.h"
 
 namespace ns3
 {
@@ -96,6 +97,8 @@ private:
   /// Object's starter and disposer:
   void DoInitialize ();
   void DoDispose ();
+  /// Pick up NetDeviceQueueInterface aggregated by traffic control helper
+  void NotifyNewAggregate ();
 private:
   /// Pointer to a MAC
   Ptr<Mac> m_mac;
@@ -103,6 +106,8 @@ private:
   Ptr<Node> m_node;
   /// NetDevice's interface index
   uint32_t m_ifIndex;
+  /// Flow control with traffic control layer, passed to MAC
+  Ptr<NetDeviceQueueInterface> m_queueInterface;
 
   mutable uint16_t m_mtu;
 
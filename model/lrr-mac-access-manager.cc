@@ -21,12 +21,21 @@
 
 #include "lrr-mac-access-manager.h"
 #include "lrr-mac-impl.h"
+#include "lrr-mac-header.h"
+#include "lrr-mac-tdma.h"
 #include "lrr-phy.h"
 #include "lrr-device-impl.h"
 
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/queue.h"
+#include "ns3/net-device-queue-interface.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include <algorithm>
+#include <cmath>
 
 NS_LOG_COMPONENT_DEFINE ("LrrAccessManager");
 
@@ -48,20 +57,115 @@ AccessManager::GetTypeId ()
                     MakeTimeChecker ()
                     )
 
+    .AddAttribute ("AdaptiveGuardInterval",
+                   "Derive guard interval from max propagation delay to interference neighbors plus Preamble "
+                   "instead of GuardInterval (doubled delay with ARQ to cover the round trip)",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AccessManager::m_adaptiveGuardInterval),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Preamble",
+                   "Preamble duration added to adaptive guard interval",
+                   TimeValue (MicroSeconds (16)),
+                   MakeTimeAccessor (&AccessManager::m_preamble),
+                   MakeTimeChecker ())
     .AddAttribute ("InterferenceNbrUpdatePeriod",
                    "How often interference neighbors are reconstructed",
                    TimeValue (Seconds (0.5)), /// Depends on mobility conditions
                    MakeTimeAccessor (&AccessManager::m_interferenceNeighborUpdatePeriod),
                    MakeTimeChecker ())
+    .AddAttribute ("MaxBurstDuration",
+                   "Max airtime of a frame aggregating several queued packets, zero disables aggregation",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&AccessManager::m_maxBurstDuration),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxBurstSize",
+                   "Max size in bytes of a frame aggregating several queued packets",
+                   UintegerValue (8192),
+                   MakeUintegerAccessor (&AccessManager::m_maxBurstSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Lookahead",
+                   "Max number of back-to-back frames reserved by a single access",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&AccessManager::m_lookahead),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("CoDel",
+                   "Apply CoDel sojourn time control to each traffic class queue",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AccessManager::m_codel),
+                   MakeBooleanChecker ())
+    .AddAttribute ("CoDelTarget",
+                   "CoDel acceptable minimum sojourn time",
+                   TimeValue (MilliSeconds (5)),
+                   MakeTimeAccessor (&AccessManager::m_codelTarget),
+                   MakeTimeChecker ())
+    .AddAttribute ("CoDelInterval",
+                   "CoDel window of minimum sojourn time tracking",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&AccessManager::m_codelInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("Arq",
+                   "Acknowledge unicast frames and retransmit lost ones",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AccessManager::m_arq),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Sifs",
+                   "Gap between the end of a frame and its acknowledgement",
+                   TimeValue (MicroSeconds (16)),
+                   MakeTimeAccessor (&AccessManager::m_sifs),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxRetries",
+                   "Max number of retransmissions of a frame which is not acknowledged",
+                   UintegerValue (7),
+                   MakeUintegerAccessor (&AccessManager::m_maxRetries),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("SpatialReuse",
+                   "Admit concurrent unicast frames by SINR of all receivers instead of silencing interference neighbors",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AccessManager::m_spatialReuse),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("CoDelDrop", "Packet dropped by CoDel",
+                     MakeTraceSourceAccessor (&AccessManager::m_codelDropTrace),
+                     "ns3::lrr::AccessManager::DropTracedCallback")
+    .AddTraceSource ("CoDelDropCount", "Number of packets dropped by CoDel",
+                     MakeTraceSourceAccessor (&AccessManager::m_codelDropCount),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("QueueDelay", "Time spent by a packet in the queue of its traffic class",
+                     MakeTraceSourceAccessor (&AccessManager::m_queueDelayTrace),
+                     "ns3::lrr::AccessManager::QueueDelayTracedCallback")
+    .AddTraceSource ("ArqRetry", "Frame is not acknowledged and will be retransmitted",
+                     MakeTraceSourceAccessor (&AccessManager::m_arqRetryTrace),
+                     "ns3::lrr::AccessManager::ArqTracedCallback")
+    .AddTraceSource ("ArqFailure", "Frame is dropped after max number of retransmissions",
+                     MakeTraceSourceAccessor (&AccessManager::m_arqFailureTrace),
+                     "ns3::lrr::AccessManager::ArqTracedCallback")
   ;
   return tid;
 }
 
 AccessManager::AccessManager ()
-  : m_queue (0),
+  : m_drrCurrent (0),
+  m_drrNewTurn (true),
   m_timeoutEnd (MicroSeconds (0)),
   m_mac (0),
+  m_arqFrame (0),
+  m_arqSequence (0),
+  m_arqRetries (0),
   m_guardInterval (MicroSeconds (150)),
+  m_adaptiveGuardInterval (false),
+  m_preamble (MicroSeconds (16)),
+  m_maxBurstDuration (Seconds (0)),
+  m_maxBurstSize (8192),
+  m_lookahead (1),
+  m_codel (false),
+  m_codelTarget (MilliSeconds (5)),
+  m_codelInterval (MilliSeconds (100)),
+  m_arq (false),
+  m_sifs (MicroSeconds (16)),
+  m_maxRetries (7),
+  m_spatialReuse (false),
+  m_channel (0),
+  m_channelIndex (0),
+  m_maxPropagationDelay (Seconds (0)),
   m_lastInterferenceNeighborsUpdate (Seconds (0)),
   m_interferenceNeighborUpdatePeriod (Seconds (0.5))
 {
@@ -72,19 +176,195 @@ AccessManager::~AccessManager ()
   m_accessTimeout.Cancel ();
   m_interferenceNeighbors.clear ();
   m_mac = 0;
-  m_queue = 0;
+  m_classes.clear ();
 }
 
-void
-AccessManager::Enqueue (Ptr<const Packet> packet)
+bool
+AccessManager::Enqueue (Ptr<Packet> packet, Address destination, uint32_t trafficClass)
 {
-  NS_LOG_FUNCTION (this << packet);
-  m_queue->Enqueue (packet->Copy ());
+  NS_LOG_FUNCTION (this << packet << trafficClass);
+  NS_ASSERT (trafficClass < m_classes.size ());
+  TrafficClass & tc = m_classes[trafficClass];
+  packet->AddPacketTag (QueueTag (Mac48Address::ConvertFrom (destination), Simulator::Now ()));
+  bool enqueued = tc.queue->Enqueue (packet);
+  if (!enqueued)
+    {
+      QueueTag tag;
+      packet->RemovePacketTag (tag);
+    }
+  if (m_queueInterface != 0)
+    {
+      Ptr<NetDeviceQueue> txQueue = m_queueInterface->GetTxQueue (0);
+      if (enqueued)
+        {
+          txQueue->NotifyQueuedBytes (packet->GetSize ());
+        }
+      if (!enqueued || IsClassQueueFull (trafficClass))
+        {
+          NS_LOG_DEBUG ("Stop device queue, class " << trafficClass << " is full");
+          txQueue->Stop ();
+        }
+    }
   StartAccessIfNeeded ();
+  return enqueued;
+}
+
+bool
+AccessManager::IsClassQueueFull (uint32_t trafficClass) const
+{
+  Ptr<Queue<Packet> > queue = m_classes[trafficClass].queue;
+  if (queue->GetMode () == QueueBase::QUEUE_MODE_PACKETS)
+    {
+      return (queue->GetNPackets () >= queue->GetMaxPackets ());
+    }
+  return (queue->GetNBytes () + m_mac->GetMaxMsduSize () > queue->GetMaxBytes ());
+}
+
+void
+AccessManager::WakeQueueIfNeeded ()
+{
+  if ((m_queueInterface == 0) || !m_queueInterface->GetTxQueue (0)->IsStopped ())
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < m_classes.size (); i++)
+    {
+      if (IsClassQueueFull (i))
+        {
+          return;
+        }
+    }
+  NS_LOG_DEBUG ("Wake device queue");
+  m_queueInterface->GetTxQueue (0)->Wake ();
+}
+
+void
+AccessManager::SetTdmaScheduler (Ptr<TdmaScheduler> scheduler)
+{
+  m_tdmaScheduler = scheduler;
+}
+
+void
+AccessManager::SetQueueInterface (Ptr<NetDeviceQueueInterface> queueInterface)
+{
+  m_queueInterface = queueInterface;
+}
+
+uint32_t
+AccessManager::Classify (Ptr<const Packet> packet, uint16_t protocol) const
+{
+  if (!m_dscpClass.empty () && (protocol == Ipv4L3Protocol::PROT_NUMBER))
+    {
+      Ipv4Header header;
+      if (packet->PeekHeader (header))
+        {
+          std::map<uint8_t, uint32_t>::const_iterator i = m_dscpClass.find (header.GetDscp ());
+          if (i != m_dscpClass.end ())
+            {
+              return i->second;
+            }
+        }
+    }
+  std::map<uint16_t, uint32_t>::const_iterator i = m_protocolClass.find (protocol);
+  if (i != m_protocolClass.end ())
+    {
+      return i->second;
+    }
+  return 0;
+}
+
+void
+AccessManager::SetProtocolClass (uint16_t protocol, uint32_t trafficClass)
+{
+  NS_ASSERT (trafficClass < m_classes.size ());
+  m_protocolClass[protocol] = trafficClass;
+}
+
+void
+AccessManager::SetDscpClass (uint8_t dscp, uint32_t trafficClass)
+{
+  NS_ASSERT (trafficClass < m_classes.size ());
+  m_dscpClass[dscp] = trafficClass;
+}
+
+uint32_t
+AccessManager::AddTrafficClass (Ptr<Queue<Packet> > queue, uint32_t priority, uint32_t quantum)
+{
+  NS_ASSERT ((queue != 0) && (quantum > 0));
+  TrafficClass tc;
+  tc.queue = queue;
+  tc.priority = priority;
+  tc.quantum = quantum;
+  tc.deficit = 0;
+  tc.dropping = false;
+  tc.firstAboveTime = Seconds (0);
+  tc.dropNext = Seconds (0);
+  tc.count = 0;
+  tc.lastCount = 0;
+  m_classes.push_back (tc);
+  return m_classes.size () - 1;
+}
+
+uint32_t
+AccessManager::GetNTrafficClasses () const
+{
+  return m_classes.size ();
+}
+
+bool
+AccessManager::IsQueueEmpty () const
+{
+  for (std::vector<TrafficClass>::const_iterator i = m_classes.begin (); i != m_classes.end (); ++i)
+    {
+      if (!i->queue->IsEmpty ())
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+uint32_t
+AccessManager::SelectClass ()
+{
+  // Strict priority: find the highest priority with backlog
+  bool found = false;
+  uint32_t priority = 0;
+  for (std::vector<TrafficClass>::const_iterator i = m_classes.begin (); i != m_classes.end (); ++i)
+    {
+      if (!i->queue->IsEmpty () && (!found || (i->priority > priority)))
+        {
+          priority = i->priority;
+          found = true;
+        }
+    }
+  if (!found)
+    {
+      return m_classes.size ();
+    }
+  // Deficit round robin among backlogged classes of that priority, terminates because quantum > 0
+  for (;;)
+    {
+      TrafficClass & tc = m_classes[m_drrCurrent];
+      if ((tc.priority == priority) && !tc.queue->IsEmpty ())
+        {
+          if (m_drrNewTurn)
+            {
+              tc.deficit += tc.quantum;
+              m_drrNewTurn = false;
+            }
+          if (tc.deficit >= tc.queue->Peek ()->GetSize ())
+            {
+              return m_drrCurrent;
+            }
+        }
+      m_drrCurrent = (m_drrCurrent + 1) % m_classes.size ();
+      m_drrNewTurn = true;
+    }
 }
 
 void
-AccessManager::SetMac (Ptr<Mac> mac)
+AccessManager::SetMac (Ptr<CollisionFreeMacImpl> mac)
 {
   m_mac = mac;
 }
@@ -93,10 +373,10 @@ void
 AccessManager::StartAccessIfNeeded ()
 {
   NS_LOG_FUNCTION (this);
-  if (m_queue->IsEmpty () || m_accessTimeout.IsRunning ())
+  if ((IsQueueEmpty () && (m_arqFrame == 0)) || m_accessTimeout.IsRunning () || m_arqTimeout.IsRunning ())
     {
       // Nothing to do
-      NS_LOG_DEBUG ("Queue not empty or access timer is running");
+      NS_LOG_DEBUG ("Queue is empty, access timer is running or acknowledgement is awaited");
       return;
     }
   Time timeoutDelay = GetTimeoutEnd () - Simulator::Now ();
@@ -109,56 +389,416 @@ void
 AccessManager::StartAccess ()
 {
   NS_LOG_FUNCTION (this);
-  if (m_queue->IsEmpty ())
+  if (IsQueueEmpty () && (m_arqFrame == 0))
     {
       return;
     }
-  // 1. Calculate TX-start time:
-  Time txStart = CalculateTxStartTime ();
-  Time txDelay = txStart - Simulator::Now ();
-  // 2. Construct a packet burst (timed out packets are dropped automatically by queue, so txDelay is passed)
+  Ptr<Phy> phy = m_mac->GetPhy ()->GetObject<Phy> ();
+  NS_ASSERT_MSG (phy != 0, "Collision free MAC works with LrrPhy or any other that supports GetRate method");
+  // 1. Calculate TX-start time (with spatial reuse or power control each slot is checked on its own):
+  Time txStart = Simulator::Now ();
+  bool spatialReuse = m_spatialReuse && (m_tdmaScheduler == 0);
+  bool powerControl = (phy->GetNTxPowerLevels () > 1) && (m_tdmaScheduler == 0);
+  if (spatialReuse || powerControl)
+    {
+      UpdateInterferenceNeighbors ();
+    }
+  else
+    {
+      txStart = CalculateTxStartTime ();
+    }
+  // 2. Construct packet bursts for up to Lookahead back-to-back slots (timed out packets are dropped automatically by queue)
+  // All events of the previous access have expired: this one starts at its timeout end
+  m_txStartEvents.clear ();
+  uint32_t dequeuedBytes = 0;
+  Time slotStart = txStart;
+  Time guardInterval = GetGuardInterval ();
+  // A frame waiting for acknowledgement takes the last reserved slot, no slots follow it:
+  for (uint32_t slot = 0; (slot < m_lookahead) && !m_arqTimeout.IsRunning (); slot++)
+    {
+      Ptr<Packet> frame = m_arqFrame;
+      DataRate rate = m_arqRate;
+      Mac48Address destination = m_arqDestination;
+      if (frame == 0)
+        {
+          if (IsQueueEmpty ())
+            {
+              break;
+            }
+          uint32_t burstBytes;
+          frame = DequeueBurst (phy, rate, destination, burstBytes);
+          dequeuedBytes += burstBytes;
+          if (frame == 0)
+            {
+              // All dequeued packets were dropped by CoDel, their bytes are still reported to the device queue below:
+              continue;
+            }
+          if (m_arq && !destination.IsGroup ())
+            {
+              // New frame to be acknowledged:
+              m_arqSequence = m_arqNextSequence[destination]++;
+              m_arqRetries = 0;
+              m_arqStats[destination].frames++;
+              // The frame keeps its single MAC header, the type it carried goes behind it with the sequence number:
+              Mac48Address to;
+              Mac48Address from;
+              uint16_t type;
+              if (!m_mac->PeekMacHeader (frame, to, from, type))
+                {
+                  NS_FATAL_ERROR ("Frame of " << frame->GetSize () << " bytes has no MAC header");
+                }
+              frame->RemoveAtStart (m_mac->GetMacHeaderSize ());
+              frame->AddHeader (MacArqHeader (m_arqSequence, type));
+              m_mac->AddMacHeader (frame, to, from, MacHeader::ARQ_TYPE);
+              m_arqFrame = frame;
+              m_arqDestination = destination;
+              m_arqRate = rate;
+            }
+        }
+      Time airtime = rate.CalculateBytesTxTime (frame->GetSize ());
+      // The whole slot goes from me to the receiver unless the acknowledgement takes its tail:
+      Time dataDuration = airtime + guardInterval;
+      if (frame == m_arqFrame)
+        {
+          // Acknowledgement is a part of the slot:
+          dataDuration = airtime + m_sifs;
+          airtime += m_sifs + GetAckDuration (phy);
+        }
+      uint32_t receiver = NeighborAwareSpectrumChannel::NO_RECEIVER;
+      uint32_t powerLevel = destination.IsGroup () ? 0 : phy->GetTxPowerLevel (destination);
+      if (m_tdmaScheduler != 0)
+        {
+          if (airtime + guardInterval > m_tdmaScheduler->GetSlotDuration ())
+            {
+              NS_FATAL_ERROR ("Frame of " << frame->GetSize () << " bytes takes " << airtime << " with guard interval "
+                              << guardInterval << ", which does not fit into TDMA slot of " << m_tdmaScheduler->GetSlotDuration ());
+            }
+          // Next frames go to the next own slots:
+          slotStart = m_tdmaScheduler->GetSlotStart (m_channelIndex, slotStart);
+        }
+      else if (spatialReuse)
+        {
+          std::map<Mac48Address, uint32_t>::const_iterator neighbor = m_neighborIndexes.find (destination);
+          if (neighbor == m_neighborIndexes.end ())
+            {
+              // Group frame: all interference neighbors must be silent
+              slotStart = m_channel->GetMaxTimeoutEnd (m_interferenceNeighbors, slotStart);
+            }
+          else
+            {
+              receiver = neighbor->second;
+              slotStart = CalculateAdmittedTxStartTime (receiver, powerLevel, slotStart, dataDuration, airtime + guardInterval);
+            }
+        }
+      else if (powerControl)
+        {
+          // Only interference neighbors of the chosen power must be silent
+          slotStart = m_channel->GetMaxTimeoutEnd (GetInterferenceNeighbors (powerLevel), slotStart);
+        }
+      // 3. Schedule MAC-low send event for packet burst:
+      m_txStartEvents.push_back (Simulator::Schedule (slotStart - Simulator::Now (), &CollisionFreeMacImpl::StartTransmission, m_mac, frame, rate, powerLevel));
+      slotStart += airtime + guardInterval;
+      if (spatialReuse)
+        {
+          // Only admission of concurrent frames looks at registered transmissions, acknowledgement is registered on its own
+          std::vector<NeighborAwareSpectrumChannel::Transmission> legs =
+            GetFrameLegs (receiver, powerLevel, slotStart - airtime - guardInterval, dataDuration, airtime + guardInterval);
+          for (std::vector<NeighborAwareSpectrumChannel::Transmission>::const_iterator leg = legs.begin (); leg != legs.end (); ++leg)
+            {
+              m_channel->AddTransmission (leg->sender, leg->receiver, leg->start, leg->end, leg->powerLevel);
+            }
+        }
+      if (frame == m_arqFrame)
+        {
+          m_arqTimeout = Simulator::Schedule (slotStart - Simulator::Now (), &AccessManager::ArqTimeout, this);
+        }
+    }
+  if (!m_txStartEvents.empty ())
+    {
+      // 4. Update timeout end once for all reserved slots:
+      m_timeoutEnd = slotStart;
+      m_channel->SetTimeoutEnd (m_channelIndex, m_timeoutEnd);
+      NS_LOG_DEBUG ("now=" << Simulator::Now ().GetSeconds () << "s\t"
+                           << "txStart = " << txStart.GetSeconds () << "s\t"
+                           << "txEnd = " << GetTimeoutEnd ().GetSeconds () << "s\t"
+                           << "slots = " << m_txStartEvents.size ());
+      NS_ASSERT (m_accessTimeout.IsExpired ());
+      StartAccessIfNeeded ();
+    }
+  // Both may wake device queue and bring new packets from traffic control layer, so they go last:
+  if (m_queueInterface != 0)
+    {
+      m_queueInterface->GetTxQueue (0)->NotifyTransmittedBytes (dequeuedBytes);
+    }
+  WakeQueueIfNeeded ();
+}
+
+Ptr<Packet>
+AccessManager::DequeueBurst (Ptr<Phy> phy, DataRate & rate, Mac48Address & destination, uint32_t & dequeuedBytes)
+{
+  dequeuedBytes = 0;
+  rate = phy->GetRate ();
   PacketList burst;
-  Ptr<const Packet> currentPacket = m_queue->Dequeue ();
-  if (currentPacket == 0)
+  Address firstDestination;
+  bool commonDestination = true;
+  MacSubframeHeader subframe;
+  uint32_t burstSize = m_mac->GetMacHeaderSize ();
+  if (m_arq)
     {
-      // May be if packet was timed out:
-      return;
+      // Room for the sequence number behind the MAC header: the burst is not known to be unicast until it is complete
+      burstSize += MacArqHeader ().GetSerializedSize ();
     }
-  // 3. Update timeout end:
-  Ptr<Phy> phy = m_mac->GetPhy ()->GetObject<Phy> ();
-  NS_ASSERT_MSG (phy != 0, "Collision free MAC works with LrrPhy or any other that supports GetRate method");
-  m_timeoutEnd = txStart + phy->GetRate ().CalculateBytesTxTime (currentPacket->GetSize ()) + m_guardInterval;
-  NS_LOG_DEBUG ("now=" << Simulator::Now ().GetSeconds () << "s\t"
-                       << "txStart = " << txStart.GetSeconds () << "s\t"
-                       << "txEnd = " << GetTimeoutEnd ().GetSeconds () << "s");
-  // 4. Schedule MAC-low send event for packet burst:
-  NS_ASSERT (m_accessTimeout.IsExpired ());
-  m_txStartEvent = Simulator::Schedule (txDelay, &CollisionFreeMacImpl::StartTransmission, m_mac, currentPacket);
-  StartAccessIfNeeded ();
+  Time maxBurstDuration = m_maxBurstDuration;
+  if ((m_tdmaScheduler != 0) && !maxBurstDuration.IsZero ())
+    {
+      // Burst with guard interval (and acknowledgement) must fit into a slot
+      Time slotAirtime = m_tdmaScheduler->GetSlotDuration () - GetGuardInterval ();
+      if (m_arq)
+        {
+          slotAirtime -= m_sifs + GetAckDuration (phy);
+        }
+      maxBurstDuration = std::min (maxBurstDuration, slotAirtime);
+    }
+  for (uint32_t index = SelectClass (); index < m_classes.size (); index = SelectClass ())
+    {
+      TrafficClass & tc = m_classes[index];
+      QueueTag info;
+      if (!burst.empty ())
+        {
+          // Check limits before the next packet is taken, the whole burst goes at the lowest rate:
+          Ptr<const Packet> next = tc.queue->Peek ();
+          uint32_t size = burstSize + subframe.GetSerializedSize () + next->GetSize ();
+          next->PeekPacketTag (info);
+          DataRate candidateRate = std::min (rate, phy->GetRate (info.destination));
+          if ((maxBurstDuration.IsZero ()) || (size > m_maxBurstSize)
+              || (candidateRate.CalculateBytesTxTime (size) > maxBurstDuration))
+            {
+              break;
+            }
+        }
+      Ptr<Packet> packet = tc.queue->Dequeue ();
+      if (tc.queue->IsEmpty ())
+        {
+          // Class is not backlogged any more: its turn is over
+          tc.deficit = 0;
+          m_drrCurrent = (m_drrCurrent + 1) % m_classes.size ();
+          m_drrNewTurn = true;
+        }
+      if (packet == 0)
+        {
+          continue;
+        }
+      packet->RemovePacketTag (info);
+      dequeuedBytes += packet->GetSize ();
+      Time sojourn = Simulator::Now () - info.enqueued;
+      m_queueDelayTrace (index, sojourn);
+      if (m_codel && CoDelDrop (tc, sojourn))
+        {
+          NS_LOG_DEBUG ("CoDel drop in class " << index << ", sojourn " << sojourn);
+          m_codelDropCount++;
+          m_codelDropTrace (index, packet);
+          continue;
+        }
+      tc.deficit -= std::min (tc.deficit, packet->GetSize ());
+      if (burst.empty ())
+        {
+          firstDestination = info.destination;
+          rate = phy->GetRate (firstDestination);
+        }
+      else
+        {
+          rate = std::min (rate, phy->GetRate (info.destination));
+        }
+      commonDestination &= (firstDestination == info.destination);
+      burstSize += subframe.GetSerializedSize () + packet->GetSize ();
+      burst.push_back (std::make_pair (rate.CalculateBytesTxTime (packet->GetSize ()), packet));
+    }
+  if (burst.empty ())
+    {
+      return 0;
+    }
+  destination = Mac48Address::GetBroadcast ();
+  if (commonDestination)
+    {
+      destination = Mac48Address::ConvertFrom (firstDestination);
+    }
+  if (burst.size () == 1)
+    {
+      return burst.front ().second;
+    }
+  // Aggregate: outer header followed by (length, packet) subframes
+  Ptr<Packet> aggregate = Create<Packet> ();
+  for (PacketList::const_iterator i = burst.begin (); i != burst.end (); ++i)
+    {
+      NS_ASSERT (i->second->GetSize () <= 0xffff);
+      subframe.SetLength (i->second->GetSize ());
+      i->second->AddHeader (subframe);
+      aggregate->AddAtEnd (i->second);
+    }
+  m_mac->AddMacHeader (aggregate, destination, Mac48Address::ConvertFrom (m_mac->GetAddress ()), MacHeader::AGGREGATE_TYPE);
+  NS_LOG_DEBUG ("Aggregated " << burst.size () << " packets, " << aggregate->GetSize () << " bytes");
+  return aggregate;
+}
+
+bool
+AccessManager::CoDelDrop (TrafficClass & tc, Time sojourn)
+{
+  Time now = Simulator::Now ();
+  bool okToDrop = false;
+  if ((sojourn < m_codelTarget) || (tc.queue->GetNBytes () <= m_mac->GetMaxMsduSize ()))
+    {
+      // Went below target or too few bytes to keep a queue
+      tc.firstAboveTime = Seconds (0);
+    }
+  else if (tc.firstAboveTime.IsZero ())
+    {
+      tc.firstAboveTime = now + m_codelInterval;
+    }
+  else if (now >= tc.firstAboveTime)
+    {
+      okToDrop = true;
+    }
+  if (tc.dropping)
+    {
+      if (!okToDrop)
+        {
+          tc.dropping = false;
+          return false;
+        }
+      if (now < tc.dropNext)
+        {
+          return false;
+        }
+      tc.count++;
+      tc.dropNext = CoDelControlLaw (tc.dropNext, tc.count);
+      return true;
+    }
+  if (!okToDrop)
+    {
+      return false;
+    }
+  // Enter dropping state, start from the previous drop rate if it was recently left
+  tc.dropping = true;
+  uint32_t delta = tc.count - tc.lastCount;
+  if ((delta > 1) && (now - tc.dropNext < Seconds (16 * m_codelInterval.GetSeconds ())))
+    {
+      tc.count = delta;
+    }
+  else
+    {
+      tc.count = 1;
+    }
+  tc.lastCount = tc.count;
+  tc.dropNext = CoDelControlLaw (now, tc.count);
+  return true;
 }
 
 Time
-AccessManager::CalculateTxStartTime ()
+AccessManager::CoDelControlLaw (Time t, uint32_t count) const
 {
-  Time nbrTimeoutEnd = Simulator::Now ();
-  NS_ASSERT (m_mac->GetPhy ()->GetObject<Phy> () != 0);
-  UpdateInterferenceNeighbors ();
-  for (std::vector<Ptr<NetDevice> >::const_iterator i = m_interferenceNeighbors.begin (); i != m_interferenceNeighbors.end (); i++)
+  return t + Seconds (m_codelInterval.GetSeconds () / std::sqrt ((double) count));
+}
+
+Time
+AccessManager::GetAckDuration (Ptr<Phy> phy) const
+{
+  return phy->GetRate ().CalculateBytesTxTime (m_mac->GetMacHeaderSize () + MacSequenceHeader ().GetSerializedSize ());
+}
+
+void
+AccessManager::ArqTimeout ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_arqFrame != 0)
     {
-      Ptr<NeighborAwareDeviceImpl> device = (*i)->GetObject<NeighborAwareDeviceImpl> ();
-      if (device == 0)
+      ArqStats & stats = m_arqStats[m_arqDestination];
+      if (m_arqRetries < m_maxRetries)
         {
-          continue;
+          m_arqRetries++;
+          stats.retries++;
+          NS_LOG_DEBUG ("No acknowledgement from " << m_arqDestination << ", retry " << m_arqRetries);
+          m_arqRetryTrace (m_arqDestination, m_arqRetries);
         }
-      Ptr<CollisionFreeMacImpl> mac = device->GetMac ()->GetObject<CollisionFreeMacImpl>();
-      NS_ASSERT (mac != 0);
-      Time current = mac->GetAccessManager ()->GetTimeoutEnd ();
-      if (nbrTimeoutEnd < current)
+      else
         {
-          nbrTimeoutEnd = current;
+          stats.failures++;
+          NS_LOG_DEBUG ("No acknowledgement from " << m_arqDestination << ", frame is dropped");
+          m_arqFailureTrace (m_arqDestination, m_arqRetries);
+          m_arqFrame = 0;
         }
     }
-  return nbrTimeoutEnd;
+  StartAccessIfNeeded ();
+}
+
+bool
+AccessManager::ReceiveArq (Mac48Address from, uint16_t sequence)
+{
+  Ptr<Phy> phy = m_mac->GetPhy ()->GetObject<Phy> ();
+  Ptr<Packet> ack = Create<Packet> ();
+  ack->AddHeader (MacSequenceHeader (sequence));
+  m_mac->AddMacHeader (ack, from, Mac48Address::ConvertFrom (m_mac->GetAddress ()), MacHeader::ACK_TYPE);
+  // Medium is reserved by the sender:
+  Simulator::Schedule (m_sifs, &CollisionFreeMacImpl::StartTransmission, m_mac, ack, phy->GetRate (), phy->GetTxPowerLevel (from));
+  std::map<Mac48Address, uint16_t>::iterator i = m_arqLastReceived.find (from);
+  if ((i != m_arqLastReceived.end ()) && (i->second == sequence))
+    {
+      // Acknowledgement was lost, frame is retransmitted
+      return false;
+    }
+  m_arqLastReceived[from] = sequence;
+  return true;
+}
+
+void
+AccessManager::ReceiveAck (Mac48Address from, uint16_t sequence)
+{
+  if ((m_arqFrame == 0) || (from != m_arqDestination) || (sequence != m_arqSequence))
+    {
+      return;
+    }
+  NS_LOG_DEBUG ("Acknowledged by " << from << " after " << m_arqRetries << " retries");
+  m_arqStats[from].acked++;
+  m_arqFrame = 0;
+}
+
+AccessManager::ArqStats
+AccessManager::GetArqStats (Mac48Address destination) const
+{
+  std::map<Mac48Address, ArqStats>::const_iterator i = m_arqStats.find (destination);
+  if (i == m_arqStats.end ())
+    {
+      ArqStats empty = {0, 0, 0, 0};
+      return empty;
+    }
+  return i->second;
+}
+
+Time
+AccessManager::GetGuardInterval () const
+{
+  if (!m_adaptiveGuardInterval || (m_tdmaScheduler != 0))
+    {
+      return m_guardInterval;
+    }
+  // Acknowledgement comes back after a round trip:
+  return (m_arq ? m_maxPropagationDelay + m_maxPropagationDelay : m_maxPropagationDelay) + m_preamble;
+}
+
+Time
+AccessManager::CalculateTxStartTime ()
+{
+  if (m_tdmaScheduler != 0)
+    {
+      if (m_channel == 0)
+        {
+          Ptr<Phy> phy = m_mac->GetPhy ()->GetObject<Phy> ();
+          m_channel = phy->GetNeighborAwareChannel ();
+          m_channelIndex = phy->GetChannelIndex ();
+        }
+      return m_tdmaScheduler->GetSlotStart (m_channelIndex, Simulator::Now ());
+    }
+  UpdateInterferenceNeighbors ();
+  return m_channel->GetMaxTimeoutEnd (m_interferenceNeighbors, Simulator::Now ());
 }
 
 Time
@@ -177,21 +817,41 @@ AccessManager::GetTimeoutEnd ()
 void
 AccessManager::SetQueue (Ptr<Queue<Packet> > queue)
 {
-  m_queue = queue;
+  if (m_classes.empty ())
+    {
+      AddTrafficClass (queue, 0);
+      return;
+    }
+  NS_ASSERT (m_classes[0].queue->IsEmpty ());
+  m_classes[0].queue = queue;
 }
 
 Ptr<Queue<Packet> >
-AccessManager::GetQueue () const
+AccessManager::GetQueue (uint32_t trafficClass) const
 {
-  return m_queue;
+  if (trafficClass >= m_classes.size ())
+    {
+      return 0;
+    }
+  return m_classes[trafficClass].queue;
 }
 
 void
 AccessManager::DoDispose ()
 {
   m_accessTimeout.Cancel ();
-  m_txStartEvent.Cancel ();
-  m_queue = 0;
+  for (std::vector<EventId>::iterator i = m_txStartEvents.begin (); i != m_txStartEvents.end (); ++i)
+    {
+      i->Cancel ();
+    }
+  m_txStartEvents.clear ();
+  m_arqTimeout.Cancel ();
+  m_arqFrame = 0;
+  m_classes.clear ();
+  m_queueInterface = 0;
+  m_tdmaScheduler = 0;
+  m_channel = 0;
+  m_interferenceNeighbors.clear ();
   m_mac = 0;
 }
 
@@ -199,12 +859,205 @@ void
 AccessManager::UpdateInterferenceNeighbors ()
 {
   Time now = Simulator::Now ();
-  if (m_lastInterferenceNeighborsUpdate + m_interferenceNeighborUpdatePeriod > now)
+  if ((m_channel != 0) && (m_lastInterferenceNeighborsUpdate + m_interferenceNeighborUpdatePeriod > now))
     {
       return;
     }
   m_lastInterferenceNeighborsUpdate = now;
-  m_interferenceNeighbors = m_mac->GetPhy ()->GetObject<Phy> ()->GetInterferenceNeighbors ();
+  Ptr<Phy> phy = m_mac->GetPhy ()->GetObject<Phy> ();
+  NS_ASSERT (phy != 0);
+  m_channel = phy->GetNeighborAwareChannel ();
+  m_channelIndex = phy->GetChannelIndex ();
+  m_interferenceNeighbors = phy->GetInterferenceNeighborIndexes ();
+  m_maxPropagationDelay = m_channel->GetMaxPropagationDelay (m_channelIndex, m_interferenceNeighbors);
+  m_levelInterferenceNeighbors.clear ();
+  for (uint32_t level = 1; level < phy->GetNTxPowerLevels (); level++)
+    {
+      m_levelInterferenceNeighbors.push_back (phy->GetInterferenceNeighborIndexes (level));
+    }
+  phy->UpdateLinkTables ();
+  if (!m_spatialReuse)
+    {
+      return;
+    }
+  m_neighborIndexes.clear ();
+  std::vector<Ptr<NetDevice> > neighbors = phy->GetCommunicationNeighbors ();
+  for (std::vector<Ptr<NetDevice> >::const_iterator i = neighbors.begin (); i != neighbors.end (); ++i)
+    {
+      Ptr<Phy> neighborPhy = (*i)->GetObject<NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<Phy> ();
+      m_neighborIndexes[Mac48Address::ConvertFrom ((*i)->GetAddress ())] = neighborPhy->GetChannelIndex ();
+    }
+}
+
+const std::vector<uint32_t> &
+AccessManager::GetInterferenceNeighbors (uint32_t powerLevel) const
+{
+  if ((powerLevel == 0) || (powerLevel > m_levelInterferenceNeighbors.size ()))
+    {
+      return m_interferenceNeighbors;
+    }
+  return m_levelInterferenceNeighbors[powerLevel - 1];
+}
+
+Time
+AccessManager::CalculateAdmittedTxStartTime (uint32_t receiver, uint32_t powerLevel, Time start, Time dataDuration, Time duration)
+{
+  std::vector<NeighborAwareSpectrumChannel::Transmission> transmissions = m_channel->GetTransmissions (start, Time::Max ());
+  // Slot may start now or when some scheduled transmission ends:
+  std::vector<Time> candidates (1, start);
+  for (std::vector<NeighborAwareSpectrumChannel::Transmission>::const_iterator i = transmissions.begin (); i != transmissions.end (); ++i)
+    {
+      candidates.push_back (i->end);
+    }
+  std::sort (candidates.begin (), candidates.end ());
+  for (std::vector<Time>::const_iterator i = candidates.begin (); i != candidates.end (); ++i)
+    {
+      std::vector<NeighborAwareSpectrumChannel::Transmission> legs = GetFrameLegs (receiver, powerLevel, *i, dataDuration, duration);
+      bool admitted = true;
+      for (std::vector<NeighborAwareSpectrumChannel::Transmission>::const_iterator leg = legs.begin (); admitted && (leg != legs.end ()); ++leg)
+        {
+          admitted = IsAdmitted (*leg, transmissions);
+        }
+      if (admitted)
+        {
+          return *i;
+        }
+    }
+  // Nothing is scheduled after the last one:
+  return candidates.back ();
+}
+
+std::vector<NeighborAwareSpectrumChannel::Transmission>
+AccessManager::GetFrameLegs (uint32_t receiver, uint32_t powerLevel, Time start, Time dataDuration, Time duration) const
+{
+  NeighborAwareSpectrumChannel::Transmission data = {m_channelIndex, receiver, start, start + duration, powerLevel};
+  std::vector<NeighborAwareSpectrumChannel::Transmission> legs (1, data);
+  if ((receiver == NeighborAwareSpectrumChannel::NO_RECEIVER) || (dataDuration >= duration))
+    {
+      return legs;
+    }
+  // Acknowledgement comes back from the receiver at the power level it uses for me:
+  Ptr<Phy> receiverPhy = m_channel->GetPhy (receiver)->GetObject<Phy> ();
+  legs[0].end = start + dataDuration;
+  NeighborAwareSpectrumChannel::Transmission ack = {receiver, m_channelIndex, start + dataDuration, start + duration,
+                                                    receiverPhy->GetTxPowerLevel (m_mac->GetAddress ())};
+  legs.push_back (ack);
+  return legs;
+}
+
+bool
+AccessManager::IsAdmitted (const NeighborAwareSpectrumChannel::Transmission & leg,
+                           const std::vector<NeighborAwareSpectrumChannel::Transmission> & transmissions) const
+{
+  Ptr<Phy> senderPhy = m_channel->GetPhy (leg.sender)->GetObject<Phy> ();
+  Ptr<Phy> receiverPhy = m_channel->GetPhy (leg.receiver)->GetObject<Phy> ();
+  Time guardInterval = GetGuardInterval ();
+  double interferenceMw = 0;
+  std::vector<NeighborAwareSpectrumChannel::Transmission> concurrent;
+  std::vector<Ptr<Phy> > concurrentSenders;
+  for (std::vector<NeighborAwareSpectrumChannel::Transmission>::const_iterator i = transmissions.begin (); i != transmissions.end (); ++i)
+    {
+      if ((i->start >= leg.end) || (i->end <= leg.start))
+        {
+          continue;
+        }
+      // Half duplex: both stations are idle and the receiver gets a single frame
+      if ((i->sender == leg.sender) || (i->receiver == leg.sender) || (i->sender == leg.receiver) || (i->receiver == leg.receiver))
+        {
+          return false;
+        }
+      if (i->receiver == NeighborAwareSpectrumChannel::NO_RECEIVER)
+        {
+          // Receivers are unknown: protected by interference neighborhood as usual
+          if (std::find (m_interferenceNeighbors.begin (), m_interferenceNeighbors.end (), i->sender) != m_interferenceNeighbors.end ())
+            {
+              return false;
+            }
+          continue;
+        }
+      Ptr<Phy> otherSenderPhy = m_channel->GetPhy (i->sender)->GetObject<Phy> ();
+      double powerMw = receiverPhy->GetAverageRxPowerMw (otherSenderPhy, i->powerLevel);
+      if (receiverPhy->IsDetected (powerMw) && (i->start < leg.start + guardInterval))
+        {
+          // The receiver would lock to that signal
+          return false;
+        }
+      interferenceMw += powerMw;
+      concurrent.push_back (*i);
+      concurrentSenders.push_back (otherSenderPhy);
+    }
+  if (!receiverPhy->IsSinrSufficient (receiverPhy->GetAverageRxPowerMw (senderPhy, leg.powerLevel), interferenceMw))
+    {
+      return false;
+    }
+  // Vice versa: SINR of every concurrent receiver with this signal added
+  for (uint32_t k = 0; k < concurrent.size (); k++)
+    {
+      Ptr<Phy> otherReceiverPhy = m_channel->GetPhy (concurrent[k].receiver)->GetObject<Phy> ();
+      double legPowerMw = otherReceiverPhy->GetAverageRxPowerMw (senderPhy, leg.powerLevel);
+      if (otherReceiverPhy->IsDetected (legPowerMw) && (leg.start < concurrent[k].start + guardInterval))
+        {
+          return false;
+        }
+      double otherInterferenceMw = legPowerMw;
+      for (uint32_t j = 0; j < concurrent.size (); j++)
+        {
+          if (j != k)
+            {
+              otherInterferenceMw += otherReceiverPhy->GetAverageRxPowerMw (concurrentSenders[j], concurrent[j].powerLevel);
+            }
+        }
+      if (!otherReceiverPhy->IsSinrSufficient (otherReceiverPhy->GetAverageRxPowerMw (concurrentSenders[k], concurrent[k].powerLevel), otherInterferenceMw))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+TypeId
+AccessManager::QueueTag::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::AccessManager::QueueTag")
+    .SetParent<Tag> ()
+    .AddConstructor<QueueTag> ();
+  return tid;
+}
+
+TypeId
+AccessManager::QueueTag::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+AccessManager::QueueTag::GetSerializedSize () const
+{
+  return 6 + sizeof (int64_t);
+}
+
+void
+AccessManager::QueueTag::Serialize (TagBuffer i) const
+{
+  uint8_t address[6];
+  destination.CopyTo (address);
+  i.Write (address, 6);
+  i.WriteU64 (enqueued.GetTimeStep ());
+}
+
+void
+AccessManager::QueueTag::Deserialize (TagBuffer i)
+{
+  uint8_t address[6];
+  i.Read (address, 6);
+  destination.CopyFrom (address);
+  enqueued = TimeStep (i.ReadU64 ());
+}
+
+void
+AccessManager::QueueTag::Print (std::ostream &os) const
+{
+  os << "Destination = " << destination << ", enqueued = " << enqueued;
 }
 
 } // namespace lrr
@@ -26,84 +26,346 @@
 #include "ns3/net-device.h"
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
+#include "ns3/data-rate.h"
+#include "ns3/mac48-address.h"
+#include "ns3/traced-callback.h"
+#include "ns3/traced-value.h"
+#include "ns3/tag.h"
+#include "ns3/lrr-channel.h"
+#include <list>
+#include <map>
 
 namespace ns3 {
 
 template <typename Item> class Queue;
+class NetDeviceQueueInterface;
 
 namespace lrr {
 
-class Mac;
+class CollisionFreeMacImpl;
+class Phy;
+class TdmaScheduler;
 /**
  * \ingroup lrr
  * \brief Core block of Collision-less MAC layer. Operates as follows:
  * 1. Each station takes into account all transmissions by all stations inside the interference area
  * 2. After medium is occupied, a special TimeoutEnd value is set (which is txStart + txDuration).
  * 3. When a new packet arrives, station may start to transmit at moment equals to maximum timeout
- *    end among all neighbors. Timeout end is updated when sending a packet to LOW.
+ *    end among all neighbors. Timeout end is updated when sending a packet to LOW. Timeout ends
+ *    are published in the reservation table of the channel, indexed by PHY ordinal.
+ *    Each frame is followed by a guard interval: GuardInterval or, with AdaptiveGuardInterval, max
+ *    propagation delay to interference neighbors plus Preamble.
+ * 4. If MaxBurstDuration is not zero, queued packets are aggregated into one PHY frame
+ *    (the first one is always sent), so the guard interval is paid once per burst.
+ * 5. With Lookahead above one, a single access reserves up to Lookahead back-to-back
+ *    frames (each followed by a guard interval) after one neighbor scan.
  *
+ * Packets are classified by protocol number or DSCP into traffic classes, each one
+ * having its own queue. Classes are served in strict priority order (higher value first),
+ * classes of the same priority share the medium by deficit round robin.
+ * Class 0 is a default one, its queue is set by SetQueue.
+ *
+ * If device has NetDeviceQueueInterface, its TX queue is stopped when any class queue
+ * is full and woken when all of them may accept a packet again. Queued and dequeued bytes
+ * are reported for byte queue limits.
+ *
+ * Optionally CoDel (RFC 8289) controls sojourn time of each class queue: packets are
+ * timestamped at Enqueue and dropped by CoDel control law when dequeued for access.
+ *
+ * With Arq enabled, unicast frames are acknowledged (stop-and-wait): the slot of such a frame
+ * also reserves Sifs and an acknowledgement at the base PHY rate, and no further slots are
+ * reserved until the acknowledgement is due. A frame which is not acknowledged is retransmitted
+ * in the next access up to MaxRetries times. Guard interval must cover the round trip
+ * propagation delay.
+ *
+ * With SpatialReuse, a unicast frame is not delayed by interference neighbors: its slot starts at
+ * the first moment when SINR of its receiver and of all receivers of concurrent scheduled
+ * transmissions stays above neighbor detection threshold, and no receiver locks to a wrong
+ * signal. Deterministic loss of the channel is used. Group frames and transmissions are
+ * protected by interference neighborhood as before.
+ *
+ * If PHY has several TX power levels, a frame to a neighbor goes at the power chosen by PHY for
+ * the link, and only interference neighbors of that power must be silent.
+ *
+ * If TDMA scheduler is set (by TdmaMacImpl), frames start only in slots assigned to this
+ * station, neither timeout ends of neighbors nor spatial reuse are considered.
  */
 class AccessManager : public Object
 {
+public:
+  /// Queue delay trace signature: traffic class and time spent in the queue
+  typedef void (* QueueDelayTracedCallback)(uint32_t trafficClass, Time delay);
+  /// CoDel drop trace signature: traffic class and dropped packet
+  typedef void (* DropTracedCallback)(uint32_t trafficClass, Ptr<const Packet> packet);
+  /// ARQ trace signature: destination and the number of retries made
+  typedef void (* ArqTracedCallback)(Mac48Address destination, uint32_t retries);
+  /// Per-link ARQ statistics
+  struct ArqStats
+  {
+    /// Frames sent to the link (not counting retransmissions)
+    uint32_t frames;
+    uint32_t acked;
+    uint32_t retries;
+    /// Frames dropped after MaxRetries retransmissions
+    uint32_t failures;
+  };
 public:
   static TypeId GetTypeId ();
   AccessManager ();
   ~AccessManager ();
-  /// Packet from net devices goes to queue:
-  void Enqueue (Ptr<const Packet> packet);
+  /**
+   * \brief Packet from net devices goes to queue, it is owned by MAC and not copied
+   * \param packet has MAC header
+   * \param destination is needed for aggregation
+   * \param trafficClass is given by Classify
+   * \return false if packet was dropped by the queue
+   */
+  bool Enqueue (Ptr<Packet> packet, Address destination, uint32_t trafficClass = 0);
   /// Callback to pass packet to PHY for transmission:
-  void SetMac (Ptr<Mac> mac);
+  void SetMac (Ptr<CollisionFreeMacImpl> mac);
   /// Timeout end is needed for neighbors:
   Time GetTimeoutEnd ();
+  /// Transmit in slots assigned by a TDMA scheduler
+  void SetTdmaScheduler (Ptr<TdmaScheduler> scheduler);
   ///\name Queue:
+  ///\{
+  /// Set queue of the default traffic class
   void SetQueue (Ptr<Queue<Packet> > queue);
-  Ptr<Queue<Packet> > GetQueue () const;
+  Ptr<Queue<Packet> > GetQueue (uint32_t trafficClass = 0) const;
+  /// Device queue interface for flow control, may be null
+  void SetQueueInterface (Ptr<NetDeviceQueueInterface> queueInterface);
+  ///\}
+  ///\name Traffic classes:
+  ///\{
+  /**
+   * \brief Add a traffic class
+   * \param queue of the class
+   * \param priority classes with higher priority are served first
+   * \param quantum bytes per deficit round robin turn among classes of the same priority
+   * \return index of the class
+   */
+  uint32_t AddTrafficClass (Ptr<Queue<Packet> > queue, uint32_t priority, uint32_t quantum = 1500);
+  uint32_t GetNTrafficClasses () const;
+  /// Map an overlying protocol number to a traffic class
+  void SetProtocolClass (uint16_t protocol, uint32_t trafficClass);
+  /// Map DSCP of IPv4 packets to a traffic class (takes precedence over protocol)
+  void SetDscpClass (uint8_t dscp, uint32_t trafficClass);
+  /// \return traffic class of a packet without MAC header
+  uint32_t Classify (Ptr<const Packet> packet, uint16_t protocol) const;
+  ///\}
+  ///\name ARQ:
+  ///\{
+  /**
+   * \brief Frame to be acknowledged is received, acknowledgement is sent after Sifs
+   * \return false if the frame is a duplicate of the last one from this source
+   */
+  bool ReceiveArq (Mac48Address from, uint16_t sequence);
+  /// Acknowledgement is received
+  void ReceiveAck (Mac48Address from, uint16_t sequence);
+  ArqStats GetArqStats (Mac48Address destination) const;
+  ///\}
 private:
   /// Packet list consists of pairs (duration, packet), needed for aggregation
-  typedef std::list<std::pair<Time, Ptr<const Packet> > > PacketList;
+  typedef std::list<std::pair<Time, Ptr<Packet> > > PacketList;
+  /// Per-packet data attached when a packet is enqueued and removed when it is dequeued
+  class QueueTag : public Tag
+  {
+public:
+    Mac48Address destination;
+    Time enqueued;
+
+    QueueTag () : Tag () {}
+    QueueTag (Mac48Address d, Time e) : Tag (), destination (d), enqueued (e) {}
+
+    ///\name Inherited from Tag
+    ///\{
+    static TypeId GetTypeId ();
+    TypeId GetInstanceTypeId () const;
+    uint32_t GetSerializedSize () const;
+    void Serialize (TagBuffer i) const;
+    void Deserialize (TagBuffer i);
+    void Print (std::ostream &os) const;
+    ///\}
+  };
+  /// Queue with its scheduling parameters
+  struct TrafficClass
+  {
+    Ptr<Queue<Packet> > queue;
+    uint32_t priority;
+    uint32_t quantum;
+    uint32_t deficit;
+    ///\name CoDel state
+    ///\{
+    bool dropping;
+    Time firstAboveTime;
+    Time dropNext;
+    uint32_t count;
+    uint32_t lastCount;
+    ///\}
+  };
 private:
   /// Start access if not started and queue is not empty
   void StartAccessIfNeeded ();
+  /// \return true if all queues are empty
+  bool IsQueueEmpty () const;
+  /**
+   * \brief Pick a class to be served next: strict priority, then deficit round robin
+   * \return class index or number of classes if all queues are empty
+   */
+  uint32_t SelectClass ();
+  /// \return true if queue of a class can not accept a max size packet
+  bool IsClassQueueFull (uint32_t trafficClass) const;
+  /// Wake device TX queue if it was stopped and all class queues have room
+  void WakeQueueIfNeeded ();
+  /**
+   * \brief CoDel dequeue decision for a packet just dequeued from a class queue
+   * \param sojourn is a time spent by the packet in the queue
+   * \return true if the packet must be dropped
+   */
+  bool CoDelDrop (TrafficClass & tc, Time sojourn);
+  /// CoDel control law: next drop time
+  Time CoDelControlLaw (Time t, uint32_t count) const;
   /**
    * \brief Core function: start access to the medium:
    * 1. Calculate TX-start time (among neighbors)
-   * 2. Construct a packet burst (timed out packets are dropped automatically by queue)
-   * 3. Update timeout end
-   * 4. Schedule MAC send event for packet list (aggregation).
+   * 2. Construct packet bursts for up to Lookahead slots (timed out packets are dropped automatically by queue)
+   * 3. Schedule MAC send event for each burst
+   * 4. Update timeout end
    */
   void StartAccess ();
-  /// Get timeout and timeout end from all neighbors and return a max timeout end value.
+  /**
+   * Get timeout end of all neighbors from channel reservation table and return a max timeout end value.
+   * With TDMA scheduler: start of the next own slot.
+   */
   Time CalculateTxStartTime ();
   /// Update interference neighbors cache if it is too old
   void UpdateInterferenceNeighbors ();
+  /**
+   * \brief Dequeue packets within burst limits and make a PHY frame
+   * \param phy gives a rate to each destination
+   * \param rate is set to the frame rate: the lowest rate of all its destinations
+   * \param destination is set to the frame destination (broadcast if destinations differ)
+   * \param dequeuedBytes is set to the size of dequeued packets
+   * \return a single packet or an aggregate
+   */
+  Ptr<Packet> DequeueBurst (Ptr<Phy> phy, DataRate & rate, Mac48Address & destination, uint32_t & dequeuedBytes);
+  /// Acknowledgement is due: frame is retransmitted or dropped if not acknowledged
+  void ArqTimeout ();
+  /// Airtime of an acknowledgement
+  Time GetAckDuration (Ptr<Phy> phy) const;
+  /// Fixed or adaptive guard interval after each frame
+  Time GetGuardInterval () const;
+  ///\name Spatial reuse admission:
+  ///\{
+  /// \return the earliest start not before \param start, when all legs of a slot of \param duration to \param receiver are admitted
+  Time CalculateAdmittedTxStartTime (uint32_t receiver, uint32_t powerLevel, Time start, Time dataDuration, Time duration);
+  /**
+   * \brief Legs of a slot of \param duration to \param receiver: the frame takes \param dataDuration (with SIFS),
+   * the rest of the slot is an acknowledgement from the receiver to me. Without acknowledgement the frame takes the whole slot
+   */
+  std::vector<NeighborAwareSpectrumChannel::Transmission> GetFrameLegs (uint32_t receiver, uint32_t powerLevel,
+                                                                        Time start, Time dataDuration, Time duration) const;
+  /// \return true if a leg keeps SINR of its receiver and of all concurrent receivers
+  bool IsAdmitted (const NeighborAwareSpectrumChannel::Transmission & leg,
+                   const std::vector<NeighborAwareSpectrumChannel::Transmission> & transmissions) const;
+  ///\}
+  /// Interference neighbors of a given TX power level
+  const std::vector<uint32_t> & GetInterferenceNeighbors (uint32_t powerLevel) const;
   /// Object's destructor:
   void DoDispose ();
 private:
-  /// Queue for packets: non-qos simple queue
-  Ptr<Queue<Packet> > m_queue;
+  ///\name Traffic classes and their scheduling:
+  ///\{
+  std::vector<TrafficClass> m_classes;
+  std::map<uint16_t, uint32_t> m_protocolClass;
+  std::map<uint8_t, uint32_t> m_dscpClass;
+  /// Class visited by deficit round robin
+  uint32_t m_drrCurrent;
+  /// Quantum is not yet added to the visited class
+  bool m_drrNewTurn;
+  ///\}
+  /// Flow control with traffic control layer
+  Ptr<NetDeviceQueueInterface> m_queueInterface;
   /// Absolute time when others may start to TX
   Time m_timeoutEnd;
   /// Event scheduled for StartAccess method
   EventId m_accessTimeout;
-  /// Tx-start event:
-  EventId m_txStartEvent;
+  /// Tx-start events of reserved slots:
+  std::vector<EventId> m_txStartEvents;
   /// MAC pointer:
-  Ptr<Mac> m_mac;
+  Ptr<CollisionFreeMacImpl> m_mac;
+  /// Slots assigned by TDMA scheduler are used if set
+  Ptr<TdmaScheduler> m_tdmaScheduler;
+  ///\name ARQ state:
+  ///\{
+  /// Frame waiting for acknowledgement or retransmission (with ARQ header), null if none
+  Ptr<Packet> m_arqFrame;
+  Mac48Address m_arqDestination;
+  DataRate m_arqRate;
+  uint16_t m_arqSequence;
+  uint32_t m_arqRetries;
+  /// Scheduled at the end of the slot of the frame
+  EventId m_arqTimeout;
+  /// Next sequence number for each destination
+  std::map<Mac48Address, uint16_t> m_arqNextSequence;
+  /// Last sequence number received from each source
+  std::map<Mac48Address, uint16_t> m_arqLastReceived;
+  std::map<Mac48Address, ArqStats> m_arqStats;
+  ///\}
 private:
   ///\name Attributes
   ///\{
   /// take propagation delay+preamble into account
   Time m_guardInterval;
+  /// Guard interval is derived from propagation delay to interference neighbors
+  bool m_adaptiveGuardInterval;
+  Time m_preamble;
+  /// Max airtime of aggregated frame, zero disables aggregation
+  Time m_maxBurstDuration;
+  /// Max size of aggregated frame
+  uint32_t m_maxBurstSize;
+  /// Number of slots reserved by a single access
+  uint32_t m_lookahead;
+  /// CoDel is enabled
+  bool m_codel;
+  /// CoDel acceptable sojourn time
+  Time m_codelTarget;
+  /// CoDel sliding minimum window
+  Time m_codelInterval;
+  /// Unicast frames are acknowledged
+  bool m_arq;
+  /// Gap between a frame and its acknowledgement
+  Time m_sifs;
+  uint32_t m_maxRetries;
+  /// Admission by SINR instead of interference neighborhood
+  bool m_spatialReuse;
   ///\}
   ///\name Interference Neighbors cache:
   ///\{
-  /// Stored neighbors:
-  std::vector<Ptr<NetDevice> > m_interferenceNeighbors;
+  /// Channel with reservation table and own PHY ordinal in it
+  Ptr<NeighborAwareSpectrumChannel> m_channel;
+  uint32_t m_channelIndex;
+  /// Stored neighbors (PHY ordinals):
+  std::vector<uint32_t> m_interferenceNeighbors;
+  /// Max propagation delay to them
+  Time m_maxPropagationDelay;
+  /// Interference neighbors of reduced TX power levels (starting with level one)
+  std::vector<std::vector<uint32_t> > m_levelInterferenceNeighbors;
+  /// PHY ordinals of communication neighbors (spatial reuse only)
+  std::map<Mac48Address, uint32_t> m_neighborIndexes;
   /// last update:
   Time m_lastInterferenceNeighborsUpdate;
   /// update period:
   Time m_interferenceNeighborUpdatePeriod;
   ///\}
+  ///\name Traces
+  ///\{
+  TracedCallback<uint32_t, Time> m_queueDelayTrace;
+  TracedCallback<uint32_t, Ptr<const Packet> > m_codelDropTrace;
+  TracedValue<uint32_t> m_codelDropCount;
+  TracedCallback<Mac48Address, uint32_t> m_arqRetryTrace;
+  TracedCallback<Mac48Address, uint32_t> m_arqFailureTrace;
+  ///\}
 };
 } // namespace lrr
 } // namespace ns3
@@ -29,6 +29,17 @@ namespace ns3 {
 namespace lrr {
 
 NS_OBJECT_ENSURE_REGISTERED (MacHeader);
+NS_OBJECT_ENSURE_REGISTERED (Mac48Header);
+NS_OBJECT_ENSURE_REGISTERED (ShortMacHeader);
+NS_OBJECT_ENSURE_REGISTERED (MacSubframeHeader);
+NS_OBJECT_ENSURE_REGISTERED (MacSequenceHeader);
+NS_OBJECT_ENSURE_REGISTERED (MacArqHeader);
+
+const uint16_t MacHeader::AGGREGATE_TYPE;
+const uint16_t MacHeader::ARQ_TYPE;
+const uint16_t MacHeader::ACK_TYPE;
+const uint16_t ShortMacHeader::BROADCAST;
+const uint16_t ShortMacHeader::MULTICAST;
 // Setters and getters {
 MacHeader::MacHeader ()
   : m_type (0),
@@ -126,5 +137,376 @@ MacHeader::GetSerializedSize () const
   return 1 + m_source.GetLength () * 2 + 2;
 }
 // }
+
+Mac48Header::Mac48Header ()
+  : m_type (0)
+{
+}
+
+void
+Mac48Header::SetType (uint16_t type)
+{
+  m_type = type;
+}
+
+uint16_t
+Mac48Header::GetType () const
+{
+  return m_type;
+}
+
+void
+Mac48Header::SetSource (Mac48Address source)
+{
+  m_source = source;
+}
+
+Mac48Address
+Mac48Header::GetSource () const
+{
+  return m_source;
+}
+
+void
+Mac48Header::SetDestination (Mac48Address destination)
+{
+  m_destination = destination;
+}
+
+Mac48Address
+Mac48Header::GetDestination () const
+{
+  return m_destination;
+}
+
+TypeId
+Mac48Header::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::Mac48Header")
+    .SetParent<Header> ()
+    .AddConstructor<Mac48Header> ()
+  ;
+  return tid;
+}
+
+TypeId
+Mac48Header::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+Mac48Header::Print (std::ostream &os) const
+{
+  os << " type=0x" << std::hex << m_type << std::dec
+     << ", source=" << m_source
+     << ", destination=" << m_destination;
+}
+
+void
+Mac48Header::Serialize (Buffer::Iterator start) const
+{
+  uint8_t buffer[12];
+  m_destination.CopyTo (buffer);
+  m_source.CopyTo (buffer + 6);
+  start.Write (buffer, 12);
+  start.WriteHtonU16 (m_type);
+}
+
+uint32_t
+Mac48Header::Deserialize (Buffer::Iterator start)
+{
+  uint8_t buffer[12];
+  start.Read (buffer, 12);
+  m_destination.CopyFrom (buffer);
+  m_source.CopyFrom (buffer + 6);
+  m_type = start.ReadNtohU16 ();
+  return GetSerializedSize ();
+}
+
+uint32_t
+Mac48Header::GetSerializedSize () const
+{
+  return 6 * 2 + 2;
+}
+
+ShortMacHeader::ShortMacHeader ()
+  : m_type (0),
+  m_destination (0),
+  m_source (0)
+{
+}
+
+void
+ShortMacHeader::SetType (uint16_t type)
+{
+  m_type = type;
+}
+
+uint16_t
+ShortMacHeader::GetType () const
+{
+  return m_type;
+}
+
+void
+ShortMacHeader::SetSource (uint16_t source)
+{
+  m_source = source;
+}
+
+uint16_t
+ShortMacHeader::GetSource () const
+{
+  return m_source;
+}
+
+void
+ShortMacHeader::SetDestination (uint16_t destination)
+{
+  m_destination = destination;
+}
+
+uint16_t
+ShortMacHeader::GetDestination () const
+{
+  return m_destination;
+}
+
+TypeId
+ShortMacHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::ShortMacHeader")
+    .SetParent<Header> ()
+    .AddConstructor<ShortMacHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+ShortMacHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+ShortMacHeader::Print (std::ostream &os) const
+{
+  os << " type=0x" << std::hex << m_type
+     << ", source=0x" << m_source
+     << ", destination=0x" << m_destination << std::dec;
+}
+
+void
+ShortMacHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_destination);
+  start.WriteHtonU16 (m_source);
+  start.WriteHtonU16 (m_type);
+}
+
+uint32_t
+ShortMacHeader::Deserialize (Buffer::Iterator start)
+{
+  m_destination = start.ReadNtohU16 ();
+  m_source = start.ReadNtohU16 ();
+  m_type = start.ReadNtohU16 ();
+  return GetSerializedSize ();
+}
+
+uint32_t
+ShortMacHeader::GetSerializedSize () const
+{
+  return 3 * 2;
+}
+
+MacSubframeHeader::MacSubframeHeader (uint16_t length)
+  : m_length (length)
+{
+}
+
+void
+MacSubframeHeader::SetLength (uint16_t length)
+{
+  m_length = length;
+}
+
+uint16_t
+MacSubframeHeader::GetLength () const
+{
+  return m_length;
+}
+
+TypeId
+MacSubframeHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::MacSubframeHeader")
+    .SetParent<Header> ()
+    .AddConstructor<MacSubframeHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+MacSubframeHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+MacSubframeHeader::Print (std::ostream &os) const
+{
+  os << " length=" << m_length;
+}
+
+void
+MacSubframeHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_length);
+}
+
+uint32_t
+MacSubframeHeader::Deserialize (Buffer::Iterator start)
+{
+  m_length = start.ReadNtohU16 ();
+  return GetSerializedSize ();
+}
+
+uint32_t
+MacSubframeHeader::GetSerializedSize () const
+{
+  return 2;
+}
+
+MacSequenceHeader::MacSequenceHeader (uint16_t sequence)
+  : m_sequence (sequence)
+{
+}
+
+void
+MacSequenceHeader::SetSequence (uint16_t sequence)
+{
+  m_sequence = sequence;
+}
+
+uint16_t
+MacSequenceHeader::GetSequence () const
+{
+  return m_sequence;
+}
+
+TypeId
+MacSequenceHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::MacSequenceHeader")
+    .SetParent<Header> ()
+    .AddConstructor<MacSequenceHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+MacSequenceHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+MacSequenceHeader::Print (std::ostream &os) const
+{
+  os << " sequence=" << m_sequence;
+}
+
+void
+MacSequenceHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_sequence);
+}
+
+uint32_t
+MacSequenceHeader::Deserialize (Buffer::Iterator start)
+{
+  m_sequence = start.ReadNtohU16 ();
+  return GetSerializedSize ();
+}
+
+uint32_t
+MacSequenceHeader::GetSerializedSize () const
+{
+  return 2;
+}
+
+MacArqHeader::MacArqHeader (uint16_t sequence, uint16_t type)
+  : m_sequence (sequence),
+  m_type (type)
+{
+}
+
+void
+MacArqHeader::SetSequence (uint16_t sequence)
+{
+  m_sequence = sequence;
+}
+
+uint16_t
+MacArqHeader::GetSequence () const
+{
+  return m_sequence;
+}
+
+void
+MacArqHeader::SetType (uint16_t type)
+{
+  m_type = type;
+}
+
+uint16_t
+MacArqHeader::GetType () const
+{
+  return m_type;
+}
+
+TypeId
+MacArqHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::MacArqHeader")
+    .SetParent<Header> ()
+    .AddConstructor<MacArqHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+MacArqHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+void
+MacArqHeader::Print (std::ostream &os) const
+{
+  os << " sequence=" << m_sequence << " type=0x" << std::hex << m_type << std::dec;
+}
+
+void
+MacArqHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_sequence);
+  start.WriteHtonU16 (m_type);
+}
+
+uint32_t
+MacArqHeader::Deserialize (Buffer::Iterator start)
+{
+  m_sequence = start.ReadNtohU16 ();
+  m_type = start.ReadNtohU16 ();
+  return GetSerializedSize ();
+}
+
+uint32_t
+MacArqHeader::GetSerializedSize () const
+{
+  return 4;
+}
 } // namespace lrr
 } // namespace ns3
@@ -25,6 +25,7 @@
 
 #include "ns3/header.h"
 #include "ns3/address.h"
+#include "ns3/mac48-address.h"
 
 namespace ns3 {
 namespace lrr {
@@ -37,6 +38,12 @@ namespace lrr {
 class MacHeader : public Header
 {
 public:
+  /// Type of a frame carrying aggregated packets (IEEE local experimental ethertype)
+  static const uint16_t AGGREGATE_TYPE = 0x88b5;
+  /// Type of a frame to be acknowledged: MacArqHeader with the frame type followed by the frame payload
+  static const uint16_t ARQ_TYPE = 0x88b6;
+  /// Type of an acknowledgement: MacSequenceHeader only
+  static const uint16_t ACK_TYPE = 0x88b7;
   /// Construct a null radio header
   MacHeader ();
   ///\name Setters/Getters for all fields:
@@ -71,6 +78,154 @@ private:
   /// Source address
   Address m_source;
 };
+
+/**
+ * \ingroup lrr
+ *
+ * \brief the same as MacHeader for Mac48 addresses: no address length, addresses are copied as is
+ */
+class Mac48Header : public Header
+{
+public:
+  Mac48Header ();
+  ///\name Setters/Getters for all fields:
+  ///\{
+  void SetType (uint16_t type);
+  uint16_t GetType () const;
+  void SetSource (Mac48Address source);
+  Mac48Address GetSource () const;
+  void SetDestination (Mac48Address destination);
+  Mac48Address GetDestination () const;
+  ///\}
+  ///\name Inherited from Header base class:
+  ///\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  void Print (std::ostream &os) const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  uint32_t GetSerializedSize () const;
+  ///\}
+private:
+  uint16_t m_type;
+  Mac48Address m_destination;
+  Mac48Address m_source;
+};
+
+/**
+ * \ingroup lrr
+ *
+ * \brief MAC header with 16-bit addresses (two low bytes of Mac48 address) for networks
+ * under 65k stations. All multicast destinations are mapped to MULTICAST, so a group
+ * is resolved by upper layers.
+ */
+class ShortMacHeader : public Header
+{
+public:
+  static const uint16_t BROADCAST = 0xffff;
+  static const uint16_t MULTICAST = 0xfffe;
+  ShortMacHeader ();
+  ///\name Setters/Getters for all fields:
+  ///\{
+  void SetType (uint16_t type);
+  uint16_t GetType () const;
+  void SetSource (uint16_t source);
+  uint16_t GetSource () const;
+  void SetDestination (uint16_t destination);
+  uint16_t GetDestination () const;
+  ///\}
+  ///\name Inherited from Header base class:
+  ///\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  void Print (std::ostream &os) const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  uint32_t GetSerializedSize () const;
+  ///\}
+private:
+  uint16_t m_type;
+  uint16_t m_destination;
+  uint16_t m_source;
+};
+
+/**
+ * \ingroup lrr
+ *
+ * \brief header of a subframe inside an aggregated frame: length of the packet that follows
+ */
+class MacSubframeHeader : public Header
+{
+public:
+  MacSubframeHeader (uint16_t length = 0);
+  void SetLength (uint16_t length);
+  uint16_t GetLength () const;
+  ///\name Inherited from Header base class:
+  ///\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  void Print (std::ostream &os) const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  uint32_t GetSerializedSize () const;
+  ///\}
+private:
+  uint16_t m_length;
+};
+
+/**
+ * \ingroup lrr
+ *
+ * \brief sequence number of an acknowledgement
+ */
+class MacSequenceHeader : public Header
+{
+public:
+  MacSequenceHeader (uint16_t sequence = 0);
+  void SetSequence (uint16_t sequence);
+  uint16_t GetSequence () const;
+  ///\name Inherited from Header base class:
+  ///\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  void Print (std::ostream &os) const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  uint32_t GetSerializedSize () const;
+  ///\}
+private:
+  uint16_t m_sequence;
+};
+
+/**
+ * \ingroup lrr
+ *
+ * \brief sequence number of a frame to be acknowledged and the type its MAC header carries without ARQ
+ */
+class MacArqHeader : public Header
+{
+public:
+  MacArqHeader (uint16_t sequence = 0, uint16_t type = 0);
+  ///\name Setters/Getters for all fields:
+  ///\{
+  void SetSequence (uint16_t sequence);
+  uint16_t GetSequence () const;
+  void SetType (uint16_t type);
+  uint16_t GetType () const;
+  ///\}
+  ///\name Inherited from Header base class:
+  ///\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  void Print (std::ostream &os) const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  uint32_t GetSerializedSize () const;
+  ///\}
+private:
+  uint16_t m_sequence;
+  uint16_t m_type;
+};
 } // namespace lrr
 } // namespace ns3
 
@@ -21,6 +21,7 @@
 
 #include "ns3/mac48-address.h"
 #include "ns3/queue.h"
+#include "ns3/enum.h"
 #include "lrr-mac-impl.h"
 
 #include "lrr-mac-access-manager.h"
@@ -38,6 +39,13 @@ CollisionFreeMacImpl::GetTypeId ()
   static TypeId tid = TypeId ("ns3::lrr::CollisionFreeMacImpl")
     .SetParent<Mac> ()
     .AddConstructor<CollisionFreeMacImpl> ()
+    .AddAttribute ("HeaderFormat",
+                   "MAC header format: generic addresses, Mac48 addresses or 16-bit short addresses",
+                   EnumValue (GENERIC_HEADER),
+                   MakeEnumAccessor (&CollisionFreeMacImpl::m_headerFormat),
+                   MakeEnumChecker (GENERIC_HEADER, "Generic",
+                                    MAC48_HEADER, "Mac48",
+                                    SHORT_HEADER, "Short"))
     .AddTraceSource ("RxError", "Error when receiving a packet",
                      MakeTraceSourceAccessor (&CollisionFreeMacImpl::m_rxErrorTrace),
                      "ns3::Packet::TracedCallback")
@@ -48,7 +56,8 @@ CollisionFreeMacImpl::GetTypeId ()
 CollisionFreeMacImpl::CollisionFreeMacImpl () :
   Mac (),
   m_address (Address ()),
-  m_accessManager (CreateObject<AccessManager> ())
+  m_accessManager (CreateObject<AccessManager> ()),
+  m_headerFormat (GENERIC_HEADER)
 {
   m_accessManager->SetMac (this);
 }
@@ -75,6 +84,7 @@ void
 CollisionFreeMacImpl::SetAddress (Address address)
 {
   m_address = address;
+  m_mac48Address = Mac48Address::ConvertFrom (address);
 }
 
 Address
@@ -89,29 +99,190 @@ CollisionFreeMacImpl::GetAccessManager () const
   return m_accessManager;
 }
 
-void
+bool
 CollisionFreeMacImpl::Enqueue (Ptr<Packet> packet, Address to, Address from, uint16_t type)
 {
-  MacHeader header;
-  header.SetType (type);
-  header.SetSource (from);
-  header.SetDestination (to);
-  packet->AddHeader (header);
-  m_accessManager->Enqueue (packet);
+  uint32_t trafficClass = m_accessManager->Classify (packet, type);
+  AddMacHeader (packet, Mac48Address::ConvertFrom (to), Mac48Address::ConvertFrom (from), type);
+  return m_accessManager->Enqueue (packet, to, trafficClass);
 }
 
 void
-CollisionFreeMacImpl::Receive (Ptr<Packet> packet)
+CollisionFreeMacImpl::AddMacHeader (Ptr<Packet> packet, Mac48Address to, Mac48Address from, uint16_t type) const
+{
+  switch (m_headerFormat)
+    {
+    case MAC48_HEADER:
+      {
+        Mac48Header header;
+        header.SetType (type);
+        header.SetSource (from);
+        header.SetDestination (to);
+        packet->AddHeader (header);
+        return;
+      }
+    case SHORT_HEADER:
+      {
+        ShortMacHeader header;
+        header.SetType (type);
+        header.SetSource (ToShortAddress (from));
+        header.SetDestination (ToShortAddress (to));
+        packet->AddHeader (header);
+        return;
+      }
+    default:
+      {
+        MacHeader header;
+        header.SetType (type);
+        header.SetSource (from);
+        header.SetDestination (to);
+        packet->AddHeader (header);
+        return;
+      }
+    }
+}
+
+bool
+CollisionFreeMacImpl::PeekMacHeader (Ptr<const Packet> packet, Mac48Address & to, Mac48Address & from, uint16_t & type) const
+{
+  if (packet->GetSize () < GetMacHeaderSize ())
+    {
+      return false;
+    }
+  switch (m_headerFormat)
+    {
+    case MAC48_HEADER:
+      {
+        Mac48Header header;
+        packet->PeekHeader (header);
+        to = header.GetDestination ();
+        from = header.GetSource ();
+        type = header.GetType ();
+        return true;
+      }
+    case SHORT_HEADER:
+      {
+        ShortMacHeader header;
+        packet->PeekHeader (header);
+        to = FromShortAddress (header.GetDestination ());
+        from = FromShortAddress (header.GetSource ());
+        type = header.GetType ();
+        return true;
+      }
+    default:
+      {
+        MacHeader header;
+        packet->PeekHeader (header);
+        to = Mac48Address::ConvertFrom (header.GetDestination ());
+        from = Mac48Address::ConvertFrom (header.GetSource ());
+        type = header.GetType ();
+        return true;
+      }
+    }
+}
+
+uint32_t
+CollisionFreeMacImpl::GetMacHeaderSize () const
+{
+  switch (m_headerFormat)
+    {
+    case MAC48_HEADER:
+      return Mac48Header ().GetSerializedSize ();
+    case SHORT_HEADER:
+      return ShortMacHeader ().GetSerializedSize ();
+    default:
+      {
+        // Generic header carries Mac48 addresses with their length
+        MacHeader header;
+        header.SetSource (Mac48Address ());
+        header.SetDestination (Mac48Address ());
+        return header.GetSerializedSize ();
+      }
+    }
+}
+
+uint16_t
+CollisionFreeMacImpl::ToShortAddress (Mac48Address address) const
+{
+  if (address.IsBroadcast ())
+    {
+      return ShortMacHeader::BROADCAST;
+    }
+  if (address.IsGroup ())
+    {
+      return ShortMacHeader::MULTICAST;
+    }
+  uint8_t buffer[6];
+  address.CopyTo (buffer);
+  uint16_t retval = (buffer[4] << 8) | buffer[5];
+  NS_ASSERT_MSG (retval < ShortMacHeader::MULTICAST, "Address " << address << " can not be shortened");
+  NS_ASSERT_MSG (FromShortAddress (retval) == address, "Address " << address << " differs from own address in high bytes");
+  return retval;
+}
+
+Mac48Address
+CollisionFreeMacImpl::FromShortAddress (uint16_t address) const
 {
-  MacHeader header;
-  packet->RemoveHeader (header);
-  Address from = header.GetSource ();
-  Address to = header.GetDestination ();
-  uint16_t protocolNumber = header.GetType ();
+  if ((address == ShortMacHeader::BROADCAST) || (address == ShortMacHeader::MULTICAST))
+    {
+      // Group is resolved by upper layers
+      return Mac48Address::GetBroadcast ();
+    }
+  uint8_t buffer[6];
+  m_mac48Address.CopyTo (buffer);
+  buffer[4] = address >> 8;
+  buffer[5] = address & 0xff;
+  Mac48Address retval;
+  retval.CopyFrom (buffer);
+  return retval;
+}
 
-  if (IsGroupAddress (to) || IsMyAddress (to))
+void
+CollisionFreeMacImpl::Receive (Ptr<Packet> packet)
+{
+  Mac48Address to;
+  Mac48Address from;
+  uint16_t protocolNumber;
+  if (!PeekMacHeader (packet, to, from, protocolNumber))
+    {
+      return;
+    }
+  packet->RemoveAtStart (GetMacHeaderSize ());
+  if (!to.IsGroup () && (to != m_mac48Address))
+    {
+      return;
+    }
+  if (protocolNumber == MacHeader::ACK_TYPE)
+    {
+      MacSequenceHeader sequence;
+      packet->RemoveHeader (sequence);
+      m_accessManager->ReceiveAck (from, sequence.GetSequence ());
+      return;
+    }
+  if (protocolNumber == MacHeader::ARQ_TYPE)
+    {
+      // Acknowledge, then receive the payload by its own type unless it is a retransmission
+      MacArqHeader arq;
+      packet->RemoveHeader (arq);
+      if (!m_accessManager->ReceiveArq (from, arq.GetSequence ()))
+        {
+          return;
+        }
+      protocolNumber = arq.GetType ();
+    }
+  if (protocolNumber != MacHeader::AGGREGATE_TYPE)
     {
       ForwardUp (packet, from, to, protocolNumber);
+      return;
+    }
+  // Split aggregate, each subframe has its own MAC header:
+  MacSubframeHeader subframe;
+  while (packet->GetSize () >= subframe.GetSerializedSize ())
+    {
+      packet->RemoveHeader (subframe);
+      NS_ASSERT (subframe.GetLength () <= packet->GetSize ());
+      Receive (packet->CreateFragment (0, subframe.GetLength ()));
+      packet->RemoveAtStart (subframe.GetLength ());
     }
 }
 
@@ -121,17 +292,23 @@ CollisionFreeMacImpl::SetQueue (Ptr<Queue<Packet> > queue)
   m_accessManager->SetQueue (queue);
 }
 
+void
+CollisionFreeMacImpl::SetQueueInterface (Ptr<NetDeviceQueueInterface> queueInterface)
+{
+  m_accessManager->SetQueueInterface (queueInterface);
+}
+
 void
 CollisionFreeMacImpl::ReceiveError (Ptr<const Packet> errorPacket)
 {
-  MacHeader header;
-  if (!errorPacket->PeekHeader (header))
+  Mac48Address destination;
+  Mac48Address source;
+  uint16_t type;
+  if (!PeekMacHeader (errorPacket, destination, source, type))
     {
       return;
     }
-  Address destination = header.GetDestination ();
-  Address source = header.GetSource ();
-  if (IsMyAddress (destination))
+  if (destination == m_mac48Address)
     {
       m_rxErrorTrace (destination, source);
     }
@@ -158,7 +335,7 @@ CollisionFreeMacImpl::GetMulticast (Ipv6Address group) const
 bool
 CollisionFreeMacImpl::IsMyAddress (const Address & a) const
 {
-  return Mac48Address::ConvertFrom (a) == Mac48Address::ConvertFrom (m_address);
+  return Mac48Address::ConvertFrom (a) == m_mac48Address;
 }
 
 bool
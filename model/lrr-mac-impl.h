@@ -24,11 +24,13 @@
 #include "ns3/packet.h"
 #include "ns3/address.h"
 #include "ns3/traced-callback.h"
+#include "ns3/mac48-address.h"
 
 #include "ns3/lrr-mac.h"
 
 namespace ns3 {
 template <typename Item> class Queue;
+class NetDeviceQueueInterface;
 namespace lrr {
 
 class AccessManager;
@@ -37,13 +39,25 @@ class AccessManager;
  * \ingroup lrr
  *
  * \brief MAC layer of MANET stack. Keeps AccessManager inside and grants a collision-free access to the medium.
- * Collisions may occur only due to fading
+ * Collisions may occur only due to fading, lost unicast frames are retransmitted if Arq
+ * attribute of AccessManager is set
  *
  * Forward packets down from net device to access manger;
  * forward packets up to net device.
+ *
+ * MAC header format is set by HeaderFormat attribute: generic MacHeader, Mac48Header or
+ * ShortMacHeader. Short addresses are two low bytes of Mac48 address, the rest bytes are
+ * taken from own address, so all stations must share them.
  */
 class CollisionFreeMacImpl : public Mac
 {
+public:
+  enum HeaderFormat
+  {
+    GENERIC_HEADER,
+    MAC48_HEADER,
+    SHORT_HEADER
+  };
 public:
   static TypeId GetTypeId ();
 
@@ -55,7 +69,7 @@ public:
   void SetAddress (Address address);
   Address GetAddress () const;
   /// Send method:
-  void Enqueue (Ptr<Packet> packet, Address to, Address from, uint16_t type);
+  bool Enqueue (Ptr<Packet> packet, Address to, Address from, uint16_t type);
   /// Addresses: all methods are virtual=> address type may be changed
   virtual Address GetBroadcast () const;
   virtual Address GetMulticast (Ipv4Address group) const;
@@ -67,6 +81,14 @@ public:
   Ptr<AccessManager> GetAccessManager () const;
   /// Set MAC queue:
   void SetQueue (Ptr<Queue<Packet> > queue);
+  ///\name MAC header of the configured format
+  ///\{
+  void AddMacHeader (Ptr<Packet> packet, Mac48Address to, Mac48Address from, uint16_t type) const;
+  uint32_t GetMacHeaderSize () const;
+  /// Read MAC header of the configured format, header is not removed. \return false if packet is too short
+  bool PeekMacHeader (Ptr<const Packet> packet, Mac48Address & to, Mac48Address & from, uint16_t & type) const;
+  ///\}
+  void SetQueueInterface (Ptr<NetDeviceQueueInterface> queueInterface);
 protected:
   /// Receive packet from PHY and forward to net-device. Made as protected for further features implementation.
   void Receive (Ptr<Packet> packet);
@@ -76,14 +98,23 @@ protected:
 private:
   /// Sniffer for erroneous packets:
   void ReceiveError (Ptr<const Packet> errorPacket);
+  ///\name Short address conversion
+  ///\{
+  uint16_t ToShortAddress (Mac48Address address) const;
+  Mac48Address FromShortAddress (uint16_t address) const;
+  ///\}
 protected:
   /// Own address:
   Address m_address;
+  /// Own address converted once:
+  Mac48Address m_mac48Address;
 private:
   ///\name Internals:
   ///\{
   /// Access manager (ideal-TDM functionality)
   Ptr<AccessManager> m_accessManager;
+  /// MAC header format
+  HeaderFormat m_headerFormat;
   ///\}
   ///RX error trace: destination, source addresses are passed
   TracedCallback<Address, Address> m_rxErrorTrace;
@@ -0,0 +1,208 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "lrr-mac-tdma.h"
+#include "lrr-mac-access-manager.h"
+#include "lrr-channel.h"
+#include "lrr-phy.h"
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("LrrTdmaMac");
+
+namespace ns3 {
+namespace lrr {
+
+NS_OBJECT_ENSURE_REGISTERED (TdmaScheduler);
+NS_OBJECT_ENSURE_REGISTERED (TdmaMacImpl);
+
+TypeId
+TdmaScheduler::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::TdmaScheduler")
+    .SetParent<Object> ()
+    .AddConstructor<TdmaScheduler> ()
+    .AddAttribute ("SlotDuration",
+                   "Duration of a TDMA slot including guard interval (default fits 1500 bytes at 1Mbps)",
+                   TimeValue (MilliSeconds (13)),
+                   MakeTimeAccessor (&TdmaScheduler::m_slotDuration),
+                   MakeTimeChecker ())
+    .AddAttribute ("UpdatePeriod",
+                   "How often interference conflict graph is colored again",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&TdmaScheduler::m_updatePeriod),
+                   MakeTimeChecker ())
+  ;
+  return tid;
+}
+
+TdmaScheduler::TdmaScheduler () :
+  m_slotDuration (MilliSeconds (13)),
+  m_updatePeriod (Seconds (1)),
+  m_frameLength (1),
+  m_lastUpdate (Seconds (0)),
+  m_updated (false)
+{
+}
+
+TdmaScheduler::~TdmaScheduler ()
+{
+}
+
+Time
+TdmaScheduler::GetSlotStart (uint32_t phyIndex, Time time)
+{
+  uint32_t slot = GetSlot (phyIndex);
+  int64_t slotDuration = m_slotDuration.GetTimeStep ();
+  int64_t frameDuration = slotDuration * m_frameLength;
+  int64_t now = time.GetTimeStep ();
+  int64_t start = (now / frameDuration) * frameDuration + slot * slotDuration;
+  if (start < now)
+    {
+      start += frameDuration;
+    }
+  return TimeStep (start);
+}
+
+uint32_t
+TdmaScheduler::GetSlot (uint32_t phyIndex)
+{
+  UpdateIfNeeded ();
+  NS_ASSERT (phyIndex < m_slots.size ());
+  return m_slots[phyIndex];
+}
+
+uint32_t
+TdmaScheduler::GetFrameLength ()
+{
+  UpdateIfNeeded ();
+  return m_frameLength;
+}
+
+Time
+TdmaScheduler::GetSlotDuration () const
+{
+  return m_slotDuration;
+}
+
+void
+TdmaScheduler::UpdateIfNeeded ()
+{
+  if (m_updated && (m_lastUpdate + m_updatePeriod > Simulator::Now ()))
+    {
+      return;
+    }
+  Update ();
+}
+
+void
+TdmaScheduler::Update ()
+{
+  m_lastUpdate = Simulator::Now ();
+  m_updated = true;
+  Ptr<NeighborAwareSpectrumChannel> channel = GetObject<NeighborAwareSpectrumChannel> ();
+  NS_ASSERT_MSG (channel != 0, "TDMA scheduler must be aggregated to a channel");
+  uint32_t n = channel->GetNDevices ();
+  // Sensitivity neighbors of all PHYs are taken in one pass, interference neighbors below are built of them:
+  channel->GetAdjacency ();
+  // Conflict graph is symmetric even if interference neighborhood is not:
+  std::vector<std::vector<uint32_t> > conflicts (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Ptr<Phy> phy = channel->GetPhy (i)->GetObject<Phy> ();
+      if (phy == 0)
+        {
+          continue;
+        }
+      std::vector<uint32_t> neighbors = phy->GetInterferenceNeighborIndexes ();
+      for (std::vector<uint32_t>::const_iterator j = neighbors.begin (); j != neighbors.end (); ++j)
+        {
+          conflicts[i].push_back (*j);
+          conflicts[*j].push_back (i);
+        }
+    }
+  std::vector<std::pair<uint32_t, uint32_t> > order;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      std::sort (conflicts[i].begin (), conflicts[i].end ());
+      conflicts[i].erase (std::unique (conflicts[i].begin (), conflicts[i].end ()), conflicts[i].end ());
+      // Largest degree first, ties are broken by PHY ordinal:
+      order.push_back (std::make_pair (n - conflicts[i].size (), i));
+    }
+  std::sort (order.begin (), order.end ());
+  std::vector<bool> colored (n, false);
+  m_slots.assign (n, 0);
+  m_frameLength = 1;
+  for (std::vector<std::pair<uint32_t, uint32_t> >::const_iterator i = order.begin (); i != order.end (); ++i)
+    {
+      uint32_t vertex = i->second;
+      std::vector<bool> used (conflicts[vertex].size () + 1, false);
+      for (std::vector<uint32_t>::const_iterator j = conflicts[vertex].begin (); j != conflicts[vertex].end (); ++j)
+        {
+          if (colored[*j] && (m_slots[*j] < used.size ()))
+            {
+              used[m_slots[*j]] = true;
+            }
+        }
+      uint32_t slot = std::find (used.begin (), used.end (), false) - used.begin ();
+      m_slots[vertex] = slot;
+      colored[vertex] = true;
+      m_frameLength = std::max (m_frameLength, slot + 1);
+    }
+  NS_LOG_DEBUG ("TDMA frame of " << m_frameLength << " slots for " << n << " stations");
+}
+
+TypeId
+TdmaMacImpl::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::lrr::TdmaMacImpl")
+    .SetParent<CollisionFreeMacImpl> ()
+    .AddConstructor<TdmaMacImpl> ()
+  ;
+  return tid;
+}
+
+TdmaMacImpl::TdmaMacImpl () :
+  CollisionFreeMacImpl ()
+{
+}
+
+TdmaMacImpl::~TdmaMacImpl ()
+{
+}
+
+void
+TdmaMacImpl::DoInitialize ()
+{
+  // All stations of a channel share one scheduler:
+  Ptr<NeighborAwareSpectrumChannel> channel = GetPhy ()->GetObject<Phy> ()->GetNeighborAwareChannel ();
+  NS_ASSERT (channel != 0);
+  Ptr<TdmaScheduler> scheduler = channel->GetObject<TdmaScheduler> ();
+  if (scheduler == 0)
+    {
+      scheduler = CreateObject<TdmaScheduler> ();
+      channel->AggregateObject (scheduler);
+    }
+  GetAccessManager ()->SetTdmaScheduler (scheduler);
+  CollisionFreeMacImpl::DoInitialize ();
+}
+} // namespace lrr
+} // namespace ns3
@@ -0,0 +1,94 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+#ifndef LRR_MAC_TDMA_H
+#define LRR_MAC_TDMA_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/lrr-mac-impl.h"
+#include <vector>
+
+namespace ns3 {
+namespace lrr {
+
+/**
+ * \ingroup lrr
+ *
+ * \brief Channel-wide TDMA frame: interference conflict graph (PHYs are vertices,
+ * interference neighbors are edges) is colored greedily, largest degree first,
+ * each color is a slot of the frame. Frames are aligned to zero time.
+ *
+ * One scheduler is aggregated to a channel. Coloring is rebuilt when a slot is requested
+ * and UpdatePeriod has passed since the last one.
+ */
+class TdmaScheduler : public Object
+{
+public:
+  static TypeId GetTypeId ();
+  TdmaScheduler ();
+  ~TdmaScheduler ();
+  /// \return the earliest start of a slot of a given PHY (ordinal in the channel) not before \param time
+  Time GetSlotStart (uint32_t phyIndex, Time time);
+  /// \return slot of a given PHY inside a frame
+  uint32_t GetSlot (uint32_t phyIndex);
+  /// \return number of slots in a frame
+  uint32_t GetFrameLength ();
+  Time GetSlotDuration () const;
+private:
+  /// Color conflict graph if it is too old
+  void UpdateIfNeeded ();
+  void Update ();
+private:
+  ///\name Attributes
+  ///\{
+  Time m_slotDuration;
+  Time m_updatePeriod;
+  ///\}
+  /// Slot of each PHY indexed by PHY ordinal
+  std::vector<uint32_t> m_slots;
+  uint32_t m_frameLength;
+  Time m_lastUpdate;
+  bool m_updated;
+};
+
+/**
+ * \ingroup lrr
+ *
+ * \brief Collision-free MAC, which transmits in slots assigned by TdmaScheduler of the channel
+ * instead of reserving medium against timeout ends of neighbors, so access time does not depend
+ * on neighbors and no per-packet neighbor scans are done. Headers, queues, traffic classes and
+ * aggregation are the same as in CollisionFreeMacImpl. Each frame must fit into a slot with a
+ * guard interval (and SIFS with ACK if Arq is enabled): bursts are cut at SlotDuration minus these
+ * whatever MaxBurstDuration of AccessManager is, a single frame which does not fit is a fatal error.
+ * With Lookahead above one, frames go into the next slots of a station.
+ */
+class TdmaMacImpl : public CollisionFreeMacImpl
+{
+public:
+  static TypeId GetTypeId ();
+  TdmaMacImpl ();
+  ~TdmaMacImpl ();
+protected:
+  void DoInitialize ();
+};
+} // namespace lrr
+} // namespace ns3
+
+#endif /* LRR_MAC_TDMA_H */
@@ -40,7 +40,8 @@ Mac::GetTypeId ()
 }
 
 Mac::Mac () :
-  m_phy (0)
+  m_phy (0),
+  m_txFrames (0)
 {}
 
 Mac::~Mac()
@@ -100,9 +101,16 @@ Mac::GetCommunicationNeighbors () const
 }
 
 void
-Mac::StartTransmission (Ptr<const Packet> packet)
+Mac::StartTransmission (Ptr<Packet> packet, DataRate rate, uint32_t powerLevel)
 {
-  m_phy->StartTx (packet->Copy ());
+  m_txFrames++;
+  m_phy->StartTx (packet, rate, powerLevel);
+}
+
+uint32_t
+Mac::GetNTxFrames () const
+{
+  return m_txFrames;
 }
 
 void
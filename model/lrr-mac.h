@@ -24,6 +24,7 @@
 #include "ns3/packet.h"
 #include "ns3/address.h"
 #include "ns3/object.h"
+#include "ns3/data-rate.h"
 #include "ns3/lrr-phy.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv6-address.h"
@@ -32,6 +33,7 @@
 
 namespace ns3 {
 template <typename Item> class Queue;
+class NetDeviceQueueInterface;
 namespace lrr {
 class NeighborAwareDevice;
 class Phy;
@@ -72,19 +74,24 @@ public:
   virtual void Receive (Ptr<Packet> packet) = 0;
   ///\name Interaction with higher layers:
   ///\{
-  /// Send Method:
-  virtual void Enqueue (Ptr<Packet> packet, Address to, Address from, uint16_t type) = 0;
+  /// Send Method, \return false if packet was dropped by MAC queue:
+  virtual bool Enqueue (Ptr<Packet> packet, Address to, Address from, uint16_t type) = 0;
   /// Receive method: by callback:
   void SetForwardUpCallback (ForwardUpCallback upCallback);
   ///\}
   virtual void SetQueue (Ptr<Queue<Packet> > queue) = 0;
+  /// Queue interface of the device for flow control with traffic control layer
+  virtual void SetQueueInterface (Ptr<NetDeviceQueueInterface> queueInterface) = 0;
   ///\name PHY: needed to obtain neighbors
   ///\{
   void SetPhy (Ptr<SpectrumPhy> phy);
   Ptr<SpectrumPhy> GetPhy () const;
   ///\}
-  /// Pass a packet to PHY:
-  void StartTransmission (Ptr<const Packet> packet);
+  /// Pass a packet to PHY at a given rate and TX power level, MAC owns the packet since Enqueue, so it is not copied:
+  void StartTransmission (Ptr<Packet> packet, DataRate rate, uint32_t powerLevel = 0);
+  /// The number of frames passed to PHY. Copies are not counted here: there are none on TX path, a test
+  /// compares frames passed to PHY with packets handed to the device
+  uint32_t GetNTxFrames () const;
 protected:
   /// Forward packet up:
   void ForwardUp (Ptr<Packet> p, Address from, Address to, uint16_t protocol);
@@ -100,6 +107,8 @@ private:
   Ptr<Phy> m_phy;
   /// Max LRRDU size, that MAC can send
   uint32_t m_maxMsduSize;
+  /// The number of frames passed to PHY
+  uint32_t m_txFrames;
 };
 } // namespace lrr
 } // namespace ns3
@@ -22,6 +22,8 @@
 namespace ns3 {
 namespace lrr {
 
+const uint32_t GlobalGroupManagement::INVALID_GROUP_INDEX;
+
 static GlobalGroupManagement * g_instance = 0;
 
 GlobalGroupManagement *
@@ -37,12 +39,7 @@ GlobalGroupManagement::GetInstance ()
 Ipv4Address
 GlobalGroupManagement::AllocateMulticastAddress ()
 {
-  static uint8_t lastOctet = 1;
-  std::ostringstream os;
-  NS_ASSERT (lastOctet < 0xff);
-  os << "227.0.0." << (uint16_t) lastOctet;
-  lastOctet++;
-  return Ipv4Address (os.str ().c_str ());
+  return GetInstance ()->DoAllocateMulticastAddress ();
 }
 
 void
@@ -52,7 +49,10 @@ GlobalGroupManagement::Destroy ()
   g_instance = 0;
 }
 
-GlobalGroupManagement::GlobalGroupManagement ()
+GlobalGroupManagement::GlobalGroupManagement () :
+  m_prefix ("227.0.0.0"),
+  m_mask ("255.0.0.0"),
+  m_lastHostId (0)
 {
 }
 
@@ -60,54 +60,212 @@ GlobalGroupManagement::~GlobalGroupManagement ()
 {
 }
 
+void
+GlobalGroupManagement::SetMulticastPrefix (Ipv4Address prefix, Ipv4Mask mask)
+{
+  NS_ASSERT (prefix.IsMulticast ());
+  m_prefix = prefix.CombineMask (mask);
+  m_mask = mask;
+  m_lastHostId = 0;
+  m_freeAddresses.clear ();
+}
+
+Ipv4Address
+GlobalGroupManagement::DoAllocateMulticastAddress ()
+{
+  while (!m_freeAddresses.empty ())
+    {
+      uint32_t address = m_freeAddresses.back ();
+      m_freeAddresses.pop_back ();
+      if (m_groupIndex.find (address) == m_groupIndex.end ())
+        {
+          m_allocated.insert (address);
+          return Ipv4Address (address);
+        }
+    }
+  uint32_t maxHostId = ~m_mask.Get ();
+  while (m_lastHostId < maxHostId)
+    {
+      m_lastHostId++;
+      uint32_t address = m_prefix.Get () | m_lastHostId;
+      // Skip addresses of groups created with explicit address:
+      if ((m_groupIndex.find (address) == m_groupIndex.end ()) && m_allocated.insert (address).second)
+        {
+          return Ipv4Address (address);
+        }
+    }
+  NS_FATAL_ERROR ("No more multicast addresses in " << m_prefix << "/" << m_mask);
+  return Ipv4Address ();
+}
+
+uint64_t
+GlobalGroupManagement::MembershipKey (uint32_t groupIndex, Ipv4Address member)
+{
+  return ((uint64_t) groupIndex << 32) | member.Get ();
+}
+
+uint32_t
+GlobalGroupManagement::AddGroupIndex (Ipv4Address mcastGrAddr)
+{
+  std::unordered_map<uint32_t, uint32_t>::const_iterator i = m_groupIndex.find (mcastGrAddr.Get ());
+  if (i != m_groupIndex.end ())
+    {
+      return i->second;
+    }
+  uint32_t index;
+  if (m_freeGroupIndexes.empty ())
+    {
+      index = m_groups.size ();
+      m_groups.push_back (Group ());
+    }
+  else
+    {
+      index = m_freeGroupIndexes.back ();
+      m_freeGroupIndexes.pop_back ();
+    }
+  m_groups[index].address = mcastGrAddr;
+  m_groups[index].used = true;
+  m_groupIndex.insert (std::make_pair (mcastGrAddr.Get (), index));
+  return index;
+}
+
 void
 GlobalGroupManagement::AddMcastGroup (Ipv4Address mcastGrAddr, MemberSet memberList)
 {
-  GroupMap::iterator i = m_groups.find (mcastGrAddr);
-  if (i == m_groups.end ())
+  // Create group even if member list is empty:
+  MemberSet oldMembers = m_groups[AddGroupIndex (mcastGrAddr)].members;
+  for (MemberSet::const_iterator i = oldMembers.begin (); i != oldMembers.end (); ++i)
     {
-      m_groups.insert (std::make_pair (mcastGrAddr, memberList));
-      return;
+      if (memberList.find (*i) == memberList.end ())
+        {
+          Leave (mcastGrAddr, *i);
+        }
+    }
+  for (MemberSet::const_iterator i = memberList.begin (); i != memberList.end (); ++i)
+    {
+      Join (mcastGrAddr, *i);
     }
-  i->second = memberList;
 }
 
 void
 GlobalGroupManagement::RemoveMulticastgroup (Ipv4Address mcastGrAddr)
 {
-  GroupMap::iterator i = m_groups.find (mcastGrAddr);
-  if (i != m_groups.end ())
+  uint32_t index = GetGroupIndex (mcastGrAddr);
+  if (index == INVALID_GROUP_INDEX)
+    {
+      return;
+    }
+  MemberSet members = m_groups[index].members;
+  for (MemberSet::const_iterator j = members.begin (); j != members.end (); ++j)
+    {
+      Leave (mcastGrAddr, *j);
+    }
+  m_groupRemoved (mcastGrAddr, index);
+  m_groups[index].used = false;
+  m_groups[index].members.clear ();
+  m_freeGroupIndexes.push_back (index);
+  m_groupIndex.erase (mcastGrAddr.Get ());
+  if (m_allocated.erase (mcastGrAddr.Get ()) != 0)
+    {
+      m_freeAddresses.push_back (mcastGrAddr.Get ());
+    }
+}
+
+bool
+GlobalGroupManagement::Join (Ipv4Address mcastGrAddr, Ipv4Address member)
+{
+  uint32_t index = AddGroupIndex (mcastGrAddr);
+  if (!m_membership.insert (MembershipKey (index, member)).second)
     {
-      m_groups.erase (i);
+      return false;
     }
+  m_groups[index].members.insert (member);
+  m_membershipChange (mcastGrAddr, member, true);
+  return true;
+}
+
+bool
+GlobalGroupManagement::Leave (Ipv4Address mcastGrAddr, Ipv4Address member)
+{
+  uint32_t index = GetGroupIndex (mcastGrAddr);
+  if ((index == INVALID_GROUP_INDEX) || (m_membership.erase (MembershipKey (index, member)) == 0))
+    {
+      return false;
+    }
+  m_groups[index].members.erase (member);
+  m_membershipChange (mcastGrAddr, member, false);
+  return true;
+}
+
+void
+GlobalGroupManagement::ConnectMembershipChange (MembershipChangeCallback cb)
+{
+  m_membershipChange.ConnectWithoutContext (cb);
+}
+
+void
+GlobalGroupManagement::DisconnectMembershipChange (MembershipChangeCallback cb)
+{
+  m_membershipChange.DisconnectWithoutContext (cb);
+}
+
+void
+GlobalGroupManagement::ConnectGroupRemoved (GroupRemovedCallback cb)
+{
+  m_groupRemoved.ConnectWithoutContext (cb);
+}
+
+void
+GlobalGroupManagement::DisconnectGroupRemoved (GroupRemovedCallback cb)
+{
+  m_groupRemoved.DisconnectWithoutContext (cb);
 }
 
 bool
 GlobalGroupManagement::IsInMcastGroup (Ipv4Address address, Ipv4Address mcastGrAddr) const
 {
-  GroupMap::const_iterator i = m_groups.find (mcastGrAddr);
-  if (i != m_groups.end ())
+  uint32_t index = GetGroupIndex (mcastGrAddr);
+  if (index == INVALID_GROUP_INDEX)
     {
-      return (i->second.find (address) != i->second.end ());
+      return false;
     }
-  return false;
+  return (m_membership.find (MembershipKey (index, address)) != m_membership.end ());
+}
+
+uint32_t
+GlobalGroupManagement::GetGroupIndex (Ipv4Address mcastGrAddr) const
+{
+  std::unordered_map<uint32_t, uint32_t>::const_iterator i = m_groupIndex.find (mcastGrAddr.Get ());
+  if (i == m_groupIndex.end ())
+    {
+      return INVALID_GROUP_INDEX;
+    }
+  return i->second;
 }
 
 GlobalGroupManagement::MemberSet
 GlobalGroupManagement::GetGroupMembers (Ipv4Address mcastGrAddr) const
 {
-  GroupMap::const_iterator i = m_groups.find (mcastGrAddr);
-  if (i != m_groups.end ())
+  uint32_t index = GetGroupIndex (mcastGrAddr);
+  if (index == INVALID_GROUP_INDEX)
     {
-      return i->second;
+      return MemberSet ();
     }
-  return MemberSet ();
+  return m_groups[index].members;
 }
 
 GlobalGroupManagement::GroupMap
 GlobalGroupManagement::GetGroupMap () const
 {
-  return m_groups;
+  GroupMap groups;
+  for (std::vector<Group>::const_iterator i = m_groups.begin (); i != m_groups.end (); ++i)
+    {
+      if (i->used)
+        {
+          groups.insert (std::make_pair (i->address, i->members));
+        }
+    }
+  return groups;
 }
 
 }
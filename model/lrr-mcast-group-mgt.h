@@ -22,39 +22,120 @@
 #define LRR_GROUP_MANAGEMENT_H_
 
 #include "ns3/ipv4-address.h"
+#include "ns3/traced-callback.h"
 #include <map>
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace ns3 {
 namespace lrr {
-/// Singleton operating with global group member list
+/**
+ * Singleton operating with global group member list
+ *
+ * Every group gets a dense index on creation, address to index is a hash
+ * lookup and membership test is a hash lookup too, so per-packet queries
+ * do not depend on the number of groups and members.
+ */
 class GlobalGroupManagement : public SimpleRefCount<GlobalGroupManagement>
 {
 public:
   typedef std::set<Ipv4Address> MemberSet;
   typedef std::map <Ipv4Address, MemberSet> GroupMap;
+  /**
+   * Membership change notification. Arguments are the group multicast address,
+   * member address and true if member has joined (false if it has left)
+   */
+  typedef Callback<void, Ipv4Address, Ipv4Address, bool> MembershipChangeCallback;
+  /**
+   * Group removal notification. Arguments are the group multicast address and its index,
+   * which is free after the notification
+   */
+  typedef Callback<void, Ipv4Address, uint32_t> GroupRemovedCallback;
+  /// Index of a group, which does not exist
+  static const uint32_t INVALID_GROUP_INDEX = 0xffffffff;
 public:
   static GlobalGroupManagement * GetInstance ();
-  /// Allocate next IP address. Number of addresses is less than 255
+  /**
+   * Allocate next unused multicast address from the multicast prefix.
+   * Addresses of removed groups are reused
+   */
   static Ipv4Address AllocateMulticastAddress ();
   static void Destroy ();
   ~GlobalGroupManagement ();
+  /// Set prefix for AllocateMulticastAddress (227.0.0.0/8 by default)
+  void SetMulticastPrefix (Ipv4Address prefix, Ipv4Mask mask);
   /// Add a new multicast group. If exists: update (OVERWRITE!) member list
   void AddMcastGroup (Ipv4Address mcastGrAddr, MemberSet memberList);
   /// Delete multicast group by multicast address:
   void RemoveMulticastgroup (Ipv4Address mcastAddress);
+  /**
+   * \brief Add a single member to a group, group is created if does not exist
+   * \return false if address is already a member of the group
+   */
+  bool Join (Ipv4Address mcastGrAddr, Ipv4Address member);
+  /**
+   * \brief Remove a single member from a group. Group itself is kept
+   * \return false if address is not a member of the group
+   */
+  bool Leave (Ipv4Address mcastGrAddr, Ipv4Address member);
+  ///\name Membership change notification (every Join/Leave, including ones
+  /// made by AddMcastGroup and RemoveMulticastgroup)
+  ///\{
+  void ConnectMembershipChange (MembershipChangeCallback cb);
+  void DisconnectMembershipChange (MembershipChangeCallback cb);
+  ///\}
+  ///\name Group removal notification (made after all members have left)
+  ///\{
+  void ConnectGroupRemoved (GroupRemovedCallback cb);
+  void DisconnectGroupRemoved (GroupRemovedCallback cb);
+  ///\}
   /// Check that address is in multicast group
   bool IsInMcastGroup (Ipv4Address address, Ipv4Address mcastGroupAddr) const;
-  /// Get group members by multicast adddress:
+  /**
+   * \return index of a group, which is valid while group exists (reused after
+   * group removal), or INVALID_GROUP_INDEX
+   */
+  uint32_t GetGroupIndex (Ipv4Address mcastGroupAddr) const;
+  /// Get group members by multicast adddress (a copy: group storage is moved when groups are added)
   MemberSet GetGroupMembers (Ipv4Address mcastAddress) const;
   /// Get the whole group set (for global topology)
   GroupMap GetGroupMap () const;
 private:
   /// Private singleton constructor:
   GlobalGroupManagement ();
+  Ipv4Address DoAllocateMulticastAddress ();
+  /// \return index of a group, group is created if does not exist
+  uint32_t AddGroupIndex (Ipv4Address mcastGroupAddr);
+  /// Key of membership set: group index (high word) and member address
+  static uint64_t MembershipKey (uint32_t groupIndex, Ipv4Address member);
 private:
-  GroupMap m_groups;
+  struct Group
+  {
+    Ipv4Address address;
+    MemberSet members;
+    bool used;
+  };
+  ///\name Groups
+  ///\{
+  std::vector<Group> m_groups;
+  std::vector<uint32_t> m_freeGroupIndexes;
+  std::unordered_map<uint32_t, uint32_t> m_groupIndex;
+  std::unordered_set<uint64_t> m_membership;
+  ///\}
+  ///\name Address allocator
+  ///\{
+  Ipv4Address m_prefix;
+  Ipv4Mask m_mask;
+  /// Last host part allocated from the prefix
+  uint32_t m_lastHostId;
+  /// Addresses of removed groups to be allocated first
+  std::vector<uint32_t> m_freeAddresses;
+  std::unordered_set<uint32_t> m_allocated;
+  ///\}
+  TracedCallback<Ipv4Address, Ipv4Address, bool> m_membershipChange;
+  TracedCallback<Ipv4Address, uint32_t> m_groupRemoved;
 };
 
 }
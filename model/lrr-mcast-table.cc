@@ -36,9 +36,18 @@ GlobalMcastTable::~GlobalMcastTable ()
 {
 }
 
+GlobalMcastTable::ForwardingEntryId
+GlobalMcastTable::GetForwardingEntryId (const Ipv4Address & root, const Ipv4Address & retranslator)
+{
+  return ((uint64_t) root.Get () << 32) | retranslator.Get ();
+}
+
 void
 GlobalMcastTable::Update ()
 {
+  // Paths may have changed, so all trees are rebuilt from scratch:
+  m_multicastForwardingMap.clear ();
+  m_brunches.clear ();
   GlobalGroupManagement::GroupMap groups = GlobalGroupManagement::GetInstance ()->GetGroupMap ();
   for (GlobalGroupManagement::GroupMap::iterator i = groups.begin (); i != groups.end (); i++)
     {
@@ -72,44 +81,148 @@ GlobalMcastTable::UpdateMulticastTree (const Ipv4Address & groupId, const Ipv4Ad
     }
 }
 
+void
+GlobalMcastTable::Graft (const Ipv4Address & groupId, const Ipv4Address & member)
+{
+  std::set<Ipv4Address> members = GlobalGroupManagement::GetInstance ()->GetGroupMembers (groupId);
+  for (set<Ipv4Address>::const_iterator i = members.begin (); i != members.end (); ++i)
+    {
+      if (*i == member)
+        {
+          continue;
+        }
+      if (GlobalGraph::Instance ()->HavePath (*i, member))
+        {
+          UpdateMulticastBrunch (groupId, *i, member);
+        }
+      if (GlobalGraph::Instance ()->HavePath (member, *i))
+        {
+          UpdateMulticastBrunch (groupId, member, *i);
+        }
+    }
+}
+
+void
+GlobalMcastTable::Prune (const Ipv4Address & groupId, const Ipv4Address & member)
+{
+  ForwardingTableTreeId treeId = std::make_pair (groupId, member);
+  // Brunches of a tree are adjacent in the map, the smallest leaf address is 0.0.0.0:
+  BrunchMap::iterator i = m_brunches.lower_bound (std::make_pair (treeId, Ipv4Address ((uint32_t) 0)));
+  while ((i != m_brunches.end ()) && (i->first.first == treeId))
+    {
+      RemoveMulticastBrunch (i++);
+    }
+  // Brunches leading to the member from other trees of the same group:
+  std::set<Ipv4Address> members = GlobalGroupManagement::GetInstance ()->GetGroupMembers (groupId);
+  for (set<Ipv4Address>::const_iterator j = members.begin (); j != members.end (); ++j)
+    {
+      BrunchMap::iterator brunch = m_brunches.find (std::make_pair (std::make_pair (groupId, *j), member));
+      if (brunch != m_brunches.end ())
+        {
+          RemoveMulticastBrunch (brunch);
+        }
+    }
+}
+
+void
+GlobalMcastTable::RemoveGroup (const Ipv4Address & groupId, uint32_t groupIndex)
+{
+  // Brunches of a group are adjacent in the map, the smallest root and leaf addresses are 0.0.0.0:
+  Ipv4Address any ((uint32_t) 0);
+  BrunchMap::iterator i = m_brunches.lower_bound (std::make_pair (std::make_pair (groupId, any), any));
+  while ((i != m_brunches.end ()) && (i->first.first.first == groupId))
+    {
+      m_brunches.erase (i++);
+    }
+  // Index is reused by the next group:
+  if (groupIndex < m_multicastForwardingMap.size ())
+    {
+      m_multicastForwardingMap[groupIndex].clear ();
+    }
+}
+
 void
 GlobalMcastTable::UpdateMulticastBrunch (const Ipv4Address & groupId, const Ipv4Address & srcAddress,
                                          const Ipv4Address & dstAddress)
 {
   Ipv4Address retr; // = GlobalGraph::Instance ()->GetNextHopMain (srcAddress, dstAddress);
   ForwardingTableTreeId treeId = std::make_pair (groupId, srcAddress);
+  BrunchId brunchId = std::make_pair (treeId, dstAddress);
+  if (m_brunches.find (brunchId) != m_brunches.end ())
+    {
+      // Already installed
+      return;
+    }
+  uint32_t groupIndex = GlobalGroupManagement::GetInstance ()->GetGroupIndex (groupId);
+  NS_ASSERT (groupIndex != GlobalGroupManagement::INVALID_GROUP_INDEX);
+  if (m_multicastForwardingMap.size () <= groupIndex)
+    {
+      m_multicastForwardingMap.resize (groupIndex + 1);
+    }
+  GroupForwardingTable & table = m_multicastForwardingMap[groupIndex];
+  std::vector<std::pair<Ipv4Address, Ipv4Address> > & hops = m_brunches[brunchId];
   Ipv4Address current = srcAddress;
   do
     {
       NS_ASSERT (GlobalGraph::Instance ()->HavePath (current, dstAddress));
       retr = GlobalGraph::Instance ()->GetNextHopMain (current, dstAddress);
       // Update forwarding table (outgoing interfaces)
-      ForwardingEntryId forwId = std::make_pair (current, treeId);
-      MulticastForwardingTable::iterator forw_it = m_multicastForwardingMap.find (forwId);
-      if (forw_it == m_multicastForwardingMap.end ())
-        {
-          m_multicastForwardingMap.insert (std::make_pair (forwId, std::set<Ipv4Address> ()));
-          forw_it = m_multicastForwardingMap.find (forwId);
-        }
+      ForwardingEntryId forwId = GetForwardingEntryId (srcAddress, current);
       Ipv4Address outInterface = GlobalGraph::Instance ()->GetUnicastRoute (current, retr).first;
-      forw_it->second.insert (outInterface);
+      table[forwId][outInterface]++;
+      hops.push_back (std::make_pair (current, outInterface));
 
       current = retr;
     }
   while (retr != dstAddress);
 }
 
+void
+GlobalMcastTable::RemoveMulticastBrunch (BrunchMap::iterator brunch)
+{
+  ForwardingTableTreeId treeId = brunch->first.first;
+  uint32_t groupIndex = GlobalGroupManagement::GetInstance ()->GetGroupIndex (treeId.first);
+  NS_ASSERT (groupIndex < m_multicastForwardingMap.size ());
+  GroupForwardingTable & table = m_multicastForwardingMap[groupIndex];
+  for (std::vector<std::pair<Ipv4Address, Ipv4Address> >::const_iterator i = brunch->second.begin ();
+       i != brunch->second.end (); ++i)
+    {
+      GroupForwardingTable::iterator forw_it = table.find (GetForwardingEntryId (treeId.second, i->first));
+      NS_ASSERT (forw_it != table.end ());
+      std::map<Ipv4Address, uint32_t>::iterator iface = forw_it->second.find (i->second);
+      NS_ASSERT ((iface != forw_it->second.end ()) && (iface->second > 0));
+      if (--iface->second == 0)
+        {
+          forw_it->second.erase (iface);
+        }
+      if (forw_it->second.empty ())
+        {
+          table.erase (forw_it);
+        }
+    }
+  m_brunches.erase (brunch);
+}
+
 std::set<Ipv4Address>
 GlobalMcastTable::GetMulticastRoute (const Ipv4Address& from, const Ipv4Address& mcastTo, const Ipv4Address& local) const
 {
-  ForwardingTableTreeId treeId = std::make_pair (mcastTo, from);
-  ForwardingEntryId forwId = std::make_pair (local, treeId);
-  MulticastForwardingTable::const_iterator forw_it = m_multicastForwardingMap.find (forwId);
-  if (forw_it == m_multicastForwardingMap.end ())
+  std::set<Ipv4Address> retval;
+  uint32_t groupIndex = GlobalGroupManagement::GetInstance ()->GetGroupIndex (mcastTo);
+  if (groupIndex >= m_multicastForwardingMap.size ())
+    {
+      return retval;
+    }
+  const GroupForwardingTable & table = m_multicastForwardingMap[groupIndex];
+  GroupForwardingTable::const_iterator forw_it = table.find (GetForwardingEntryId (from, local));
+  if (forw_it == table.end ())
+    {
+      return retval;
+    }
+  for (std::map<Ipv4Address, uint32_t>::const_iterator i = forw_it->second.begin (); i != forw_it->second.end (); ++i)
     {
-      return std::set<Ipv4Address> ();
+      retval.insert (i->first);
     }
-  return forw_it->second;
+  return retval;
 }
 
 bool
@@ -25,6 +25,8 @@
 #include "ns3/ipv4-address.h"
 #include <map>
 #include <set>
+#include <vector>
+#include <unordered_map>
 
 namespace ns3 {
 namespace lrr {
@@ -58,16 +60,32 @@ public:
   std::set<Ipv4Address> GetMulticastRoute (const Ipv4Address & from, const Ipv4Address & mcastTo, const Ipv4Address & local) const;
   /// Update multicast table. Called after graph update
   void Update ();
+  /**
+   * \brief Graft a new group member: add branches from the rest group members
+   * to \param member and a tree rooted at \param member. Nothing else is touched.
+   */
+  void Graft (const Ipv4Address & groupId, const Ipv4Address & member);
+  /// Prune all branches rooted at or leading to \param member of group \param groupId
+  void Prune (const Ipv4Address & groupId, const Ipv4Address & member);
+  /// Forget all branches and the forwarding table of a removed group, whose index is freed
+  void RemoveGroup (const Ipv4Address & groupId, uint32_t groupIndex);
 private:
   ///\name Multicast forwarding table: Each node must know about nexthop set of each multicast tree, identified by (source unicast, dts multicast pair)
   ///\{
   /// Forwarding table tree ID consists of group ID multicast address (first) and source address  (tree root)
   typedef std::pair<Ipv4Address, Ipv4Address> ForwardingTableTreeId;
-  /// Tree id and retranslator address form a forwarding entry ID
-  typedef std::pair <Ipv4Address, ForwardingTableTreeId> ForwardingEntryId;
-  /// A set of source outgoing interfaces for each forwarding entry ID
-  typedef std::map <ForwardingEntryId, std::set<Ipv4Address> > MulticastForwardingTable;
+  /// Inside a group tree root (high word) and retranslator address form a forwarding entry ID
+  typedef uint64_t ForwardingEntryId;
+  /// Source outgoing interfaces for each forwarding entry ID with the number of brunches using each one
+  typedef std::unordered_map <ForwardingEntryId, std::map<Ipv4Address, uint32_t> > GroupForwardingTable;
+  /// Forwarding tables of all groups indexed by group index (see GlobalGroupManagement)
+  typedef std::vector<GroupForwardingTable> MulticastForwardingTable;
+  /// Brunch is identified by the tree it belongs to and its leaf
+  typedef std::pair<ForwardingTableTreeId, Ipv4Address> BrunchId;
+  /// (retranslator, outgoing interface) hops of each brunch, kept to prune it later
+  typedef std::map <BrunchId, std::vector<std::pair<Ipv4Address, Ipv4Address> > > BrunchMap;
   ///\}
+  static ForwardingEntryId GetForwardingEntryId (const Ipv4Address & root, const Ipv4Address & retranslator);
   /**
    * \brief Update multicast group. Iterate throug all group members and construct trees starting at
    * each group member with all the rest group members as leafs.
@@ -90,9 +108,13 @@ private:
    * \param dstAddress is a leaf of the brunch
    */
   void UpdateMulticastBrunch (const Ipv4Address & groupId, const Ipv4Address & srcAddress, const Ipv4Address & dstAddress);
+  /// Remove a brunch and release forwarding entries used only by this brunch
+  void RemoveMulticastBrunch (BrunchMap::iterator brunch);
 private:
   /// Multicast forwarding table gives a set of next-hop interfaces for each station inside a tree (tree ID is source and )
   MulticastForwardingTable m_multicastForwardingMap;
+  /// All brunches installed into the forwarding table
+  BrunchMap m_brunches;
 };
 
 } // namespace lrr
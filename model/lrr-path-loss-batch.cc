@@ -0,0 +1,319 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "lrr-path-loss-batch.h"
+
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include <algorithm>
+#include <cmath>
+#ifdef LRR_PATH_LOSS_AVX2
+#include <immintrin.h>
+#endif
+
+NS_LOG_COMPONENT_DEFINE ("LrrPathLossBatch");
+
+namespace ns3 {
+namespace lrr {
+
+/// Speed of light, as in ns-3 propagation loss models
+static const double C = 299792458.0;
+
+#ifdef LRR_PATH_LOSS_AVX2
+/**
+ * AVX2 kernels are compiled for this target only, the module itself is built without -mavx2, so
+ * they are called after a run time check of the CPU. Each kernel processes receivers four at
+ * a time and returns the number of processed ones, the rest is left to the scalar code.
+ */
+__attribute__ ((target ("avx2"))) static uint32_t
+CalcDistances2Avx2 (const Vector & tx, const double * x, const double * y, const double * z, uint32_t n, double * d2)
+{
+  __m256d txX = _mm256_set1_pd (tx.x);
+  __m256d txY = _mm256_set1_pd (tx.y);
+  __m256d txZ = _mm256_set1_pd (tx.z);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d dx = _mm256_sub_pd (_mm256_loadu_pd (x + i), txX);
+      __m256d dy = _mm256_sub_pd (_mm256_loadu_pd (y + i), txY);
+      __m256d dz = _mm256_sub_pd (_mm256_loadu_pd (z + i), txZ);
+      __m256d sum = _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (dx, dx), _mm256_mul_pd (dy, dy)), _mm256_mul_pd (dz, dz));
+      _mm256_storeu_pd (d2 + i, sum);
+    }
+  return i;
+}
+
+/// Friis gains in place of squared distances
+__attribute__ ((target ("avx2"))) static uint32_t
+CalcFriisAvx2 (double friisFactor, double maxGain, uint32_t n, double * gains)
+{
+  __m256d factor = _mm256_set1_pd (friisFactor);
+  __m256d max = _mm256_set1_pd (maxGain);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d gain = _mm256_div_pd (factor, _mm256_loadu_pd (gains + i));
+      // Infinity at zero distance is limited as well, min returns the second operand for NaN only
+      _mm256_storeu_pd (gains + i, _mm256_min_pd (gain, max));
+    }
+  return i;
+}
+
+/// TwoRayGround gains in place of squared distances
+__attribute__ ((target ("avx2"))) static uint32_t
+CalcTwoRayGroundAvx2 (double friisFactor, double systemLoss, double minDistance, double heightAboveZ, double lambda,
+                      double txZ, const double * z, uint32_t n, double * gains)
+{
+  __m256d factor = _mm256_set1_pd (friisFactor);
+  __m256d loss = _mm256_set1_pd (systemLoss);
+  __m256d minD = _mm256_set1_pd (minDistance);
+  __m256d height = _mm256_set1_pd (heightAboveZ);
+  __m256d txAntHeight = _mm256_set1_pd (txZ + heightAboveZ);
+  __m256d crossFactor = _mm256_set1_pd (4 * M_PI);
+  __m256d lambdaV = _mm256_set1_pd (lambda);
+  __m256d one = _mm256_set1_pd (1.0);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d d2 = _mm256_loadu_pd (gains + i);
+      __m256d distance = _mm256_sqrt_pd (d2);
+      __m256d rxAntHeight = _mm256_add_pd (_mm256_loadu_pd (z + i), height);
+      __m256d dCross = _mm256_div_pd (_mm256_mul_pd (_mm256_mul_pd (crossFactor, txAntHeight), rxAntHeight), lambdaV);
+      __m256d heights = _mm256_mul_pd (txAntHeight, rxAntHeight);
+      __m256d friis = _mm256_div_pd (factor, d2);
+      __m256d ray = _mm256_div_pd (_mm256_mul_pd (heights, heights), _mm256_mul_pd (_mm256_mul_pd (d2, d2), loss));
+      __m256d gain = _mm256_blendv_pd (ray, friis, _mm256_cmp_pd (distance, dCross, _CMP_LE_OQ));
+      gain = _mm256_blendv_pd (gain, one, _mm256_cmp_pd (distance, minD, _CMP_LE_OQ));
+      _mm256_storeu_pd (gains + i, gain);
+    }
+  return i;
+}
+#endif
+
+PathLossBatch::PathLossBatch () :
+  m_type (NONE),
+  m_model (0),
+  m_lambda (0),
+  m_systemLoss (1),
+  m_friisFactor (0),
+  m_maxGain (1),
+  m_minDistance (0),
+  m_heightAboveZ (0),
+  m_exponent (0),
+  m_referenceDistance2 (1),
+  m_referenceGain (1),
+  m_vectorized (IsVectorizationSupported ())
+{
+}
+
+bool
+PathLossBatch::Configure (Ptr<PropagationLossModel> model)
+{
+  m_model = model;
+  m_type = NONE;
+  // Chained models apply the next one, derived models may override the calculation:
+  if ((model == 0) || (model->GetNext () != 0))
+    {
+      return false;
+    }
+  TypeId tid = model->GetInstanceTypeId ();
+  DoubleValue value;
+  if ((tid == FriisPropagationLossModel::GetTypeId ()) || (tid == TwoRayGroundPropagationLossModel::GetTypeId ()))
+    {
+      model->GetAttribute ("Frequency", value);
+      m_lambda = C / value.Get ();
+      model->GetAttribute ("SystemLoss", value);
+      m_systemLoss = value.Get ();
+      m_friisFactor = m_lambda * m_lambda / (16 * M_PI * M_PI * m_systemLoss);
+      if (tid == FriisPropagationLossModel::GetTypeId ())
+        {
+          model->GetAttribute ("MinLoss", value);
+          m_maxGain = std::pow (10.0, -value.Get () / 10.0);
+          m_type = FRIIS;
+        }
+      else
+        {
+          model->GetAttribute ("MinDistance", value);
+          m_minDistance = value.Get ();
+          model->GetAttribute ("HeightAboveZ", value);
+          m_heightAboveZ = value.Get ();
+          m_type = TWO_RAY_GROUND;
+        }
+    }
+  else if (tid == LogDistancePropagationLossModel::GetTypeId ())
+    {
+      model->GetAttribute ("Exponent", value);
+      m_exponent = value.Get ();
+      model->GetAttribute ("ReferenceDistance", value);
+      m_referenceDistance2 = value.Get () * value.Get ();
+      model->GetAttribute ("ReferenceLoss", value);
+      m_referenceGain = std::pow (10.0, -value.Get () / 10.0);
+      m_type = LOG_DISTANCE;
+    }
+  NS_LOG_DEBUG ("Model " << tid.GetName () << (m_type == NONE ? " is not supported" : " is supported"));
+  return m_type != NONE;
+}
+
+bool
+PathLossBatch::IsConfiguredFor (Ptr<PropagationLossModel> model) const
+{
+  return (m_model != 0) && (m_model == model);
+}
+
+bool
+PathLossBatch::IsSupported () const
+{
+  return m_type != NONE;
+}
+
+bool
+PathLossBatch::IsVectorizationSupported ()
+{
+#ifdef LRR_PATH_LOSS_AVX2
+  return __builtin_cpu_supports ("avx2");
+#else
+  return false;
+#endif
+}
+
+void
+PathLossBatch::SetVectorized (bool vectorized)
+{
+  m_vectorized = vectorized && IsVectorizationSupported ();
+}
+
+bool
+PathLossBatch::IsVectorized () const
+{
+  return m_vectorized;
+}
+
+void
+PathLossBatch::Reject ()
+{
+  m_type = NONE;
+}
+
+double
+PathLossBatch::CalcFriisGain (double d2) const
+{
+  // Zero distance gives infinite gain limited by MinLoss, as the model does
+  return std::min (m_friisFactor / d2, m_maxGain);
+}
+
+double
+PathLossBatch::CalcLogDistanceGain (double d2) const
+{
+  if (d2 <= m_referenceDistance2)
+    {
+      return m_referenceGain;
+    }
+  return m_referenceGain * std::pow (d2 / m_referenceDistance2, -m_exponent / 2);
+}
+
+double
+PathLossBatch::CalcTwoRayGroundGain (double d2, double txZ, double rxZ) const
+{
+  double distance = std::sqrt (d2);
+  if (distance <= m_minDistance)
+    {
+      return 1;
+    }
+  double txAntHeight = txZ + m_heightAboveZ;
+  double rxAntHeight = rxZ + m_heightAboveZ;
+  double dCross = (4 * M_PI * txAntHeight * rxAntHeight) / m_lambda;
+  if (distance <= dCross)
+    {
+      return m_friisFactor / d2;
+    }
+  double heights = txAntHeight * rxAntHeight;
+  return (heights * heights) / (d2 * d2 * m_systemLoss);
+}
+
+void
+PathLossBatch::CalcDistances2 (const Vector & tx, const double * x, const double * y, const double * z, uint32_t n, double * d2) const
+{
+  uint32_t i = 0;
+#ifdef LRR_PATH_LOSS_AVX2
+  if (m_vectorized)
+    {
+      i = CalcDistances2Avx2 (tx, x, y, z, n, d2);
+    }
+#endif
+  for (; i < n; i++)
+    {
+      double dx = x[i] - tx.x;
+      double dy = y[i] - tx.y;
+      double dz = z[i] - tx.z;
+      d2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+void
+PathLossBatch::CalcGains (const Vector & tx, const double * x, const double * y, const double * z, uint32_t n, double * gains) const
+{
+  NS_ASSERT (m_type != NONE);
+  CalcDistances2 (tx, x, y, z, n, gains);
+  uint32_t i = 0;
+  switch (m_type)
+    {
+    case FRIIS:
+      {
+#ifdef LRR_PATH_LOSS_AVX2
+        if (m_vectorized)
+          {
+            i = CalcFriisAvx2 (m_friisFactor, m_maxGain, n, gains);
+          }
+#endif
+        for (; i < n; i++)
+          {
+            gains[i] = CalcFriisGain (gains[i]);
+          }
+        break;
+      }
+    case TWO_RAY_GROUND:
+      {
+#ifdef LRR_PATH_LOSS_AVX2
+        if (m_vectorized)
+          {
+            i = CalcTwoRayGroundAvx2 (m_friisFactor, m_systemLoss, m_minDistance, m_heightAboveZ, m_lambda,
+                                      tx.z, z, n, gains);
+          }
+#endif
+        for (; i < n; i++)
+          {
+            gains[i] = CalcTwoRayGroundGain (gains[i], tx.z, z[i]);
+          }
+        break;
+      }
+    case LOG_DISTANCE:
+      // No vector pow in AVX2, distances are vectorized only
+      for (; i < n; i++)
+        {
+          gains[i] = CalcLogDistanceGain (gains[i]);
+        }
+      break;
+    default:
+      NS_FATAL_ERROR ("Unsupported model");
+    }
+}
+
+} // namespace lrr
+} // namespace ns3
@@ -0,0 +1,110 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author:  Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#ifndef LRR_PATH_LOSS_BATCH_H
+#define LRR_PATH_LOSS_BATCH_H
+
+#include "ns3/propagation-loss-model.h"
+#include "ns3/vector.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+/// AVX2 kernels are built with a target attribute and chosen at run time
+#define LRR_PATH_LOSS_AVX2
+#endif
+
+namespace ns3 {
+namespace lrr {
+/**
+ * \ingroup lrr
+ * \brief Path loss from one transmitter to many receivers in one pass.
+ *
+ * Friis, LogDistance and TwoRayGround models (not chained) are recognized by type, their attributes are
+ * taken once and gains are calculated in linear domain from squared distances, so Friis and TwoRayGround
+ * need neither log10 nor pow. If the CPU supports AVX2 (checked at run time) four receivers are processed
+ * at once, LogDistance keeps a scalar pow after vectorized distances. Other models are not supported, the
+ * caller uses the model itself.
+ */
+class PathLossBatch
+{
+public:
+  PathLossBatch ();
+  /// Recognize a model and take its attributes, \return true if the model is supported
+  bool Configure (Ptr<PropagationLossModel> model);
+  /// \return true if the last Configure was called for \param model
+  bool IsConfiguredFor (Ptr<PropagationLossModel> model) const;
+  bool IsSupported () const;
+  /// Do not use batch calculation for the configured model any more
+  void Reject ();
+  /// \return true if this build and CPU can run AVX2 kernels
+  static bool IsVectorizationSupported ();
+  /// Use AVX2 kernels if supported (default) or scalar code only
+  void SetVectorized (bool vectorized);
+  bool IsVectorized () const;
+  /**
+   * \brief Linear gains (received to transmitted power ratio) from a transmitter at \param tx
+   * to \param n receivers with coordinates \param x, \param y and \param z
+   */
+  void CalcGains (const Vector & tx, const double * x, const double * y, const double * z, uint32_t n, double * gains) const;
+private:
+  enum Type
+  {
+    NONE,
+    FRIIS,
+    LOG_DISTANCE,
+    TWO_RAY_GROUND
+  };
+  /// Squared distances to receivers
+  void CalcDistances2 (const Vector & tx, const double * x, const double * y, const double * z, uint32_t n, double * d2) const;
+  ///\name Gain of a single receiver by squared distance
+  ///\{
+  double CalcFriisGain (double d2) const;
+  double CalcLogDistanceGain (double d2) const;
+  double CalcTwoRayGroundGain (double d2, double txZ, double rxZ) const;
+  ///\}
+private:
+  Type m_type;
+  /// Configured model, kept to detect model change
+  Ptr<PropagationLossModel> m_model;
+  ///\name Friis and TwoRayGround
+  ///\{
+  double m_lambda;
+  double m_systemLoss;
+  /// lambda^2 / (16 pi^2 L)
+  double m_friisFactor;
+  /// Friis gain corresponding to MinLoss
+  double m_maxGain;
+  double m_minDistance;
+  double m_heightAboveZ;
+  ///\}
+  ///\name LogDistance
+  ///\{
+  double m_exponent;
+  double m_referenceDistance2;
+  /// Gain at the reference distance
+  double m_referenceGain;
+  ///\}
+  /// Use AVX2 kernels
+  bool m_vectorized;
+};
+
+} // namespace lrr
+} // namespace ns3
+
+#endif /* LRR_PATH_LOSS_BATCH_H */
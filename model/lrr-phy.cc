@@ -24,6 +24,7 @@
 #include "ns3/log.h"
 #include "ns3/double.h"
 #include "ns3/uinteger.h"
+#include <algorithm>
 
 #include "lrr-phy.h"
 #include "lrr-device-impl.h"
@@ -37,6 +38,7 @@ NS_OBJECT_ENSURE_REGISTERED (Phy);
 Phy::Phy () :
   HalfDuplexIdealPhy (),
   m_channel (0),
+  m_channelIndex (0),
   m_txPsd (0),
   m_errorModel (0),
   m_rxFilter (0),
@@ -45,7 +47,10 @@ Phy::Phy () :
   m_edThresholdDbm (-99),
   m_linkQualityAddtionDb (0),
   m_communicationSuccessProbability (0.99),
-  m_communicationTestPacketLength (100)
+  m_communicationTestPacketLength (100),
+  m_txPowerLevels (1),
+  m_txPowerStepDb (3),
+  m_txPowerMarginDb (3)
 {
 }
 
@@ -74,12 +79,12 @@ Phy::GetTypeId (void)
     .AddAttribute ("EnergyDetectionThreshold",
                    "The same as the Energy detection threshold: all signals weaker than this threshold are not captured",
                    DoubleValue (-99), /// Default for WiFi modes with Range error model
-                   MakeDoubleAccessor (&Phy::m_edThresholdDbm),
+                   MakeDoubleAccessor (&Phy::SetEnergyDetectionThreshold, &Phy::GetEnergyDetectionThreshold),
                    MakeDoubleChecker<double> ())
     .AddAttribute ("LinkQualityAddtionDb",
                    "Add some gap to make links still relable even with fading. Set in according with fading model",
                    DoubleValue (0), /// Depends on fading conditions
-                   MakeDoubleAccessor (&Phy::m_linkQualityAddtionDb),
+                   MakeDoubleAccessor (&Phy::SetLinkQualityAddition, &Phy::GetLinkQualityAddition),
                    MakeDoubleChecker<double> ())
     .AddAttribute ("CommunicationTestPacketLengh",
                    "Packet length to be tested with error model to estimate communication range",
@@ -91,6 +96,21 @@ Phy::GetTypeId (void)
                    DoubleValue (0.99),
                    MakeDoubleAccessor (&Phy::m_communicationSuccessProbability),
                    MakeDoubleChecker<double> (0,1))
+    .AddAttribute ("TxPowerLevels",
+                   "Number of TX power levels for per-link power control, one disables power control",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&Phy::m_txPowerLevels),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("TxPowerStepDb",
+                   "Attenuation between adjacent TX power levels",
+                   DoubleValue (3),
+                   MakeDoubleAccessor (&Phy::m_txPowerStepDb),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("TxPowerMarginDb",
+                   "Link margin above neighbor detection threshold kept when TX power is reduced",
+                   DoubleValue (3),
+                   MakeDoubleAccessor (&Phy::m_txPowerMarginDb),
+                   MakeDoubleChecker<double> (0))
   ;
   return tid;
 }
@@ -129,6 +149,10 @@ void
 Phy::SetTxPowerSpectralDensity (Ptr<SpectrumValue> txPsd)
 {
   m_txPsd = txPsd;
+  if (m_channel != 0)
+    {
+      m_channel->UpdateFilterClass (m_channelIndex);
+    }
   InitiateNeighborDetectionthresholdDbm ();
   HalfDuplexIdealPhy::SetTxPowerSpectralDensity (txPsd);
 }
@@ -152,34 +176,249 @@ Phy::SetErrorModel (Ptr<SpectrumErrorModel> m)
 std::vector<Ptr<NetDevice> >
 Phy::GetCommunicationNeighbors ()
 {
-  NeighborAwareSpectrumChannel::NeighborList neighbors = GetAllNeigbors ();
+  std::vector<std::pair<Ptr<NetDevice>, double> > links = GetCommunicationLinks ();
   std::vector<Ptr<NetDevice> > retval;
+  for (std::vector<std::pair<Ptr<NetDevice>, double> >::const_iterator i = links.begin (); i != links.end (); ++i)
+    {
+      retval.push_back (i->first);
+    }
+  return retval;
+}
+
+std::vector<std::pair<Ptr<NetDevice>, double> >
+Phy::GetCommunicationLinks ()
+{
+  std::vector<std::pair<Ptr<NetDevice>, double> > retval;
+  if (m_channel->IsAdjacencyPreferred ())
+    {
+      const NeighborAwareSpectrumChannel::Adjacency & adjacency = m_channel->GetAdjacency ();
+      const std::vector<uint32_t> & neighbors = adjacency.communication[m_channelIndex];
+      // Adjacency has only PHYs of LRR devices, they are cached by the channel:
+      for (uint32_t i = 0; i < neighbors.size (); i++)
+        {
+          Ptr<NetDevice> device = m_channel->GetNeighborAwareDevice (neighbors[i]);
+          retval.push_back (std::make_pair (device, adjacency.communicationRxPowerMw[m_channelIndex][i]));
+        }
+      return retval;
+    }
+  NeighborAwareSpectrumChannel::NeighborList neighbors = GetAllNeigbors ();
   for (NeighborAwareSpectrumChannel::NeighborList::iterator i = neighbors.begin (); i != neighbors.end (); i++)
     {
-      NS_ASSERT (i->first->GetObject<NeighborAwareDeviceImpl> () != 0);
-      Ptr<Phy> nbrPhy = i->first->GetObject<NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<Phy> ();
+      Ptr<Phy> nbrPhy = i->phy;
       if (nbrPhy == 0)
         {
           continue;
         }
-      double nbrRxPowerMw = GetSignalPowerMw (nbrPhy->ApplyRxFilter (i->second));
+      double nbrRxPowerMw = GetSignalPowerMw (nbrPhy->ApplyRxFilter (i->rxPsd));
       if (MwToDbm (nbrRxPowerMw) <= m_neighborDetectionThresholdDbm)
         {
           continue;
         }
       if (NeighborRxFilterEquals (nbrPhy))
         {
-          retval.push_back (i->first);
+          retval.push_back (std::make_pair (i->device, nbrRxPowerMw));
         }
     }
   return retval;
 }
 
+void
+Phy::AddLink (const Address & address, double rxPowerMw)
+{
+  // Highest rate whose margin is covered, base rate otherwise
+  double marginDb = MwToDbm (rxPowerMw) - m_neighborDetectionThresholdDbm;
+  std::map<double, DataRate>::const_iterator rate = m_rateLadder.upper_bound (marginDb);
+  if (rate != m_rateLadder.begin ())
+    {
+      --rate;
+      m_rateTable[address] = rate->second;
+      marginDb -= rate->first;
+    }
+  // Lowest power keeping the rest of the margin:
+  if ((m_txPowerLevels > 1) && (m_txPowerStepDb > 0) && (marginDb > m_txPowerMarginDb))
+    {
+      uint32_t level = std::min (m_txPowerLevels - 1, (uint32_t) ((marginDb - m_txPowerMarginDb) / m_txPowerStepDb));
+      if (level > 0)
+        {
+          m_txPowerTable[address] = level;
+        }
+    }
+}
+
+void
+Phy::AddRate (DataRate rate, double marginDb)
+{
+  NS_ASSERT (marginDb >= 0);
+  m_rateLadder[marginDb] = rate;
+}
+
+void
+Phy::UpdateLinkTables ()
+{
+  if (m_rateLadder.empty () && (m_txPowerLevels <= 1))
+    {
+      return;
+    }
+  m_rateTable.clear ();
+  m_txPowerTable.clear ();
+  std::vector<std::pair<Ptr<NetDevice>, double> > links = GetCommunicationLinks ();
+  for (std::vector<std::pair<Ptr<NetDevice>, double> >::const_iterator i = links.begin (); i != links.end (); ++i)
+    {
+      AddLink (i->first->GetAddress (), i->second);
+    }
+}
+
+DataRate
+Phy::GetRate (const Address & destination) const
+{
+  std::map<Address, DataRate>::const_iterator i = m_rateTable.find (destination);
+  if (i == m_rateTable.end ())
+    {
+      return GetRate ();
+    }
+  return i->second;
+}
+
+bool
+Phy::StartTx (Ptr<Packet> packet, DataRate rate, uint32_t powerLevel)
+{
+  // Duration and signal are taken by HalfDuplexIdealPhy at the moment of StartTx
+  DataRate baseRate = GetRate ();
+  SetRate (rate);
+  if (powerLevel > 0)
+    {
+      HalfDuplexIdealPhy::SetTxPowerSpectralDensity (GetTxPsd (powerLevel));
+    }
+  bool retval = HalfDuplexIdealPhy::StartTx (packet);
+  SetRate (baseRate);
+  if (powerLevel > 0)
+    {
+      HalfDuplexIdealPhy::SetTxPowerSpectralDensity (m_txPsd);
+    }
+  return retval;
+}
+
+uint32_t
+Phy::GetNTxPowerLevels () const
+{
+  return m_txPowerLevels;
+}
+
+uint32_t
+Phy::GetTxPowerLevel (const Address & destination) const
+{
+  std::map<Address, uint32_t>::const_iterator i = m_txPowerTable.find (destination);
+  if (i == m_txPowerTable.end ())
+    {
+      return 0;
+    }
+  return i->second;
+}
+
+Ptr<SpectrumValue>
+Phy::GetTxPsd (uint32_t powerLevel) const
+{
+  if (powerLevel == 0)
+    {
+      return m_txPsd;
+    }
+  return Create<SpectrumValue> ((*m_txPsd) / DbToRatio (m_txPowerStepDb * powerLevel));
+}
+
+double
+Phy::GetAverageRxPowerMw (Ptr<Phy> sender, uint32_t powerLevel)
+{
+  return GetSignalPowerMw (ApplyRxFilter (m_channel->GetAverageRxPsd (sender->GetTxPsd (powerLevel), sender->GetChannelIndex (), m_channelIndex)));
+}
+
+bool
+Phy::IsSinrSufficient (double signalMw, double interferenceMw) const
+{
+  // Neighbor detection threshold is the weakest signal received over noise only:
+  double noiseMw = GetSignalPowerMw (ApplyRxFilter (m_noisePsd));
+  return (MwToDbm (signalMw * noiseMw / (noiseMw + interferenceMw)) > m_neighborDetectionThresholdDbm);
+}
+
+bool
+Phy::IsDetected (double powerMw) const
+{
+  return ((powerMw > 0) && (MwToDbm (powerMw) > m_edThresholdDbm));
+}
+
+double
+Phy::GetFilteredPowerMw (Ptr<const SpectrumValue> received) const
+{
+  return GetSignalPowerMw (ApplyRxFilter (received));
+}
+
+double
+Phy::GetNeighborDetectionThresholdDbm () const
+{
+  return m_neighborDetectionThresholdDbm;
+}
+
+double
+Phy::GetSensitivityThresholdDbm () const
+{
+  // See MayInterfere
+  return m_edThresholdDbm - m_linkQualityAddtionDb;
+}
+
+Ptr<NeighborAwareSpectrumChannel>
+Phy::GetNeighborAwareChannel () const
+{
+  return m_channel;
+}
+
+void
+Phy::SetChannelIndex (uint32_t index)
+{
+  m_channelIndex = index;
+}
+
+uint32_t
+Phy::GetChannelIndex () const
+{
+  return m_channelIndex;
+}
+
 std::vector<Ptr<NetDevice> >
 Phy::GetInterferenceNeighbors ()
 {
   std::vector<Ptr<NetDevice> > retval;
-  std::set<Ptr<Phy> > oneHopNeighbors = GetSensitivityNeighbors ();
+  std::set<Ptr<Phy> > phySet = GetInterferencePhys ();
+  for (std::set<Ptr<Phy> >::iterator i = phySet.begin (); i != phySet.end (); i++)
+    {
+      NS_ASSERT ((*i)->GetDevice ()->GetObject<NetDevice> () != 0);
+      retval.push_back ((*i)->GetDevice ()->GetObject<NetDevice> ());
+    }
+  NS_LOG_DEBUG ("The size of interference neighbors is " << retval.size ());
+  return retval;
+}
+
+std::vector<uint32_t>
+Phy::GetInterferenceNeighborIndexes ()
+{
+  return GetInterferenceNeighborIndexes (0);
+}
+
+std::vector<uint32_t>
+Phy::GetInterferenceNeighborIndexes (uint32_t powerLevel)
+{
+  std::vector<uint32_t> retval;
+  std::set<Ptr<Phy> > phySet = GetInterferencePhys (powerLevel);
+  for (std::set<Ptr<Phy> >::iterator i = phySet.begin (); i != phySet.end (); i++)
+    {
+      retval.push_back ((*i)->GetChannelIndex ());
+    }
+  return retval;
+}
+
+std::set<Ptr<Phy> >
+Phy::GetInterferencePhys (uint32_t powerLevel)
+{
+  // Stations hearing my transmission at a given power, they transmit at full power
+  std::set<Ptr<Phy> > oneHopNeighbors = GetSensitivityNeighbors (powerLevel);
   std::set<Ptr<Phy> > phySet;
   /**
    * \attention To avoid collisions, we must avoid the following simultaneous transmissions:
@@ -206,30 +445,39 @@ Phy::GetInterferenceNeighbors ()
       std::set<Ptr<Phy> > twoHopNeighbors = (*i)->GetSensitivityNeighbors ();
       phySet.insert (twoHopNeighbors.begin (), twoHopNeighbors.end ());
     }
-  phySet.erase (this);
-  for (std::set<Ptr<Phy> >::iterator i = phySet.begin (); i != phySet.end (); i++)
+  if (powerLevel > 0)
     {
-      NS_ASSERT ((*i)->GetDevice ()->GetObject<NetDevice> () != 0);
-      retval.push_back ((*i)->GetDevice ()->GetObject<NetDevice> ());
+      // Stations reaching me at full power still disturb my reception (e.g. of ACK) when I transmit at a reduced level
+      std::set<Ptr<Phy> > fullPowerNeighbors = GetSensitivityNeighbors (0);
+      phySet.insert (fullPowerNeighbors.begin (), fullPowerNeighbors.end ());
     }
-  NS_LOG_DEBUG ("The size of interference neighbors is " << retval.size ());
-  return retval;
+  phySet.erase (this);
+  return phySet;
 }
 
 std::set<Ptr<Phy> >
-Phy::GetSensitivityNeighbors ()
+Phy::GetSensitivityNeighbors (uint32_t powerLevel)
 {
   std::set<Ptr<Phy> > sensitivityNeighbors;
-  NeighborAwareSpectrumChannel::NeighborList neighbors = GetAllNeigbors ();
+  // Adjacency is calculated at full power:
+  if ((powerLevel == 0) && m_channel->IsAdjacencyPreferred ())
+    {
+      const std::vector<uint32_t> & neighbors = m_channel->GetAdjacency ().sensitivity[m_channelIndex];
+      for (std::vector<uint32_t>::const_iterator i = neighbors.begin (); i != neighbors.end (); ++i)
+        {
+          sensitivityNeighbors.insert (DynamicCast<Phy> (m_channel->GetPhy (*i)));
+        }
+      return sensitivityNeighbors;
+    }
+  NeighborAwareSpectrumChannel::NeighborList neighbors = GetAllNeigbors (powerLevel);
   for (NeighborAwareSpectrumChannel::NeighborList::iterator i = neighbors.begin (); i != neighbors.end (); i++)
     {
-      NS_ASSERT (i->first->GetObject<NeighborAwareDeviceImpl> () != 0);
-      Ptr<Phy> nbrPhy = i->first->GetObject<NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<Phy> ();
+      Ptr<Phy> nbrPhy = i->phy;
       if (nbrPhy == 0)
         {
           continue;
         }
-      if (MayInterfere (nbrPhy, i->second))
+      if (MayInterfere (nbrPhy, i->rxPsd))
         {
           sensitivityNeighbors.insert (nbrPhy);
         }
@@ -242,6 +490,10 @@ Phy::SetRxFilter (Ptr<const SpectrumValue> rxFilter)
 {
   m_rxFilter = rxFilter;
   InitiateNeighborDetectionthresholdDbm ();
+  if (m_channel != 0)
+    {
+      m_channel->UpdateFilterClass (m_channelIndex);
+    }
 }
 
 Ptr<const SpectrumValue>
@@ -250,6 +502,12 @@ Phy::GetRxFilter () const
   return m_rxFilter;
 }
 
+Ptr<const SpectrumValue>
+Phy::GetTxPowerSpectralDensity () const
+{
+  return m_txPsd;
+}
+
 Ptr<SpectrumValue>
 Phy::ApplyRxFilter (Ptr<const SpectrumValue> received) const
 {
@@ -264,9 +522,45 @@ Phy::ApplyRxFilter (Ptr<const SpectrumValue> received) const
   return Create<SpectrumValue> ((*m_rxFilter) * (*convertedSignal));
 }
 
+void
+Phy::SetEnergyDetectionThreshold (double thresholdDbm)
+{
+  m_edThresholdDbm = thresholdDbm;
+  if (m_channel != 0)
+    {
+      m_channel->InvalidateAdjacency ();
+    }
+}
+
+double
+Phy::GetEnergyDetectionThreshold () const
+{
+  return m_edThresholdDbm;
+}
+
+void
+Phy::SetLinkQualityAddition (double additionDb)
+{
+  m_linkQualityAddtionDb = additionDb;
+  if (m_channel != 0)
+    {
+      m_channel->InvalidateAdjacency ();
+    }
+}
+
+double
+Phy::GetLinkQualityAddition () const
+{
+  return m_linkQualityAddtionDb;
+}
+
 void
 Phy::InitiateNeighborDetectionthresholdDbm ()
 {
+  if (m_channel != 0)
+    {
+      m_channel->InvalidateAdjacency ();
+    }
   if ((m_rxFilter == 0) || (m_errorModel == 0) || (m_noisePsd == 0) || (m_txPsd == 0))
     {
       return;
@@ -304,39 +598,21 @@ Phy::InitiateNeighborDetectionthresholdDbm ()
 }
 
 NeighborAwareSpectrumChannel::NeighborList
-Phy::GetAllNeigbors ()
+Phy::GetAllNeigbors (uint32_t powerLevel)
 {
   NS_ASSERT (m_errorModel != 0);
   NS_ASSERT_MSG (m_channel->GetObject<NeighborAwareSpectrumChannel> () != 0, "To detect neighbors, I need NeighborAwareSpectrumChannel");
   Ptr<NeighborAwareDeviceImpl> me = GetDevice ()->GetObject<NeighborAwareDeviceImpl> ();
   NS_ASSERT (me != 0);
-  return m_channel->GetAllNeighbors (me, m_txPsd);
+  return m_channel->GetAllNeighbors (me, GetTxPsd (powerLevel));
 }
 
 bool
 Phy::NeighborRxFilterEquals (Ptr<const Phy> nbrPhy) const
 {
-  Ptr<const SpectrumValue> nbrFilter = nbrPhy->GetRxFilter ();
-  // We can not compare doubles, so some tolerance is needed
-  static double tolerance = 0.01;
-  if (m_rxFilter->GetSpectrumModelUid () != nbrFilter->GetSpectrumModelUid ())
-    {
-      return false;
-    }
-  Values::const_iterator myIt = m_rxFilter->ConstValuesBegin ();
-  Values::const_iterator nbrIt = nbrFilter->ConstValuesBegin ();
-  for (; myIt != m_rxFilter->ConstValuesEnd (); myIt++, nbrIt++)
-    {
-      if ((*nbrIt == 0) && (abs (*myIt) > tolerance))
-        {
-          return false;
-        }
-      if (abs (*myIt / *nbrIt - 1) > tolerance)
-        {
-          return false;
-        }
-    }
-  return true;
+  // Filters are compared once, when they are set:
+  uint32_t filterClass = m_channel->GetFilterClass (m_channelIndex);
+  return (filterClass != NeighborAwareSpectrumChannel::NO_FILTER_CLASS) && (filterClass == m_channel->GetFilterClass (nbrPhy->GetChannelIndex ()));
 }
 
 bool
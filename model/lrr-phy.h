@@ -26,6 +26,7 @@
 #include "ns3/lrr-channel.h"
 #include "ns3/lrr-mac.h"
 #include <set>
+#include <map>
 
 namespace ns3 {
 
@@ -58,11 +59,64 @@ public:
   std::vector<Ptr<NetDevice> > GetCommunicationNeighbors ();
   /// Interference neihbors are one hop + two hop neighbors obtained by sensitivity threshold
   std::vector<Ptr<NetDevice> > GetInterferenceNeighbors ();
+  /// The same as GetInterferenceNeighbors, but PHY ordinals in the channel are returned
+  std::vector<uint32_t> GetInterferenceNeighborIndexes ();
+  /// The same for transmission at a given TX power level (one hop neighbors are those hearing this level),
+  /// stations heard at full power are always included
+  std::vector<uint32_t> GetInterferenceNeighborIndexes (uint32_t powerLevel);
+  ///\}
+  ///\name Channel this PHY is attached to and PHY ordinal in it (set by the channel)
+  ///\{
+  Ptr<NeighborAwareSpectrumChannel> GetNeighborAwareChannel () const;
+  void SetChannelIndex (uint32_t index);
+  uint32_t GetChannelIndex () const;
   ///\}
   /// Receiver frequency response characteristic (to take into account inter-channel interference)
   void SetRxFilter (Ptr<const SpectrumValue> rxFilter);
   /// Needed by neighbor PHYs to determine wheter my transmission causes interference or not to this device
   Ptr<const SpectrumValue> GetRxFilter () const;
+  /// Full power TX-PSD, needed by the channel to find filter classes coupled with mine
+  Ptr<const SpectrumValue> GetTxPowerSpectralDensity () const;
+  ///\name Per-link rate adaptation: Rate attribute is a base rate for all links, group traffic and unknown neighbors
+  ///\{
+  /// Use \param rate for links whose average RX power exceeds neighbor detection threshold by \param marginDb
+  void AddRate (DataRate rate, double marginDb);
+  /// Rebuild rate and TX power tables from communication neighbors, does nothing if both are disabled.
+  /// Tables are kept until the next call, GetCommunicationNeighbors does not touch them
+  void UpdateLinkTables ();
+  /// \return rate to a given neighbor device address
+  DataRate GetRate (const Address & destination) const;
+  using HalfDuplexIdealPhy::GetRate;
+  /// Start transmission with a given rate and TX power level
+  bool StartTx (Ptr<Packet> packet, DataRate rate, uint32_t powerLevel = 0);
+  using HalfDuplexIdealPhy::StartTx;
+  ///\}
+  ///\name Per-link TX power control: level N is TX-PSD attenuated by N * TxPowerStepDb, level 0 is full power.
+  /// Margin of a link left after its rate is spent on attenuation, keeping TxPowerMarginDb. Group traffic
+  /// and unknown neighbors use full power
+  ///\{
+  uint32_t GetNTxPowerLevels () const;
+  /// \return TX power level for a given neighbor device address
+  uint32_t GetTxPowerLevel (const Address & destination) const;
+  ///\}
+  ///\name Physical interference model for spatial reuse (deterministic loss only)
+  ///\{
+  /// \return average power received from \param sender transmitting at \param powerLevel after RX filter
+  double GetAverageRxPowerMw (Ptr<Phy> sender, uint32_t powerLevel = 0);
+  /// \return true if a signal is received successfully with a given interference
+  bool IsSinrSufficient (double signalMw, double interferenceMw) const;
+  /// \return true if a signal is above energy detection threshold, so receiver locks to it
+  bool IsDetected (double powerMw) const;
+  ///\}
+  ///\name Needed by the channel to calculate adjacency of all PHYs at once
+  ///\{
+  /// \return power of a signal received by this PHY after RX filter
+  double GetFilteredPowerMw (Ptr<const SpectrumValue> received) const;
+  /// Communication neighbors receive my transmission above this threshold
+  double GetNeighborDetectionThresholdDbm () const;
+  /// Sensitivity neighbors receive my transmission above this threshold
+  double GetSensitivityThresholdDbm () const;
+  ///\}
 private:
   void DoInitialize ();
   /// Real destructor
@@ -71,11 +125,24 @@ private:
   Ptr<SpectrumValue> ApplyRxFilter (Ptr<const SpectrumValue> received) const;
   /// Initiate neighbor detection threshold: packet size and it's one try success probability are intputs
   void InitiateNeighborDetectionthresholdDbm ();
+  ///\name Attribute accessors, adjacency of the channel depends on thresholds
+  ///\{
+  void SetEnergyDetectionThreshold (double thresholdDbm);
+  double GetEnergyDetectionThreshold () const;
+  void SetLinkQualityAddition (double additionDb);
+  double GetLinkQualityAddition () const;
+  ///\}
+  /// Communication neighbors with average power of my transmission received by each of them
+  std::vector<std::pair<Ptr<NetDevice>, double> > GetCommunicationLinks ();
+  /// Add a communication neighbor to rate and TX power tables
+  void AddLink (const Address & address, double rxPowerMw);
   ///\name Neighbor detection methods:
   ///\{
   /// Get neighbors by a threshold from a channel. \return device and rx-power pairs.
-  NeighborAwareSpectrumChannel::NeighborList GetAllNeigbors ();
-  /// Check that neighbor operates at the same frequency with the same spectrum model UID
+  NeighborAwareSpectrumChannel::NeighborList GetAllNeigbors (uint32_t powerLevel = 0);
+  /// TX-PSD of a given TX power level
+  Ptr<SpectrumValue> GetTxPsd (uint32_t powerLevel) const;
+  /// Check that neighbor operates at the same frequency with the same spectrum model UID (same filter class)
   bool NeighborRxFilterEquals (Ptr<const Phy> nbrPhy) const;
   /**
    * \brief Check that neighbor PHY may interfere with us. Checks inter-channel interference too.
@@ -93,9 +160,13 @@ private:
   double MwToDbm (double mW) const;
   ///\}
   /// Sensitivity neighbors: average rx-power more that a sensitivity threshold. One and Two-hop sensitivity neighbors are supposed to form interference neighbors.
-  std::set<Ptr<Phy> > GetSensitivityNeighbors ();
+  std::set<Ptr<Phy> > GetSensitivityNeighbors (uint32_t powerLevel = 0);
+  /// PHYs of interference neighbors
+  std::set<Ptr<Phy> > GetInterferencePhys (uint32_t powerLevel = 0);
 private:
   Ptr<NeighborAwareSpectrumChannel> m_channel;
+  /// PHY ordinal in the channel
+  uint32_t m_channelIndex;
   ///\name Parameters needed to estimate communication neighbors:
   ///\{
   Ptr<SpectrumValue> m_txPsd;
@@ -117,6 +188,21 @@ private:
   /// Packet length to be tested with error model:
   uint16_t m_communicationTestPacketLength;
   ///\}
+  ///\name Per-link rates
+  ///\{
+  /// Required margin in dB for each rate
+  std::map<double, DataRate> m_rateLadder;
+  /// Rates of communication neighbors by device address
+  std::map<Address, DataRate> m_rateTable;
+  ///\}
+  ///\name Per-link TX power
+  ///\{
+  uint32_t m_txPowerLevels;
+  double m_txPowerStepDb;
+  double m_txPowerMarginDb;
+  /// TX power levels of communication neighbors by device address
+  std::map<Address, uint32_t> m_txPowerTable;
+  ///\}
 };
 
 } // namespace lrr
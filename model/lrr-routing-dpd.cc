@@ -20,15 +20,40 @@
  */
 
 #include "lrr-routing-dpd.h"
+#include "ns3/hash.h"
 
 namespace ns3
 {
 namespace lrr
 {
 
+void
+DuplicatePacketDetection::SetMode (Mode mode)
+{
+  m_mode = mode;
+  m_seqnoCache.SetSequenceBits (mode == IP_IDENTIFICATION ? 16 : 32);
+}
+
+uint64_t
+DuplicatePacketDetection::GetFlowKey (const Ipv4Header & header)
+{
+  // Fragments of a datagram share identification, so offset is a part of the key
+  uint8_t buf[11];
+  header.GetSource ().Serialize (buf);
+  header.GetDestination ().Serialize (buf + 4);
+  buf[8] = header.GetProtocol ();
+  buf[9] = header.GetFragmentOffset () >> 8;
+  buf[10] = header.GetFragmentOffset () & 0xff;
+  return Hash64 ((const char *) buf, sizeof (buf));
+}
+
 bool
 DuplicatePacketDetection::IsDuplicate  (Ptr<const Packet> p, const Ipv4Header & header)
 {
+  if (m_mode == IP_IDENTIFICATION)
+    {
+      return m_seqnoCache.IsDuplicate (GetFlowKey (header), header.GetIdentification ());
+    }
   SeqTag tag;
   if (p->PeekPacketTag (tag))
     {
@@ -52,14 +77,17 @@ DuplicatePacketDetection::GetLifetime () const
 void
 DuplicatePacketDetection::PrepareTx (Ptr<Packet> p)
 {
-  static uint32_t lastSequence = 0;
+  if (m_mode == IP_IDENTIFICATION)
+    {
+      return;
+    }
   SeqTag tag;
   if (p->PeekPacketTag (tag))
     {
       return;
     }
-  lastSequence++;
-  p->AddPacketTag (SeqTag (lastSequence));
+  m_lastSequence++;
+  p->AddPacketTag (SeqTag (m_lastSequence));
 }
 
 TypeId
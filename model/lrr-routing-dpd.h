@@ -40,8 +40,25 @@ namespace lrr
 class DuplicatePacketDetection
 {
 public:
+  /// How packets are identified
+  enum Mode
+  {
+    /// Sequence number packet tag added by PrepareTx
+    SEQ_TAG,
+    /**
+     * Source, destination, protocol and fragment offset with IPv4
+     * identification, which IP increments per (source, destination, protocol)
+     * on its own, so PrepareTx does nothing
+     */
+    IP_IDENTIFICATION
+  };
   /// C-tor
-  DuplicatePacketDetection (Time lifetime) : m_seqnoCache (lifetime) {}
+  DuplicatePacketDetection (Time lifetime) : m_mode (SEQ_TAG), m_lastSequence (0), m_seqnoCache (lifetime) {}
+  ///\name Packet identification mode, all remembered packets are forgotten on change
+  ///\{
+  void SetMode (Mode mode);
+  Mode GetMode () const { return m_mode; }
+  ///\}
   /// Check that the packet is duplicated. If not, save information about this packet.
   bool IsDuplicate (Ptr<const Packet> p, const Ipv4Header & header);
   /// Set duplicate records lifetimes
@@ -71,6 +88,11 @@ public:
     void Print (std::ostream &os) const;
     ///\}
   };
+  /// Duplicate key of a packet identified by IP header
+  static uint64_t GetFlowKey (const Ipv4Header & header);
+  Mode m_mode;
+  /// Last sequence number sent by this node
+  uint32_t m_lastSequence;
   /// Impl
   SeqCache m_seqnoCache;
 };
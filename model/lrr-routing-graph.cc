@@ -79,11 +79,18 @@ GlobalGraph::Start (void)
   m_isStarted = true;
   CreateVertices ();
   UpdateEdges ();
+  GlobalGroupManagement::GetInstance ()->ConnectMembershipChange (MakeCallback (&GlobalGraph::MembershipChanged, this));
+  GlobalGroupManagement::GetInstance ()->ConnectGroupRemoved (MakeCallback (&GlobalGraph::GroupRemoved, this));
 }
 
 void
 GlobalGraph::Stop (void)
 {
+  if (m_isStarted)
+    {
+      GlobalGroupManagement::GetInstance ()->DisconnectMembershipChange (MakeCallback (&GlobalGraph::MembershipChanged, this));
+      GlobalGroupManagement::GetInstance ()->DisconnectGroupRemoved (MakeCallback (&GlobalGraph::GroupRemoved, this));
+    }
   m_graph->Clear ();
   m_peering->Clear ();
   m_updateEvent.Cancel ();
@@ -132,6 +139,32 @@ GlobalGraph::CreateEdges (void)
     }
 }
 
+void
+GlobalGraph::MembershipChanged (Ipv4Address mcastGroup, Ipv4Address member, bool joined)
+{
+  if (m_mcastTable == 0)
+    {
+      return;
+    }
+  if (joined)
+    {
+      m_mcastTable->Graft (mcastGroup, member);
+    }
+  else
+    {
+      m_mcastTable->Prune (mcastGroup, member);
+    }
+}
+
+void
+GlobalGraph::GroupRemoved (Ipv4Address mcastGroup, uint32_t groupIndex)
+{
+  if (m_mcastTable != 0)
+    {
+      m_mcastTable->RemoveGroup (mcastGroup, groupIndex);
+    }
+}
+
 void
 GlobalGraph::PrintGraph (std::ostream & os)
 {
@@ -200,13 +233,13 @@ GlobalGraph::GetNextHopMain (Ipv4Address from, Ipv4Address to)
 bool
 GlobalGraph::HaveMcastPath (Ipv4Address local, Ipv4Address mcastTo)
 {
-  std::set <Ipv4Address>  members = GlobalGroupManagement::GetInstance ()->GetGroupMembers (mcastTo);
   Ipv4Address localMain = m_peering->MainFromIfaceAddress (local);
   /// Not a member->have no path
-  if (members.find (localMain) == members.end ())
+  if (!GlobalGroupManagement::GetInstance ()->IsInMcastGroup (localMain, mcastTo))
     {
       return false;
     }
+  std::set <Ipv4Address> members = GlobalGroupManagement::GetInstance ()->GetGroupMembers (mcastTo);
   /// I am a member of group: check path to at least one other member:
   for (std::set<Ipv4Address>::const_iterator i = members.begin (); i != members.end (); ++i)
     {
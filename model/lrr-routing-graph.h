@@ -136,6 +136,10 @@ private:
   void UpdateEdges ();
   /// Create all existing edges (between all nodes in simulator)
   void CreateEdges ();
+  /// Graft or prune multicast trees when a station joins or leaves a group
+  void MembershipChanged (Ipv4Address mcastGroup, Ipv4Address member, bool joined);
+  /// Clear multicast table entries of a removed group before its index is reused
+  void GroupRemoved (Ipv4Address mcastGroup, uint32_t groupIndex);
   /// isStarted means that topology is constructed and periodical
   //update is started
   bool m_isStarted;
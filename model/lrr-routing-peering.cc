@@ -21,6 +21,10 @@
 #include "ns3/uinteger.h"
 #include "ns3/ipv4.h"
 #include "lrr-routing-peering.h"
+#include "lrr-device-impl.h"
+#include "lrr-mac.h"
+#include "lrr-phy.h"
+#include <set>
 namespace ns3
 {
 namespace lrr
@@ -72,6 +76,25 @@ GlobalPeering::CreateLinks ()
   m_globalLinkSet.clear ();
   Topology oldTopology = m_topology;
   m_topology.clear ();
+  // Communication neighbors of all interfaces come from one adjacency pass of each channel:
+  std::set<Ptr<NeighborAwareSpectrumChannel> > channels;
+  for (std::vector<Ptr<Node> >::const_iterator i = m_registredNodes.begin (); i != m_registredNodes.end (); ++i)
+    {
+      std::vector<Interface> nodeInterfaces = GetRadioInterfaces (*i);
+      for (std::vector<Interface>::const_iterator j = nodeInterfaces.begin (); j != nodeInterfaces.end (); j++)
+        {
+          Ptr<NeighborAwareDeviceImpl> device = j->device->GetObject<NeighborAwareDeviceImpl> ();
+          if (device == 0)
+            {
+              continue;
+            }
+          Ptr<Phy> phy = device->GetMac ()->GetPhy ()->GetObject<Phy> ();
+          if ((phy != 0) && channels.insert (phy->GetNeighborAwareChannel ()).second)
+            {
+              phy->GetNeighborAwareChannel ()->GetAdjacency ();
+            }
+        }
+    }
   for (std::vector<Ptr<Node> >::const_iterator i = m_registredNodes.begin (); i != m_registredNodes.end (); ++i)
     {
       CreateOutgoingLinks (*i);
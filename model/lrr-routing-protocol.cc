@@ -22,6 +22,7 @@
 #include "lrr-mcast-group-mgt.h"
 #include "ns3/log.h"
 #include "ns3/boolean.h"
+#include "ns3/enum.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/trace-source-accessor.h"
 #include "ns3/udp-socket-factory.h"
@@ -46,6 +47,13 @@ RoutingProtocol::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::lrr::RoutingProtocol")
     .SetParent<Ipv4RoutingProtocol> ()
     .AddConstructor<RoutingProtocol> ()
+    .AddAttribute ("DuplicateDetection",
+                   "How multicast duplicates are detected: by sequence number tag or by IPv4 identification",
+                   EnumValue (DuplicatePacketDetection::SEQ_TAG),
+                   MakeEnumAccessor (&RoutingProtocol::SetDuplicateDetection,
+                                     &RoutingProtocol::GetDuplicateDetection),
+                   MakeEnumChecker (DuplicatePacketDetection::SEQ_TAG, "SeqTag",
+                                    DuplicatePacketDetection::IP_IDENTIFICATION, "IpIdentification"))
   ;
   return tid;
 }
@@ -61,6 +69,18 @@ RoutingProtocol::DoDispose ()
   m_ipv4 = 0;
 }
 
+void
+RoutingProtocol::SetDuplicateDetection (DuplicatePacketDetection::Mode mode)
+{
+  m_dpd.SetMode (mode);
+}
+
+DuplicatePacketDetection::Mode
+RoutingProtocol::GetDuplicateDetection () const
+{
+  return m_dpd.GetMode ();
+}
+
 void
 RoutingProtocol::Start ()
 {
@@ -143,32 +163,29 @@ RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
           NS_LOG_DEBUG ("ROUTING: Duplicated packet " << p->GetUid () << " from " << origin << ". Drop.");
           return true;
         }
-      Ptr<Packet> packet = p->Copy ();
       if (GlobalGroupManagement::GetInstance ()->IsInMcastGroup (m_local, dst))
         {
           NS_LOG_LOGIC ("Multicast local delivery to " << m_local);
           lcb (p, header, iif);
         }
-      if (header.GetTtl () > 1)
+      // Tree root is never a retranslator
+      if ((header.GetTtl () > 1) && !GlobalGraph::Instance ()->IsLocalAddress (origin, m_local))
         {
-          if (GlobalGraph::Instance ()->IsMcastRetranslator (m_local, origin, dst))
+          // Outgoing interfaces, empty if not a retranslator (the most of group members are leafs):
+          std::set<Ipv4Address> interfaces = GlobalGraph::Instance ()->GetMulticastRoute (origin, dst, m_local);
+          for (std::set<Ipv4Address>::const_iterator i = interfaces.begin (); i != interfaces.end (); i++)
             {
-              // Find outgoing interfaces:
-              std::set<Ipv4Address> interfaces = GlobalGraph::Instance ()->GetMulticastRoute (origin, header.GetDestination (), m_local);
-              for (std::set<Ipv4Address>::iterator i =  interfaces.begin (); i != interfaces.end (); i++)
-                {
-                  Ipv4Address dst = header.GetDestination ();
-                  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
-                  route->SetDestination (dst);
-                  route->SetGateway (m_bcast);
-                  route->SetSource (origin);
-                  route->SetOutputDevice (m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (*i)));
-                  NS_LOG_DEBUG ("ROUTING: Forward multicast packet " << p->GetUid () << " from " << origin << ", destination " << dst << ", outgoing interface is " << *i);
-                  ucb (route, packet->Copy (), header);
-                }
+              Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+              route->SetDestination (dst);
+              route->SetGateway (m_bcast);
+              route->SetSource (origin);
+              route->SetOutputDevice (m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (*i)));
+              NS_LOG_DEBUG ("ROUTING: Forward multicast packet " << p->GetUid () << " from " << origin << ", destination " << dst << ", outgoing interface is " << *i);
+              // IP makes its own writable copy for every forwarded packet, so one read-only packet is shared
+              ucb (route, p, header);
             }
         }
-      else
+      else if (header.GetTtl () <= 1)
         {
           NS_LOG_DEBUG ("ROUTING: TTL exceeded. Drop packet " << p->GetUid ());
         }
@@ -60,6 +60,11 @@ public:
   virtual void SetIpv4 (Ptr<Ipv4> ipv4);
   virtual void PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::Unit unit) const;
   ///\}
+  ///\name Duplicate detection mode, see DuplicatePacketDetection::Mode
+  ///\{
+  void SetDuplicateDetection (DuplicatePacketDetection::Mode mode);
+  DuplicatePacketDetection::Mode GetDuplicateDetection () const;
+  ///\}
 private:
   ///\name Handle output and input packets:
   ///\{
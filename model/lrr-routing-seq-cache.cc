@@ -24,22 +24,185 @@ namespace ns3
 {
 namespace lrr
 {
+const uint32_t SeqCache::WHEEL_SIZE;
+
+SeqCache::SeqCache (Time lifetime, uint32_t windowSize) :
+  m_windowSize (windowSize),
+  m_seqMask (0xffffffff),
+  m_wheel (WHEEL_SIZE),
+  m_lastTick (0),
+  m_lifetime (lifetime)
+{
+  NS_ASSERT ((windowSize >= 64) && ((windowSize & (windowSize - 1)) == 0));
+  NS_ASSERT (lifetime.IsStrictlyPositive ());
+  m_lastTick = GetTick (Simulator::Now ());
+}
+
+void
+SeqCache::SetLifetime (Time lifetime)
+{
+  NS_ASSERT (lifetime.IsStrictlyPositive ());
+  m_lifetime = lifetime;
+  // Tick length has changed: re-bucket all origins
+  m_wheel = std::vector<std::vector<uint64_t> > (WHEEL_SIZE);
+  m_lastTick = GetTick (Simulator::Now ());
+  for (WindowMap::iterator i = m_windows.begin (); i != m_windows.end (); ++i)
+    {
+      i->second.m_expire = GetExpireTick ();
+      Schedule (i->first, i->second.m_expire);
+    }
+}
+
+void
+SeqCache::SetSequenceBits (uint8_t bits)
+{
+  NS_ASSERT ((bits > 0) && (bits <= 32) && (m_windowSize <= ((uint64_t) 1 << (bits - 1))));
+  m_seqMask = (bits == 32) ? 0xffffffff : (((uint32_t) 1 << bits) - 1);
+  m_windows.clear ();
+  m_wheel = std::vector<std::vector<uint64_t> > (WHEEL_SIZE);
+}
+
 bool
 SeqCache::IsDuplicate (Ipv4Address addr, uint32_t id)
 {
-  std::map<Ipv4Address, UniqueId>::iterator i = m_seqnoCache.find (addr);
-  if (i == m_seqnoCache.end ())
+  return IsDuplicate ((uint64_t) addr.Get (), id);
+}
+
+bool
+SeqCache::IsDuplicate (uint64_t origin, uint32_t id)
+{
+  Advance ();
+  int64_t expire = GetExpireTick ();
+  WindowMap::iterator i = m_windows.find (origin);
+  if (i == m_windows.end ())
     {
-      m_seqnoCache.insert (std::make_pair (addr, UniqueId (id, m_lifetime + Simulator::Now ())));
+      Window & w = m_windows[origin];
+      w.m_highest = id & m_seqMask;
+      w.m_expire = expire;
+      w.m_bitmap.assign (m_windowSize / 64, 0);
+      SetBit (w, id);
+      Schedule (origin, expire);
       return false;
     }
-  if ((!i->second.IsExpired ()) && (i->second.m_id == id))
+  Window & w = i->second;
+  // Wheel bucket is not changed here, origin is moved when its old bucket expires
+  w.m_expire = expire;
+  id &= m_seqMask;
+  uint32_t ahead = (id - w.m_highest) & m_seqMask;
+  if ((ahead != 0) && (ahead <= (m_seqMask >> 1)))
     {
-      i->second = UniqueId (id, m_lifetime + Simulator::Now ());
+      // Slide the window forward
+      ClearBits (w, w.m_highest, ahead);
+      w.m_highest = id;
+      SetBit (w, id);
+      return false;
+    }
+  if (((w.m_highest - id) & m_seqMask) >= m_windowSize)
+    {
+      // Behind the window
       return true;
     }
-  i->second = UniqueId (id, m_lifetime + Simulator::Now ());
+  if (TestBit (w, id))
+    {
+      return true;
+    }
+  SetBit (w, id);
   return false;
 }
+
+bool
+SeqCache::TestBit (const Window & w, uint32_t id) const
+{
+  uint32_t bit = id & (m_windowSize - 1);
+  return (w.m_bitmap[bit >> 6] >> (bit & 63)) & 1;
+}
+
+void
+SeqCache::SetBit (Window & w, uint32_t id)
+{
+  uint32_t bit = id & (m_windowSize - 1);
+  w.m_bitmap[bit >> 6] |= ((uint64_t) 1 << (bit & 63));
+}
+
+void
+SeqCache::ClearBits (Window & w, uint32_t from, uint32_t count)
+{
+  if (count >= m_windowSize)
+    {
+      std::fill (w.m_bitmap.begin (), w.m_bitmap.end (), 0);
+      return;
+    }
+  // Window size divides 2^bits, so bit index does not depend on id wrap around
+  uint32_t id = from + 1;
+  while (count > 0)
+    {
+      uint32_t bit = id & (m_windowSize - 1);
+      if (((bit & 63) == 0) && (count >= 64))
+        {
+          // Whole word
+          w.m_bitmap[bit >> 6] = 0;
+          id += 64;
+          count -= 64;
+          continue;
+        }
+      w.m_bitmap[bit >> 6] &= ~((uint64_t) 1 << (bit & 63));
+      id++;
+      count--;
+    }
+}
+
+int64_t
+SeqCache::GetTick (Time t) const
+{
+  // Wheel turn is a lifetime
+  return t.GetTimeStep () / std::max<int64_t> (m_lifetime.GetTimeStep () / WHEEL_SIZE, 1);
+}
+
+int64_t
+SeqCache::GetExpireTick () const
+{
+  // Origin lives for at least a lifetime (whole number of ticks is rounded up)
+  return m_lastTick + WHEEL_SIZE + 1;
+}
+
+void
+SeqCache::Schedule (uint64_t origin, int64_t expire)
+{
+  m_wheel[expire % WHEEL_SIZE].push_back (origin);
+}
+
+void
+SeqCache::Advance ()
+{
+  int64_t now = GetTick (Simulator::Now ());
+  if (now <= m_lastTick)
+    {
+      return;
+    }
+  // Buckets of ticks (m_lastTick, now], each bucket is visited at most once
+  int64_t first = std::max (m_lastTick + 1, now - (int64_t) WHEEL_SIZE + 1);
+  m_lastTick = now;
+  for (int64_t tick = first; tick <= now; tick++)
+    {
+      std::vector<uint64_t> bucket;
+      bucket.swap (m_wheel[tick % WHEEL_SIZE]);
+      for (std::vector<uint64_t>::const_iterator i = bucket.begin (); i != bucket.end (); ++i)
+        {
+          WindowMap::iterator w = m_windows.find (*i);
+          if (w == m_windows.end ())
+            {
+              continue;
+            }
+          if (w->second.m_expire <= now)
+            {
+              m_windows.erase (w);
+            }
+          else
+            {
+              Schedule (*i, w->second.m_expire);
+            }
+        }
+    }
+}
 }
 }
@@ -23,7 +23,8 @@
 
 #include "ns3/ipv4-address.h"
 #include "ns3/simulator.h"
-#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3
 {
@@ -31,41 +32,81 @@ namespace lrr
 {
 /**
  * \ingroup lrr
- * 
- * \brief Unique packets identification cache used for simple duplicate detection.
+ *
+ * \brief Duplicate detection cache
+ *
+ * Each origin has a sliding window of the last seen ids (like IPsec
+ * anti-replay window): ids inside the window are checked exactly, ids behind
+ * the window are treated as duplicates. Origins, which have been silent for
+ * the lifetime, are purged by a timer wheel, which is advanced on each check.
  */
 class SeqCache
 {
 public:
-  /// c-tor
-  SeqCache (Time lifetime) : m_lifetime (lifetime) {}
+  /**
+   * c-tor
+   * \param lifetime is how long an origin is remembered after its last packet
+   * \param windowSize is a number of ids tracked per origin, must be a power of two
+   */
+  SeqCache (Time lifetime, uint32_t windowSize = 1024);
   /// Check that entry (addr, id) exists in cache. Add entry, if it doesn't exist.
   bool IsDuplicate (Ipv4Address addr, uint32_t id);
+  /// The same for any 64-bit origin key
+  bool IsDuplicate (uint64_t origin, uint32_t id);
+  /**
+   * Set width of ids, which wrap around at 2^bits (32 by default).
+   * All remembered origins are forgotten
+   */
+  void SetSequenceBits (uint8_t bits);
   /// Set lifetime for future added entries.
-  void SetLifetime (Time lifetime) { m_lifetime = lifetime; }
+  void SetLifetime (Time lifetime);
   /// Return lifetime for existing entries in cache
   Time GetLifeTime () const { return m_lifetime; }
+  /// Number of origins currently remembered
+  uint32_t GetNOrigins () const { return m_windows.size (); }
 private:
-  /// Unique packet ID
-  struct UniqueId
+  /// Already seen ids of one origin
+  struct Window
   {
-    /// The id
-    uint32_t m_id;
-    /// When record will expire
-    Time m_expire;
-    UniqueId (uint32_t id, Time t) :
-      m_id (id),
-      m_expire (t)
-    {};
-    bool
-    IsExpired ()
-    {
-      return (m_expire < Simulator::Now ());
-    };
+    /// The highest id seen
+    uint32_t m_highest;
+    /// Wheel tick, when origin will expire
+    int64_t m_expire;
+    /// Bit per id, indexed by id modulo window size
+    std::vector<uint64_t> m_bitmap;
   };
-
-  /// Already seen IDs
-  std::map<Ipv4Address, UniqueId> m_seqnoCache;
+  typedef std::unordered_map<uint64_t, Window> WindowMap;
+  ///\name Window bitmap
+  ///\{
+  bool TestBit (const Window & w, uint32_t id) const;
+  void SetBit (Window & w, uint32_t id);
+  /// Clear bits of count ids following the given one
+  void ClearBits (Window & w, uint32_t from, uint32_t count);
+  ///\}
+  ///\name Timer wheel
+  ///\{
+  int64_t GetTick (Time t) const;
+  /// Expiration tick of an origin refreshed at the last processed tick
+  int64_t GetExpireTick () const;
+  /// Put origin into the wheel bucket of its expiration tick
+  void Schedule (uint64_t origin, int64_t expire);
+  /// Purge origins expired till now
+  void Advance ();
+  ///\}
+private:
+  /// Number of wheel buckets
+  static const uint32_t WHEEL_SIZE = 16;
+  /// Windows of all origins
+  WindowMap m_windows;
+  /// Number of ids in the window
+  uint32_t m_windowSize;
+  /// Id mask: ids are compared modulo 2^bits
+  uint32_t m_seqMask;
+  /// Origins by expiration tick modulo wheel size. An origin may be refreshed
+  /// after it was put into a bucket, in this case it is moved when bucket expires
+  std::vector<std::vector<uint64_t> > m_wheel;
+  /// Last processed tick
+  int64_t m_lastTick;
   /// Default lifetime for ID records
   Time m_lifetime;
 };
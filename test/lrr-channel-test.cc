@@ -0,0 +1,596 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/node-container.h"
+#include "ns3/constant-velocity-mobility-model.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/wifi-spectrum-value-helper.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/propagation-loss-model.h"
+
+#include "ns3/lrr-channel-helper.h"
+#include "ns3/lrr-channel-assignment-helper.h"
+#include "ns3/lrr-device-helper.h"
+#include "ns3/lrr-device-impl.h"
+#include "ns3/lrr-mac.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <map>
+#include <cmath>
+#include <sstream>
+
+using namespace ns3;
+
+/**
+ * Stations in a line with growing spacing, so they have different numbers of neighbors. Constant velocity
+ * positions are not static, so PHYs scan the channel until adjacency is taken at this timestamp.
+ * Checks that adjacency calculated by several threads in one symmetric batch pass with default channel
+ * attributes gives the same neighbors as the scans
+ */
+class LrrChannelAdjacencyTestCase : public ns3::TestCase
+{
+public:
+  LrrChannelAdjacencyTestCase () : ns3::TestCase ("Channel adjacency test") {}
+  void DoRun ();
+};
+
+void
+LrrChannelAdjacencyTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (11);
+  double x = 0;
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantVelocityMobilityModel> mobility = CreateObject<ConstantVelocityMobilityModel> ();
+      mobility->SetPosition (Vector (x, 10 * (i % 2), 0));
+      nodes.Get (i)->AggregateObject (mobility);
+      x += 100 * (i + 1);
+    }
+  Ptr<lrr::NeighborAwareSpectrumChannel> channel = LrrChannelHelper::Default ().Create ();
+  channel->SetAttribute ("AdjacencyThreads", UintegerValue (3));
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (channel);
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+
+  std::vector<Ptr<lrr::Phy> > phys;
+  std::vector<std::vector<Ptr<NetDevice> > > communication;
+  std::vector<std::vector<uint32_t> > interference;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      phys.push_back (devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ());
+      communication.push_back (phys[i]->GetCommunicationNeighbors ());
+      interference.push_back (phys[i]->GetInterferenceNeighborIndexes ());
+    }
+  NS_TEST_ASSERT_MSG_EQ (channel->IsAdjacencyPreferred (), false, "PHYs have scanned the channel");
+  uint64_t batchGains = channel->GetNBatchGains ();
+  const lrr::NeighborAwareSpectrumChannel::Adjacency & adjacency = channel->GetAdjacency ();
+  NS_TEST_ASSERT_MSG_EQ (channel->IsAdjacencyPreferred (), true, "Adjacency is kept at this timestamp");
+  uint64_t pairs = phys.size () * (phys.size () - 1) / 2;
+  NS_TEST_EXPECT_MSG_EQ ((channel->GetNBatchGains () - batchGains >= pairs), true, "Each pair is calculated in batch once with default attributes");
+  NS_TEST_EXPECT_MSG_LT (channel->GetNBatchGains () - batchGains, 2 * pairs, "Pairs are not calculated twice");
+  uint32_t links = 0;
+  for (uint32_t i = 0; i < phys.size (); ++i)
+    {
+      const std::vector<uint32_t> & neighbors = adjacency.communication[phys[i]->GetChannelIndex ()];
+      std::vector<Ptr<NetDevice> > devs;
+      for (std::vector<uint32_t>::const_iterator j = neighbors.begin (); j != neighbors.end (); ++j)
+        {
+          devs.push_back (channel->GetDevice (*j));
+        }
+      std::sort (devs.begin (), devs.end ());
+      std::sort (communication[i].begin (), communication[i].end ());
+      NS_TEST_EXPECT_MSG_EQ ((devs == communication[i]), true, "Communication neighbors of station " << i);
+      // Now interference neighbors are built of adjacency:
+      NS_TEST_EXPECT_MSG_EQ ((phys[i]->GetInterferenceNeighborIndexes () == interference[i]), true, "Interference neighbors of station " << i);
+      links += neighbors.size ();
+    }
+  NS_TEST_EXPECT_MSG_GT (links, 0, "Some stations are neighbors");
+  NS_TEST_EXPECT_MSG_LT (links, phys.size () * (phys.size () - 1), "Not all stations are neighbors");
+  Simulator::Destroy ();
+}
+
+/**
+ * A sends to a close B at a reduced TX power level, C is on the other side of A: C hears A at full
+ * power but not at the reduced level, and does not hear B. ED threshold is put between powers of C at A
+ * and C at B. Checks that C is an interference neighbor of A at the reduced level, since its
+ * transmission to A collides with the reception of ACK from B
+ */
+class LrrPhyPowerLevelInterferenceTestCase : public ns3::TestCase
+{
+public:
+  LrrPhyPowerLevelInterferenceTestCase () : ns3::TestCase ("Interference neighbors at reduced TX power test") {}
+  void DoRun ();
+};
+
+void
+LrrPhyPowerLevelInterferenceTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+  double x[] = {0 /*A*/, 10 /*B*/, -100 /*C*/};
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (x[i], 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (LrrChannelHelper::Default ().Create ());
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  std::vector<Ptr<lrr::Phy> > phys;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      phys.push_back (devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ());
+    }
+  Ptr<lrr::Phy> a = phys[0];
+  Ptr<lrr::Phy> b = phys[1];
+  Ptr<lrr::Phy> c = phys[2];
+  double thresholdDbm = 5 * (std::log10 (a->GetAverageRxPowerMw (c)) + std::log10 (b->GetAverageRxPowerMw (c)));
+  for (uint32_t i = 0; i < phys.size (); ++i)
+    {
+      phys[i]->SetAttribute ("EnergyDetectionThreshold", DoubleValue (thresholdDbm));
+      phys[i]->SetAttribute ("TxPowerLevels", UintegerValue (2));
+      phys[i]->SetAttribute ("TxPowerStepDb", DoubleValue (10));
+    }
+  // B is 10 m away and C is 100 m away, so the reduced level still reaches B only:
+  NS_TEST_ASSERT_MSG_GT (10 * std::log10 (b->GetAverageRxPowerMw (a, 1)), thresholdDbm, "B hears A at the reduced level");
+  NS_TEST_ASSERT_MSG_LT (10 * std::log10 (c->GetAverageRxPowerMw (a, 1)), thresholdDbm, "C does not hear A at the reduced level");
+
+  std::vector<uint32_t> fullPower = a->GetInterferenceNeighborIndexes (0);
+  std::vector<uint32_t> reduced = a->GetInterferenceNeighborIndexes (1);
+  NS_TEST_EXPECT_MSG_EQ ((std::find (fullPower.begin (), fullPower.end (), c->GetChannelIndex ()) != fullPower.end ()), true,
+                         "C interferes at full power");
+  NS_TEST_EXPECT_MSG_EQ ((std::find (reduced.begin (), reduced.end (), b->GetChannelIndex ()) != reduced.end ()), true,
+                         "B interferes at the reduced level");
+  NS_TEST_EXPECT_MSG_EQ ((std::find (reduced.begin (), reduced.end (), c->GetChannelIndex ()) != reduced.end ()), true,
+                         "C reaching A at full power interferes at the reduced level");
+  std::vector<uint32_t> ofB = b->GetInterferenceNeighborIndexes (0);
+  NS_TEST_EXPECT_MSG_EQ ((std::find (ofB.begin (), ofB.end (), c->GetChannelIndex ()) != ofB.end ()), true,
+                         "C is a two-hop neighbor of B through A");
+  Simulator::Destroy ();
+}
+
+/**
+ * A with a rate ladder set by the device helper, B is 10 m away and C is 100 m away from A.
+ * Checks that rate tables are not touched by GetCommunicationNeighbors and that UpdateLinkTables gives
+ * each link the highest rate whose margin over neighbor detection threshold it has
+ */
+class LrrPhyRateAdaptationTestCase : public ns3::TestCase
+{
+public:
+  LrrPhyRateAdaptationTestCase () : ns3::TestCase ("Per-link rate adaptation test") {}
+  void DoRun ();
+};
+
+void
+LrrPhyRateAdaptationTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+  double x[] = {0 /*A*/, 10 /*B*/, 100 /*C*/};
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (x[i], 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (LrrChannelHelper::Default ().Create ());
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  double margins[] = {20, 50};
+  DataRate rates[] = {DataRate ("2Mbps"), DataRate ("6Mbps")};
+  deviceHelper.AddRate (rates[0], margins[0]);
+  deviceHelper.AddRate (rates[1], margins[1]);
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  std::vector<Ptr<lrr::Phy> > phys;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      phys.push_back (devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ());
+    }
+  Ptr<lrr::Phy> a = phys[0];
+  DataRate baseRate = a->GetRate ();
+  NS_TEST_ASSERT_MSG_EQ (a->GetCommunicationNeighbors ().size (), 2, "B and C are communication neighbors of A");
+  for (uint32_t i = 1; i < devices.GetN (); ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ (a->GetRate (devices.Get (i)->GetAddress ()), baseRate, "Base rate before update, station " << i);
+    }
+  a->UpdateLinkTables ();
+  for (uint32_t i = 1; i < devices.GetN (); ++i)
+    {
+      double marginDb = 10 * std::log10 (phys[i]->GetAverageRxPowerMw (a)) - a->GetNeighborDetectionThresholdDbm ();
+      DataRate expected = baseRate;
+      for (uint32_t j = 0; j < 2; j++)
+        {
+          if (marginDb >= margins[j])
+            {
+              expected = rates[j];
+            }
+        }
+      NS_TEST_EXPECT_MSG_EQ (a->GetRate (devices.Get (i)->GetAddress ()), expected, "Rate of station " << i << " with margin " << marginDb << " dB");
+    }
+  NS_TEST_EXPECT_MSG_EQ ((a->GetRate (devices.Get (1)->GetAddress ()) >= a->GetRate (devices.Get (2)->GetAddress ())), true,
+                         "Close station does not get a lower rate");
+  NS_TEST_EXPECT_MSG_EQ (a->GetRate (Mac48Address::GetBroadcast ()), baseRate, "Base rate for group traffic");
+  Simulator::Destroy ();
+}
+
+/**
+ * Three nodes in a line, A - B - C, each with two radios. Both links share B, so they conflict.
+ * Checks that with two channels the links get different channels without conflicts, both nodes
+ * of a link have a radio tuned to the link channel and radios tuned to different channels are not
+ * communication neighbors. With a single channel the links conflict
+ */
+class LrrChannelAssignmentTestCase : public ns3::TestCase
+{
+public:
+  LrrChannelAssignmentTestCase () : ns3::TestCase ("Channel assignment test") {}
+  void DoRun ();
+};
+
+void
+LrrChannelAssignmentTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (10 * i, 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (LrrChannelHelper::Default ().Create ());
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (1));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  devices.Add (deviceHelper.Install (nodes));
+
+  LrrChannelAssignmentHelper assignment;
+  uint32_t channelNumbers[] = {1, 13};
+  for (uint32_t c = 0; c < 2; c++)
+    {
+      assignment.AddChannel (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, channelNumbers[c]), sf.CreateRfFilter (channelNumbers[c]));
+    }
+  NS_TEST_EXPECT_MSG_EQ (assignment.Assign (nodes), 0, "All links get a channel");
+  NS_TEST_EXPECT_MSG_EQ (assignment.GetConflicts (), 0, "Links sharing B get different channels");
+  // Channels of each node:
+  std::map<Ptr<Node>, std::set<uint32_t> > channels;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      channels[devices.Get (i)->GetNode ()].insert (assignment.GetChannel (devices.Get (i)));
+    }
+  for (uint32_t n = 0; n + 1 < nodes.GetN (); ++n)
+    {
+      const std::set<uint32_t> & a = channels[nodes.Get (n)];
+      const std::set<uint32_t> & b = channels[nodes.Get (n + 1)];
+      std::vector<uint32_t> common;
+      std::set_intersection (a.begin (), a.end (), b.begin (), b.end (), std::back_inserter (common));
+      NS_TEST_EXPECT_MSG_EQ (common.empty (), false, "Nodes of link " << n << " share a channel");
+    }
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      Ptr<lrr::Phy> phy = devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+      std::vector<Ptr<NetDevice> > neighbors = phy->GetCommunicationNeighbors ();
+      for (std::vector<Ptr<NetDevice> >::const_iterator j = neighbors.begin (); j != neighbors.end (); ++j)
+        {
+          NS_TEST_EXPECT_MSG_EQ (assignment.GetChannel (*j), assignment.GetChannel (devices.Get (i)),
+                                 "Communication neighbors of radio " << i << " are tuned to its channel");
+        }
+    }
+
+  LrrChannelAssignmentHelper single;
+  single.AddChannel (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/), sf.CreateRfFilter (1));
+  NS_TEST_EXPECT_MSG_EQ (single.Assign (nodes), 0, "All links get the only channel");
+  NS_TEST_EXPECT_MSG_EQ (single.GetConflicts (), 1, "Links sharing B conflict on the only channel");
+  Simulator::Destroy ();
+}
+
+/// Lossless model remembering receivers it was applied to
+class LrrReceiverTrackingLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId ()
+  {
+    static TypeId tid = TypeId ("ns3::LrrReceiverTrackingLossModel")
+      .SetParent<PropagationLossModel> ()
+    ;
+    return tid;
+  }
+  void Reset ()
+  {
+    receivers.clear ();
+  }
+  std::set<Ptr<MobilityModel> > receivers;
+private:
+  double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+  {
+    const_cast<LrrReceiverTrackingLossModel *> (this)->receivers.insert (b);
+    return txPowerDbm;
+  }
+  int64_t DoAssignStreams (int64_t stream)
+  {
+    return 0;
+  }
+};
+
+/**
+ * A sends a broadcast frame, B is tuned to the same channel, C to a disjoint channel and D to an overlapping one.
+ * Checks filter classes and their coupling, and that the frame propagates to B and D only (stochastic
+ * loss is applied to each propagation), while C is skipped
+ */
+class LrrChannelFilterClassTestCase : public ns3::TestCase
+{
+public:
+  LrrChannelFilterClassTestCase () : ns3::TestCase ("Channel filter class test") {}
+  void DoRun ();
+private:
+  void RxStart (std::string context, Ptr<const Packet> packet);
+  std::map<std::string, uint32_t> m_rxStarts;
+};
+
+void
+LrrChannelFilterClassTestCase::RxStart (std::string context, Ptr<const Packet> packet)
+{
+  m_rxStarts[context]++;
+}
+
+void
+LrrChannelFilterClassTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (4);
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (10 * i, 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  Ptr<lrr::NeighborAwareSpectrumChannel> channel = LrrChannelHelper::Default ().Create ();
+  Ptr<LrrReceiverTrackingLossModel> tracking = CreateObject<LrrReceiverTrackingLossModel> ();
+  channel->SetStochasticPropagationLossModel (tracking);
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (channel);
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (1));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  std::vector<Ptr<lrr::Phy> > phys;
+  uint32_t channelNumbers[] = {1 /*A*/, 1 /*B*/, 13 /*C*/, 2 /*D*/};
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      phys.push_back (devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ());
+      phys[i]->SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, channelNumbers[i]));
+      phys[i]->SetRxFilter (sf.CreateRfFilter (channelNumbers[i]));
+      std::ostringstream context;
+      context << i;
+      phys[i]->TraceConnect ("RxStart", context.str (), MakeCallback (&LrrChannelFilterClassTestCase::RxStart, this));
+    }
+  std::vector<uint32_t> classes;
+  for (uint32_t i = 0; i < phys.size (); ++i)
+    {
+      classes.push_back (channel->GetFilterClass (phys[i]->GetChannelIndex ()));
+    }
+  NS_TEST_EXPECT_MSG_EQ (classes[0], classes[1], "A and B share a filter class");
+  NS_TEST_EXPECT_MSG_NE (classes[0], classes[2], "C has its own class");
+  NS_TEST_EXPECT_MSG_NE (classes[0], classes[3], "D has its own class");
+  NS_TEST_EXPECT_MSG_EQ (channel->IsCoupled (classes[0], classes[2]), false, "Disjoint channels are not coupled");
+  NS_TEST_EXPECT_MSG_EQ (channel->IsCoupled (classes[0], classes[3]), true, "Overlapping channels are coupled");
+
+  Simulator::Schedule (Seconds (1), &LrrReceiverTrackingLossModel::Reset, tracking);
+  Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (0)->GetBroadcast (), 0x0800);
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  std::string names[] = {"A", "B", "C", "D"};
+  bool propagated[] = {false, true, false, true};
+  for (uint32_t i = 1; i < nodes.GetN (); ++i)
+    {
+      Ptr<MobilityModel> mobility = nodes.Get (i)->GetObject<MobilityModel> ();
+      NS_TEST_EXPECT_MSG_EQ ((tracking->receivers.count (mobility) != 0), propagated[i], "Frame propagates to " << names[i]);
+      std::ostringstream context;
+      context << i;
+      NS_TEST_EXPECT_MSG_EQ ((m_rxStarts[context.str ()] != 0), propagated[i], "Frame is received by " << names[i]);
+    }
+  Simulator::Destroy ();
+}
+
+/**
+ * A is still, B moves away from A at 10 m/s starting 10 m from it, position snapshot is enabled. Friis
+ * gain goes as inverse square of distance. Checks that average RX power and batch gains follow B at a new
+ * timestamp and after a course change at the same timestamp, when the snapshot is already taken
+ */
+class LrrChannelPositionSnapshotTestCase : public ns3::TestCase
+{
+public:
+  LrrChannelPositionSnapshotTestCase () : ns3::TestCase ("Channel position snapshot test") {}
+  void DoRun ();
+private:
+  /// Check gains of B at A against the gains at 20 m taken at first check
+  void Check (double distance);
+  void CourseChange ();
+  Ptr<lrr::NeighborAwareSpectrumChannel> m_channel;
+  Ptr<lrr::Phy> m_a;
+  Ptr<lrr::Phy> m_b;
+  Ptr<ConstantVelocityMobilityModel> m_mobility;
+  double m_powerMw;
+  double m_gain;
+};
+
+void
+LrrChannelPositionSnapshotTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+  nodes.Get (0)->AggregateObject (CreateObject<ConstantPositionMobilityModel> ());
+  m_mobility = CreateObject<ConstantVelocityMobilityModel> ();
+  m_mobility->SetPosition (Vector (10, 0, 0));
+  m_mobility->SetVelocity (Vector (10, 0, 0));
+  nodes.Get (1)->AggregateObject (m_mobility);
+  m_channel = LrrChannelHelper::Default ().Create ();
+  m_channel->SetAttribute ("PositionSnapshot", BooleanValue (true));
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (m_channel);
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  m_a = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+  m_b = devices.Get (1)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+  m_powerMw = 0;
+  m_gain = 0;
+  Simulator::Schedule (Seconds (1), &LrrChannelPositionSnapshotTestCase::Check, this, 20);
+  Simulator::Schedule (Seconds (1), &LrrChannelPositionSnapshotTestCase::CourseChange, this);
+  Simulator::Schedule (Seconds (2), &LrrChannelPositionSnapshotTestCase::Check, this, 50);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  m_channel = 0;
+  m_a = 0;
+  m_b = 0;
+  m_mobility = 0;
+}
+
+void
+LrrChannelPositionSnapshotTestCase::Check (double distance)
+{
+  double powerMw = m_a->GetAverageRxPowerMw (m_b);
+  std::vector<double> gains;
+  m_channel->GetDeterministicGains (m_b->GetChannelIndex (), std::vector<uint32_t> (1, m_a->GetChannelIndex ()), gains);
+  NS_TEST_ASSERT_MSG_EQ (gains.size (), 1, "Gain of A");
+  if (m_powerMw == 0)
+    {
+      m_powerMw = powerMw;
+      m_gain = gains[0];
+    }
+  double ratio = (distance / 20) * (distance / 20);
+  NS_TEST_EXPECT_MSG_EQ_TOL (m_powerMw / powerMw, ratio, ratio * 1e-6, "Average RX power at " << distance << " m");
+  NS_TEST_EXPECT_MSG_EQ_TOL (m_gain / gains[0], ratio, ratio * 1e-6, "Gain at " << distance << " m");
+}
+
+void
+LrrChannelPositionSnapshotTestCase::CourseChange ()
+{
+  // The snapshot of this timestamp is taken by the check scheduled before:
+  m_mobility->SetPosition (Vector (40, 0, 0));
+  Check (40);
+}
+
+/**
+ * Stations at 10, 100 and 1000 m from A with default channel attributes, so the position snapshot is disabled.
+ * Checks that Friis gains from A are calculated in batch, both directly and for the neighbor list, and that
+ * they match the model and follow a station moved at the same timestamp
+ */
+class LrrChannelBatchGainsTestCase : public ns3::TestCase
+{
+public:
+  LrrChannelBatchGainsTestCase () : ns3::TestCase ("Channel batch gains test") {}
+  void DoRun ();
+};
+
+void
+LrrChannelBatchGainsTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (4);
+  double x[] = {0 /*A*/, 10, 100, 1000};
+  std::vector<Ptr<MobilityModel> > mobilities;
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (x[i], 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+      mobilities.push_back (mobility);
+    }
+  Ptr<lrr::NeighborAwareSpectrumChannel> channel = LrrChannelHelper::Default ().Create ();
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (channel);
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  std::vector<uint32_t> receivers;
+  for (uint32_t i = 1; i < devices.GetN (); ++i)
+    {
+      receivers.push_back (devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ()->GetChannelIndex ());
+    }
+  Ptr<lrr::Phy> a = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+  Ptr<FriisPropagationLossModel> friis = CreateObject<FriisPropagationLossModel> ();
+
+  uint64_t batchGains = channel->GetNBatchGains ();
+  std::vector<double> gains;
+  channel->GetDeterministicGains (a->GetChannelIndex (), receivers, gains);
+  NS_TEST_ASSERT_MSG_EQ (gains.size (), receivers.size (), "Gain of each receiver");
+  NS_TEST_EXPECT_MSG_EQ (channel->GetNBatchGains () - batchGains, receivers.size (), "Gains are calculated in batch with default attributes");
+  for (uint32_t k = 0; k < receivers.size (); k++)
+    {
+      double expected = std::pow (10, friis->CalcRxPower (0, mobilities[0], mobilities[k + 1]) / 10.0);
+      NS_TEST_EXPECT_MSG_EQ_TOL (gains[k], expected, expected * 1e-6, "Gain at " << x[k + 1] << " m");
+    }
+
+  // Without snapshot the current position is taken:
+  mobilities[1]->SetPosition (Vector (20, 0, 0));
+  channel->GetDeterministicGains (a->GetChannelIndex (), receivers, gains);
+  double expected = std::pow (10, friis->CalcRxPower (0, mobilities[0], mobilities[1]) / 10.0);
+  NS_TEST_EXPECT_MSG_EQ_TOL (gains[0], expected, expected * 1e-6, "Gain of a moved station");
+
+  batchGains = channel->GetNBatchGains ();
+  lrr::NeighborAwareSpectrumChannel::NeighborList neighbors =
+    channel->GetAllNeighbors (devices.Get (0)->GetObject<lrr::NeighborAwareDevice> (), a->GetTxPowerSpectralDensity ());
+  NS_TEST_EXPECT_MSG_EQ (neighbors.size (), receivers.size (), "All stations are in the neighbor list");
+  NS_TEST_EXPECT_MSG_EQ (channel->GetNBatchGains () - batchGains, receivers.size (), "Neighbor list is calculated in batch");
+  Simulator::Destroy ();
+}
+
+class LrrChannelTest : public ns3::TestSuite
+{
+public:
+  LrrChannelTest () : ns3::TestSuite ("lrr-channel-test", UNIT)
+  {
+    AddTestCase (new LrrChannelAdjacencyTestCase, TestCase::QUICK);
+    AddTestCase (new LrrPhyPowerLevelInterferenceTestCase, TestCase::QUICK);
+    AddTestCase (new LrrPhyRateAdaptationTestCase, TestCase::QUICK);
+    AddTestCase (new LrrChannelAssignmentTestCase, TestCase::QUICK);
+    AddTestCase (new LrrChannelFilterClassTestCase, TestCase::QUICK);
+    AddTestCase (new LrrChannelPositionSnapshotTestCase, TestCase::QUICK);
+    AddTestCase (new LrrChannelBatchGainsTestCase, TestCase::QUICK);
+  }
+} g_lrrChannelTest;
@@ -78,11 +78,127 @@ LrrGroupManagementTestCase::DoRun ()
   lrr::GlobalGroupManagement::Destroy ();
 }
 
+/// Join/Leave and membership change notification
+class LrrGroupJoinLeaveTestCase : public ns3::TestCase
+{
+public:
+  LrrGroupJoinLeaveTestCase () : ns3::TestCase ("Group join/leave test"), m_joins (0), m_leaves (0),
+    m_removedIndex (lrr::GlobalGroupManagement::INVALID_GROUP_INDEX) {}
+  void DoRun ();
+private:
+  void MembershipChanged (Ipv4Address group, Ipv4Address member, bool joined);
+  void GroupRemoved (Ipv4Address group, uint32_t index);
+  uint32_t m_joins;
+  uint32_t m_leaves;
+  uint32_t m_removedIndex;
+};
+
+void
+LrrGroupJoinLeaveTestCase::MembershipChanged (Ipv4Address group, Ipv4Address member, bool joined)
+{
+  if (joined)
+    {
+      m_joins++;
+    }
+  else
+    {
+      m_leaves++;
+    }
+}
+
+void
+LrrGroupJoinLeaveTestCase::GroupRemoved (Ipv4Address group, uint32_t index)
+{
+  NS_TEST_EXPECT_MSG_EQ (m_leaves, 3, "Members leave before group removal notification");
+  m_removedIndex = index;
+}
+
+void
+LrrGroupJoinLeaveTestCase::DoRun ()
+{
+  lrr::GlobalGroupManagement * mgt = lrr::GlobalGroupManagement::GetInstance ();
+  mgt->ConnectMembershipChange (MakeCallback (&LrrGroupJoinLeaveTestCase::MembershipChanged, this));
+  mgt->ConnectGroupRemoved (MakeCallback (&LrrGroupJoinLeaveTestCase::GroupRemoved, this));
+  NS_TEST_ASSERT_MSG_EQ (mgt->Join (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.1")), true, "Join");
+  NS_TEST_ASSERT_MSG_EQ (mgt->Join (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.2")), true, "Join");
+  NS_TEST_ASSERT_MSG_EQ (mgt->Join (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.2")), false, "Second join is ignored");
+  NS_TEST_ASSERT_MSG_EQ (mgt->IsInMcastGroup (Ipv4Address ("192.168.0.2"), Ipv4Address ("227.0.0.1")), true, "Check members");
+  NS_TEST_ASSERT_MSG_EQ (m_joins, 2, "Join notifications");
+  NS_TEST_ASSERT_MSG_EQ (mgt->Leave (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.1")), true, "Leave");
+  NS_TEST_ASSERT_MSG_EQ (mgt->Leave (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.1")), false, "Second leave is ignored");
+  NS_TEST_ASSERT_MSG_EQ (mgt->IsInMcastGroup (Ipv4Address ("192.168.0.1"), Ipv4Address ("227.0.0.1")), false, "Check members");
+  NS_TEST_ASSERT_MSG_EQ (m_leaves, 1, "Leave notifications");
+  /// Overwrite notifies only the difference:
+  std::set<Ipv4Address> group;
+  group.insert (Ipv4Address ("192.168.0.2"));
+  group.insert (Ipv4Address ("192.168.0.3"));
+  mgt->AddMcastGroup (Ipv4Address ("227.0.0.1"), group);
+  NS_TEST_ASSERT_MSG_EQ (m_joins, 3, "Join notifications");
+  NS_TEST_ASSERT_MSG_EQ (m_leaves, 1, "Leave notifications");
+  /// Members are a copy, which is valid while other groups are added:
+  lrr::GlobalGroupManagement::MemberSet members = mgt->GetGroupMembers (Ipv4Address ("227.0.0.1"));
+  for (uint32_t i = 2; i < 100; i++)
+    {
+      mgt->AddMcastGroup (Ipv4Address (Ipv4Address ("227.0.0.0").Get () + i), lrr::GlobalGroupManagement::MemberSet ());
+    }
+  NS_TEST_ASSERT_MSG_EQ ((members == group), true, "Members");
+  NS_TEST_ASSERT_MSG_EQ (m_joins, 3, "Empty groups are created without notifications");
+  uint32_t index = mgt->GetGroupIndex (Ipv4Address ("227.0.0.1"));
+  /// Group removal makes every member leave:
+  mgt->RemoveMulticastgroup (Ipv4Address ("227.0.0.1"));
+  NS_TEST_ASSERT_MSG_EQ (m_leaves, 3, "Leave notifications");
+  NS_TEST_ASSERT_MSG_EQ (m_removedIndex, index, "Group removal notification");
+  mgt->DisconnectGroupRemoved (MakeCallback (&LrrGroupJoinLeaveTestCase::GroupRemoved, this));
+  mgt->DisconnectMembershipChange (MakeCallback (&LrrGroupJoinLeaveTestCase::MembershipChanged, this));
+  mgt->Join (Ipv4Address ("227.0.0.1"), Ipv4Address ("192.168.0.1"));
+  NS_TEST_ASSERT_MSG_EQ (m_joins, 3, "Disconnected");
+  lrr::GlobalGroupManagement::Destroy ();
+}
+
+/// Multicast address allocation and reuse
+class LrrGroupAllocatorTestCase : public ns3::TestCase
+{
+public:
+  LrrGroupAllocatorTestCase () : ns3::TestCase ("Multicast address allocator test") {}
+  void DoRun ();
+};
+
+void
+LrrGroupAllocatorTestCase::DoRun ()
+{
+  lrr::GlobalGroupManagement * mgt = lrr::GlobalGroupManagement::GetInstance ();
+  /// Explicitly created group is skipped by allocator:
+  mgt->Join (Ipv4Address ("227.0.0.2"), Ipv4Address ("192.168.0.1"));
+  NS_TEST_ASSERT_MSG_EQ (lrr::GlobalGroupManagement::AllocateMulticastAddress (), Ipv4Address ("227.0.0.1"), "First address");
+  NS_TEST_ASSERT_MSG_EQ (lrr::GlobalGroupManagement::AllocateMulticastAddress (), Ipv4Address ("227.0.0.3"), "Used address is skipped");
+  /// More than 254 groups:
+  Ipv4Address last;
+  for (uint32_t i = 0; i < 1000; i++)
+    {
+      last = lrr::GlobalGroupManagement::AllocateMulticastAddress ();
+      mgt->Join (last, Ipv4Address ("192.168.0.1"));
+    }
+  NS_TEST_ASSERT_MSG_EQ (last, Ipv4Address ("227.0.3.235"), "Last address");
+  NS_TEST_ASSERT_MSG_EQ (mgt->IsInMcastGroup (Ipv4Address ("192.168.0.1"), last), true, "Check members");
+  NS_TEST_ASSERT_MSG_NE (mgt->GetGroupIndex (last), lrr::GlobalGroupManagement::INVALID_GROUP_INDEX, "Group index");
+  /// Removed group address is reused:
+  mgt->RemoveMulticastgroup (Ipv4Address ("227.0.1.0"));
+  NS_TEST_ASSERT_MSG_EQ (mgt->GetGroupIndex (Ipv4Address ("227.0.1.0")), lrr::GlobalGroupManagement::INVALID_GROUP_INDEX, "Group index");
+  NS_TEST_ASSERT_MSG_EQ (lrr::GlobalGroupManagement::AllocateMulticastAddress (), Ipv4Address ("227.0.1.0"), "Reused address");
+  NS_TEST_ASSERT_MSG_EQ (lrr::GlobalGroupManagement::AllocateMulticastAddress (), Ipv4Address ("227.0.3.236"), "Next address");
+  /// Other prefix:
+  mgt->SetMulticastPrefix (Ipv4Address ("239.1.0.0"), Ipv4Mask ("255.255.0.0"));
+  NS_TEST_ASSERT_MSG_EQ (lrr::GlobalGroupManagement::AllocateMulticastAddress (), Ipv4Address ("239.1.0.1"), "Prefix");
+  lrr::GlobalGroupManagement::Destroy ();
+}
+
 class LrrGroupManagementTest : public ns3::TestSuite
 {
 public:
   LrrGroupManagementTest () : ns3::TestSuite ("lrr-group-management-test", UNIT)
   {
     AddTestCase (new LrrGroupManagementTestCase, TestCase::QUICK);
+    AddTestCase (new LrrGroupJoinLeaveTestCase, TestCase::QUICK);
+    AddTestCase (new LrrGroupAllocatorTestCase, TestCase::QUICK);
   }
 } g_lrrGroupManagementTest;
@@ -0,0 +1,178 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+
+#include "ns3/test.h"
+#include "ns3/packet.h"
+#include "ns3/enum.h"
+#include "ns3/lrr-mac-header.h"
+#include "ns3/lrr-mac-impl.h"
+
+using namespace ns3;
+using namespace lrr;
+
+/**
+ * Each MAC header is serialized into a packet and deserialized back. Checks the fields and that
+ * the header takes exactly GetSerializedSize bytes
+ */
+class LrrMacHeaderTestCase : public ns3::TestCase
+{
+public:
+  LrrMacHeaderTestCase () : ns3::TestCase ("MAC header serialization test") {}
+  void DoRun ();
+private:
+  template <class H>
+  H RoundTrip (const H & header);
+};
+
+template <class H>
+H
+LrrMacHeaderTestCase::RoundTrip (const H & header)
+{
+  Ptr<Packet> packet = Create<Packet> (10);
+  packet->AddHeader (header);
+  NS_TEST_EXPECT_MSG_EQ (packet->GetSize (), 10 + header.GetSerializedSize (), "Size of " << header.GetInstanceTypeId ().GetName ());
+  H retval;
+  packet->RemoveHeader (retval);
+  NS_TEST_EXPECT_MSG_EQ (packet->GetSize (), 10, "Whole " << header.GetInstanceTypeId ().GetName () << " is read");
+  return retval;
+}
+
+void
+LrrMacHeaderTestCase::DoRun ()
+{
+  Mac48Address a ("00:00:00:00:01:02");
+  Mac48Address b ("00:00:00:00:03:04");
+
+  MacHeader generic;
+  generic.SetType (0x0800);
+  generic.SetSource (a);
+  generic.SetDestination (Mac48Address::GetBroadcast ());
+  MacHeader genericCopy = RoundTrip (generic);
+  NS_TEST_EXPECT_MSG_EQ (genericCopy.GetType (), 0x0800, "Generic header type");
+  NS_TEST_EXPECT_MSG_EQ (Mac48Address::ConvertFrom (genericCopy.GetSource ()), a, "Generic header source");
+  NS_TEST_EXPECT_MSG_EQ (Mac48Address::ConvertFrom (genericCopy.GetDestination ()), Mac48Address::GetBroadcast (), "Generic header destination");
+
+  Mac48Header mac48;
+  mac48.SetType (MacHeader::ARQ_TYPE);
+  mac48.SetSource (a);
+  mac48.SetDestination (b);
+  Mac48Header mac48Copy = RoundTrip (mac48);
+  NS_TEST_EXPECT_MSG_EQ (mac48Copy.GetType (), MacHeader::ARQ_TYPE, "Mac48 header type");
+  NS_TEST_EXPECT_MSG_EQ (mac48Copy.GetSource (), a, "Mac48 header source");
+  NS_TEST_EXPECT_MSG_EQ (mac48Copy.GetDestination (), b, "Mac48 header destination");
+
+  ShortMacHeader shortHeader;
+  shortHeader.SetType (MacHeader::AGGREGATE_TYPE);
+  shortHeader.SetSource (0x0102);
+  shortHeader.SetDestination (ShortMacHeader::MULTICAST);
+  ShortMacHeader shortCopy = RoundTrip (shortHeader);
+  NS_TEST_EXPECT_MSG_EQ (shortCopy.GetType (), MacHeader::AGGREGATE_TYPE, "Short header type");
+  NS_TEST_EXPECT_MSG_EQ (shortCopy.GetSource (), 0x0102, "Short header source");
+  NS_TEST_EXPECT_MSG_EQ (shortCopy.GetDestination (), ShortMacHeader::MULTICAST, "Short header destination");
+
+  NS_TEST_EXPECT_MSG_EQ (RoundTrip (MacSubframeHeader (1500)).GetLength (), 1500, "Subframe length");
+  NS_TEST_EXPECT_MSG_EQ (RoundTrip (MacSequenceHeader (0xfffe)).GetSequence (), 0xfffe, "Sequence number");
+  MacArqHeader arqCopy = RoundTrip (MacArqHeader (0xfffe, MacHeader::AGGREGATE_TYPE));
+  NS_TEST_EXPECT_MSG_EQ (arqCopy.GetSequence (), 0xfffe, "ARQ sequence number");
+  NS_TEST_EXPECT_MSG_EQ (arqCopy.GetType (), MacHeader::AGGREGATE_TYPE, "ARQ frame type");
+}
+
+/**
+ * MAC of each HeaderFormat adds its header to a packet. Checks that GetMacHeaderSize is the size of
+ * the added header and the header is read back by the class of its format
+ */
+class LrrMacHeaderFormatTestCase : public ns3::TestCase
+{
+public:
+  LrrMacHeaderFormatTestCase () : ns3::TestCase ("MAC header format test") {}
+  void DoRun ();
+};
+
+void
+LrrMacHeaderFormatTestCase::DoRun ()
+{
+  Mac48Address own ("00:00:00:00:00:01");
+  Mac48Address peer ("00:00:00:00:00:02");
+  CollisionFreeMacImpl::HeaderFormat formats[] = {
+    CollisionFreeMacImpl::GENERIC_HEADER,
+    CollisionFreeMacImpl::MAC48_HEADER,
+    CollisionFreeMacImpl::SHORT_HEADER
+  };
+  for (uint32_t f = 0; f < 3; f++)
+    {
+      Ptr<CollisionFreeMacImpl> mac = CreateObject<CollisionFreeMacImpl> ();
+      mac->SetAttribute ("HeaderFormat", EnumValue (formats[f]));
+      mac->SetAddress (own);
+      Ptr<Packet> packet = Create<Packet> (10);
+      mac->AddMacHeader (packet, peer, own, 0x0800);
+      NS_TEST_EXPECT_MSG_EQ (packet->GetSize (), 10 + mac->GetMacHeaderSize (), "Header size of format " << f);
+      uint16_t type = 0;
+      Mac48Address source;
+      Mac48Address destination;
+      switch (formats[f])
+        {
+        case CollisionFreeMacImpl::MAC48_HEADER:
+          {
+            Mac48Header header;
+            packet->RemoveHeader (header);
+            type = header.GetType ();
+            source = header.GetSource ();
+            destination = header.GetDestination ();
+            break;
+          }
+        case CollisionFreeMacImpl::SHORT_HEADER:
+          {
+            ShortMacHeader header;
+            packet->RemoveHeader (header);
+            type = header.GetType ();
+            NS_TEST_EXPECT_MSG_EQ (header.GetSource (), 0x0001, "Short source");
+            NS_TEST_EXPECT_MSG_EQ (header.GetDestination (), 0x0002, "Short destination");
+            source = own;
+            destination = peer;
+            break;
+          }
+        default:
+          {
+            MacHeader header;
+            packet->RemoveHeader (header);
+            type = header.GetType ();
+            source = Mac48Address::ConvertFrom (header.GetSource ());
+            destination = Mac48Address::ConvertFrom (header.GetDestination ());
+            break;
+          }
+        }
+      NS_TEST_EXPECT_MSG_EQ (packet->GetSize (), 10, "Whole header is read, format " << f);
+      NS_TEST_EXPECT_MSG_EQ (type, 0x0800, "Type, format " << f);
+      NS_TEST_EXPECT_MSG_EQ (source, own, "Source, format " << f);
+      NS_TEST_EXPECT_MSG_EQ (destination, peer, "Destination, format " << f);
+      mac->Dispose ();
+    }
+}
+
+class LrrMacHeaderTest : public ns3::TestSuite
+{
+public:
+  LrrMacHeaderTest () : ns3::TestSuite ("lrr-mac-header-test", UNIT)
+  {
+    AddTestCase (new LrrMacHeaderTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacHeaderFormatTestCase, TestCase::QUICK);
+  }
+} g_lrrMacHeaderTest;
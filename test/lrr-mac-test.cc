@@ -0,0 +1,892 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/node-container.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/wifi-spectrum-value-helper.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/drop-tail-queue.h"
+#include "ns3/net-device-queue-interface.h"
+#include "ns3/queue-limits.h"
+
+#include "ns3/lrr-channel-helper.h"
+#include "ns3/lrr-device-helper.h"
+#include "ns3/lrr-device-impl.h"
+#include "ns3/lrr-mac-impl.h"
+#include "ns3/lrr-mac-access-manager.h"
+#include "ns3/lrr-mac-tdma.h"
+#include "ns3/lrr-mac-header.h"
+#include "ns3/lrr-phy.h"
+
+#include <set>
+#include <map>
+#include <algorithm>
+
+using namespace ns3;
+
+/// Two stations 10 meters apart
+static NetDeviceContainer
+InstallTwoStations (std::string macType = "ns3::lrr::CollisionFreeMacImpl")
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (10 * i, 0, 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetType (macType);
+  deviceHelper.SetChannel (LrrChannelHelper::Default ().Create ());
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  return deviceHelper.Install (nodes);
+}
+
+/**
+ * Two stations, the first one sends several packets to the second one.
+ * Checks that frames passed to PHY are the packets handed to the device (no copies on TX path)
+ */
+class LrrMacTxCopyTestCase : public ns3::TestCase
+{
+public:
+  LrrMacTxCopyTestCase () : ns3::TestCase ("MAC TX path copies test"), m_copies (0), m_received (0) {}
+  void DoRun ();
+private:
+  void Send (Ptr<NetDevice> from, Ptr<NetDevice> to);
+  void TxStart (Ptr<const Packet> packet);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+private:
+  /// Packets handed to the device
+  std::set<const Packet *> m_sent;
+  /// Frames passed to PHY, which are not the packets handed to the device
+  uint32_t m_copies;
+  uint32_t m_received;
+};
+
+void
+LrrMacTxCopyTestCase::Send (Ptr<NetDevice> from, Ptr<NetDevice> to)
+{
+  Ptr<Packet> packet = Create<Packet> (100);
+  m_sent.insert (PeekPointer (packet));
+  from->Send (packet, to->GetAddress (), 0x0800);
+}
+
+void
+LrrMacTxCopyTestCase::TxStart (Ptr<const Packet> packet)
+{
+  if (m_sent.find (PeekPointer (packet)) == m_sent.end ())
+    {
+      m_copies++;
+    }
+}
+
+bool
+LrrMacTxCopyTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received++;
+  return true;
+}
+
+void
+LrrMacTxCopyTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::Mac> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ();
+  mac->GetPhy ()->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacTxCopyTestCase::TxStart, this));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacTxCopyTestCase::Receive, this));
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (Seconds (1), &LrrMacTxCopyTestCase::Send, this, devices.Get (0), devices.Get (1));
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (mac->GetNTxFrames (), 3, "Each packet is sent in its own frame");
+  NS_TEST_EXPECT_MSG_EQ (m_copies, 0, "Frames are passed to PHY without copies");
+  NS_TEST_EXPECT_MSG_EQ (m_received, 3, "All packets are received");
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations with ARQ, the first one sends several packets to the second one.
+ * Checks that all frames are acknowledged without retries and received once, and that
+ * each frame carries a single MAC header followed by its sequence number
+ */
+class LrrMacArqTestCase : public ns3::TestCase
+{
+public:
+  LrrMacArqTestCase () : ns3::TestCase ("MAC ARQ test"), m_received (0) {}
+  void DoRun ();
+private:
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+  void TxStart (Ptr<const Packet> packet);
+private:
+  uint32_t m_received;
+  /// Sizes of frames sent by the first station
+  std::vector<uint32_t> m_frameSizes;
+};
+
+bool
+LrrMacArqTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  NS_TEST_EXPECT_MSG_EQ (protocol, 0x0800, "Protocol of the acknowledged frame");
+  m_received++;
+  return true;
+}
+
+void
+LrrMacArqTestCase::TxStart (Ptr<const Packet> packet)
+{
+  m_frameSizes.push_back (packet->GetSize ());
+}
+
+void
+LrrMacArqTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::CollisionFreeMacImpl> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()
+    ->GetObject<lrr::CollisionFreeMacImpl> ();
+  Ptr<lrr::AccessManager> accessManager = mac->GetAccessManager ();
+  accessManager->SetAttribute ("Arq", BooleanValue (true));
+  mac->GetPhy ()->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacArqTestCase::TxStart, this));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacArqTestCase::Receive, this));
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  lrr::AccessManager::ArqStats stats = accessManager->GetArqStats (Mac48Address::ConvertFrom (devices.Get (1)->GetAddress ()));
+  NS_TEST_EXPECT_MSG_EQ (stats.frames, 3, "Each packet is sent in its own frame");
+  NS_TEST_EXPECT_MSG_EQ (stats.acked, 3, "All frames are acknowledged");
+  NS_TEST_EXPECT_MSG_EQ (stats.retries, 0, "No retries without fading");
+  NS_TEST_EXPECT_MSG_EQ (m_received, 3, "All packets are received once");
+  NS_TEST_ASSERT_MSG_EQ (m_frameSizes.size (), 3, "No retransmissions");
+  for (uint32_t i = 0; i < m_frameSizes.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (m_frameSizes[i], 100 + mac->GetMacHeaderSize () + lrr::MacArqHeader ().GetSerializedSize (),
+                             "Acknowledged frame carries a single MAC header");
+    }
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations with ARQ and MaxRetries = 2, frames are lost in one of two ways:
+ * - data: the receiver is moved 100 km away, two packets are sent, then it comes back and one more is sent;
+ * - acknowledgements: ED threshold of the sender is above the power of ACK, two packets are sent.
+ * Checks retries, drops after MaxRetries (ArqFailure trace) and that each packet is received at most once
+ */
+class LrrMacArqLossTestCase : public ns3::TestCase
+{
+public:
+  LrrMacArqLossTestCase (bool lostAcks) :
+    ns3::TestCase (lostAcks ? "MAC ARQ lost acknowledgements test" : "MAC ARQ lost data test"),
+    m_lostAcks (lostAcks), m_retries (0), m_failures (0), m_received (0) {}
+  void DoRun ();
+private:
+  void Retry (Mac48Address destination, uint32_t retries);
+  void Failure (Mac48Address destination, uint32_t retries);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+  static void Move (Ptr<Node> node, Vector position);
+private:
+  bool m_lostAcks;
+  uint32_t m_retries;
+  uint32_t m_failures;
+  /// Number of receptions of each packet by its UID
+  std::map<uint64_t, uint32_t> m_received;
+};
+
+void
+LrrMacArqLossTestCase::Retry (Mac48Address destination, uint32_t retries)
+{
+  m_retries++;
+}
+
+void
+LrrMacArqLossTestCase::Failure (Mac48Address destination, uint32_t retries)
+{
+  NS_TEST_EXPECT_MSG_EQ (retries, 2, "Frame is dropped after MaxRetries retransmissions");
+  m_failures++;
+}
+
+bool
+LrrMacArqLossTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received[packet->GetUid ()]++;
+  return true;
+}
+
+void
+LrrMacArqLossTestCase::Move (Ptr<Node> node, Vector position)
+{
+  node->GetObject<MobilityModel> ()->SetPosition (position);
+}
+
+void
+LrrMacArqLossTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::Mac> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ();
+  Ptr<lrr::AccessManager> accessManager = mac->GetObject<lrr::CollisionFreeMacImpl> ()->GetAccessManager ();
+  accessManager->SetAttribute ("Arq", BooleanValue (true));
+  accessManager->SetAttribute ("MaxRetries", UintegerValue (2));
+  accessManager->TraceConnectWithoutContext ("ArqRetry", MakeCallback (&LrrMacArqLossTestCase::Retry, this));
+  accessManager->TraceConnectWithoutContext ("ArqFailure", MakeCallback (&LrrMacArqLossTestCase::Failure, this));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacArqLossTestCase::Receive, this));
+  if (m_lostAcks)
+    {
+      // Data at 10 m is far above the receiver ED threshold, but the sender does not detect anything
+      mac->GetPhy ()->SetAttribute ("EnergyDetectionThreshold", DoubleValue (0));
+    }
+  else
+    {
+      Simulator::Schedule (Seconds (0.5), &LrrMacArqLossTestCase::Move, devices.Get (1)->GetNode (), Vector (100000, 0, 0));
+      Simulator::Schedule (Seconds (1.5), &LrrMacArqLossTestCase::Move, devices.Get (1)->GetNode (), Vector (10, 0, 0));
+      Simulator::Schedule (Seconds (1.6), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  lrr::AccessManager::ArqStats stats = accessManager->GetArqStats (Mac48Address::ConvertFrom (devices.Get (1)->GetAddress ()));
+  NS_TEST_EXPECT_MSG_EQ (stats.frames, (m_lostAcks ? 2 : 3), "Each packet is sent in its own frame");
+  NS_TEST_EXPECT_MSG_EQ (stats.retries, 4, "Lost frames are retransmitted MaxRetries times");
+  NS_TEST_EXPECT_MSG_EQ (m_retries, 4, "ArqRetry trace");
+  NS_TEST_EXPECT_MSG_EQ (stats.failures, 2, "Lost frames are dropped after MaxRetries");
+  NS_TEST_EXPECT_MSG_EQ (m_failures, 2, "ArqFailure trace");
+  NS_TEST_EXPECT_MSG_EQ (stats.acked, (m_lostAcks ? 0 : 1), "Frame is acknowledged when the receiver is back");
+  // Retransmissions of frames whose acknowledgements are lost are not passed up:
+  NS_TEST_EXPECT_MSG_EQ (m_received.size (), (m_lostAcks ? 2 : 1), "Received packets");
+  for (std::map<uint64_t, uint32_t>::const_iterator i = m_received.begin (); i != m_received.end (); ++i)
+    {
+      NS_TEST_EXPECT_MSG_EQ (i->second, 1, "Packet " << i->first << " is received once");
+    }
+  Simulator::Destroy ();
+}
+
+/**
+ * Two TDMA stations interfere, so they get different slots of a two-slot frame.
+ * Checks that all frames start at the slot of the sender and are received
+ */
+class LrrMacTdmaTestCase : public ns3::TestCase
+{
+public:
+  LrrMacTdmaTestCase () : ns3::TestCase ("TDMA MAC test"), m_misplaced (0), m_received (0) {}
+  void DoRun ();
+private:
+  void TxStart (Ptr<const Packet> packet);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+private:
+  Ptr<lrr::Phy> m_phy;
+  /// Frames started out of the sender slot
+  uint32_t m_misplaced;
+  uint32_t m_received;
+};
+
+void
+LrrMacTdmaTestCase::TxStart (Ptr<const Packet> packet)
+{
+  // Scheduler is aggregated to the channel when MAC is initialized
+  Ptr<lrr::TdmaScheduler> scheduler = m_phy->GetNeighborAwareChannel ()->GetObject<lrr::TdmaScheduler> ();
+  Time now = Simulator::Now ();
+  if ((scheduler == 0) || (scheduler->GetSlotStart (m_phy->GetChannelIndex (), now) != now))
+    {
+      m_misplaced++;
+    }
+}
+
+bool
+LrrMacTdmaTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received++;
+  return true;
+}
+
+void
+LrrMacTdmaTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ("ns3::lrr::TdmaMacImpl");
+  m_phy = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()->GetPhy ()->GetObject<lrr::Phy> ();
+  m_phy->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacTdmaTestCase::TxStart, this));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacTdmaTestCase::Receive, this));
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (Seconds (1) + MicroSeconds (300 * i), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  Ptr<lrr::TdmaScheduler> scheduler = m_phy->GetNeighborAwareChannel ()->GetObject<lrr::TdmaScheduler> ();
+  NS_TEST_ASSERT_MSG_EQ ((scheduler != 0), true, "Scheduler is aggregated to the channel");
+  NS_TEST_EXPECT_MSG_EQ (scheduler->GetFrameLength (), 2, "Two interfering stations need two slots");
+  NS_TEST_EXPECT_MSG_NE (scheduler->GetSlot (0), scheduler->GetSlot (1), "Interfering stations have different slots");
+  NS_TEST_EXPECT_MSG_EQ (m_misplaced, 0, "Frames start in the sender slot");
+  NS_TEST_EXPECT_MSG_EQ (m_received, 3, "All packets are received");
+  m_phy = 0;
+  Simulator::Destroy ();
+}
+
+/**
+ * Two pairs of a 2x2 grid, senders are 1 km apart: they are interference neighbors, but each receiver is
+ * 10 m away from its sender, so SINR is high. Both senders start at the same time.
+ * Checks that with SpatialReuse frames overlap and are registered in the channel, without it frames are
+ * serialized and nothing is registered. All frames are received in both cases. With ARQ the acknowledgement
+ * is registered as a transmission of its own from the receiver, and frames are acknowledged without retries.
+ */
+class LrrMacSpatialReuseTestCase : public ns3::TestCase
+{
+public:
+  LrrMacSpatialReuseTestCase (bool spatialReuse, bool arq) :
+    ns3::TestCase (spatialReuse ? (arq ? "MAC spatial reuse with ARQ test" : "MAC spatial reuse test") : "MAC without spatial reuse test"),
+    m_spatialReuse (spatialReuse), m_arq (arq), m_active (0), m_maxActive (0), m_registered (0), m_acks (0), m_retries (0), m_received (0) {}
+  void DoRun ();
+private:
+  void TxStart (Ptr<const Packet> packet);
+  void TxEnd (Ptr<const Packet> packet);
+  void CountTransmissions (Ptr<lrr::NeighborAwareSpectrumChannel> channel);
+  void Retry (Mac48Address destination, uint32_t retries);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+private:
+  bool m_spatialReuse;
+  bool m_arq;
+  /// Frames being transmitted now
+  uint32_t m_active;
+  uint32_t m_maxActive;
+  /// Transmissions registered in the channel
+  uint32_t m_registered;
+  /// Registered transmissions of receivers, i.e. acknowledgements
+  uint32_t m_acks;
+  uint32_t m_retries;
+  uint32_t m_received;
+};
+
+void
+LrrMacSpatialReuseTestCase::TxStart (Ptr<const Packet> packet)
+{
+  m_active++;
+  m_maxActive = std::max (m_maxActive, m_active);
+}
+
+void
+LrrMacSpatialReuseTestCase::TxEnd (Ptr<const Packet> packet)
+{
+  m_active--;
+}
+
+void
+LrrMacSpatialReuseTestCase::CountTransmissions (Ptr<lrr::NeighborAwareSpectrumChannel> channel)
+{
+  std::vector<lrr::NeighborAwareSpectrumChannel::Transmission> transmissions = channel->GetTransmissions (Seconds (0), Time::Max ());
+  m_registered = transmissions.size ();
+  for (std::vector<lrr::NeighborAwareSpectrumChannel::Transmission>::const_iterator i = transmissions.begin (); i != transmissions.end (); ++i)
+    {
+      // PHY ordinals follow the order of devices, receivers are odd:
+      if (i->sender % 2 == 1)
+        {
+          m_acks++;
+          NS_TEST_EXPECT_MSG_EQ (i->receiver, i->sender - 1, "Acknowledgement goes back to the sender");
+        }
+    }
+}
+
+void
+LrrMacSpatialReuseTestCase::Retry (Mac48Address destination, uint32_t retries)
+{
+  m_retries++;
+}
+
+bool
+LrrMacSpatialReuseTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received++;
+  return true;
+}
+
+void
+LrrMacSpatialReuseTestCase::DoRun ()
+{
+  NodeContainer nodes;
+  nodes.Create (4);
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+    {
+      // Senders are even, each receiver is next to its sender:
+      Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (Vector (1000 * (i / 2), 10 * (i % 2), 0));
+      nodes.Get (i)->AggregateObject (mobility);
+    }
+  Ptr<lrr::NeighborAwareSpectrumChannel> channel = LrrChannelHelper::Default ().Create ();
+  NeighborAwareDeviceHelper deviceHelper;
+  deviceHelper.SetChannel (channel);
+  WifiSpectrumValue5MhzFactory sf;
+  deviceHelper.SetTxPowerSpectralDensity (sf.CreateTxPowerSpectralDensity (0.1 /*Watts*/, 1 /*channel number*/));
+  deviceHelper.SetNoisePowerSpectralDensity (sf.CreateConstant (1.381e-23 * 290 /*kT*/));
+  deviceHelper.SetRxFilter (sf.CreateRfFilter (5));
+  NetDeviceContainer devices = deviceHelper.Install (nodes);
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      Ptr<lrr::Mac> mac = devices.Get (i)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ();
+      Ptr<lrr::AccessManager> accessManager = mac->GetObject<lrr::CollisionFreeMacImpl> ()->GetAccessManager ();
+      accessManager->SetAttribute ("SpatialReuse", BooleanValue (m_spatialReuse));
+      accessManager->SetAttribute ("Arq", BooleanValue (m_arq));
+      if (i % 2 == 0)
+        {
+          accessManager->TraceConnectWithoutContext ("ArqRetry", MakeCallback (&LrrMacSpatialReuseTestCase::Retry, this));
+          mac->GetPhy ()->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacSpatialReuseTestCase::TxStart, this));
+          mac->GetPhy ()->TraceConnectWithoutContext ("TxEnd", MakeCallback (&LrrMacSpatialReuseTestCase::TxEnd, this));
+          Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (i), Create<Packet> (100), devices.Get (i + 1)->GetAddress (), 0x0800);
+        }
+      else
+        {
+          devices.Get (i)->SetReceiveCallback (MakeCallback (&LrrMacSpatialReuseTestCase::Receive, this));
+        }
+    }
+  Simulator::Schedule (Seconds (1) + NanoSeconds (1), &LrrMacSpatialReuseTestCase::CountTransmissions, this, channel);
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_maxActive, (m_spatialReuse ? 2 : 1), "Frames overlap with spatial reuse only");
+  NS_TEST_EXPECT_MSG_EQ (m_registered, (m_spatialReuse ? (m_arq ? 4 : 2) : 0), "Transmissions are registered with spatial reuse only");
+  NS_TEST_EXPECT_MSG_EQ (m_acks, (m_spatialReuse && m_arq ? 2 : 0), "Acknowledgements are registered with ARQ");
+  NS_TEST_EXPECT_MSG_EQ (m_retries, 0, "Acknowledgements do not collide");
+  NS_TEST_EXPECT_MSG_EQ (m_received, 2, "All packets are received");
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations with aggregation, the first one sends packets of different sizes at once.
+ * Checks that several packets share a frame within MaxBurstSize and all of them are received intact and in order
+ */
+class LrrMacAggregationTestCase : public ns3::TestCase
+{
+public:
+  LrrMacAggregationTestCase () : ns3::TestCase ("MAC aggregation test"), m_maxBurstSize (600), m_frames (0), m_oversized (0) {}
+  void DoRun ();
+private:
+  void TxStart (Ptr<const Packet> packet);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+  static Ptr<Packet> CreatePayload (uint32_t index);
+private:
+  uint32_t m_maxBurstSize;
+  uint32_t m_frames;
+  /// Frames exceeding MaxBurstSize
+  uint32_t m_oversized;
+  std::vector<Ptr<const Packet> > m_received;
+};
+
+Ptr<Packet>
+LrrMacAggregationTestCase::CreatePayload (uint32_t index)
+{
+  std::vector<uint8_t> buffer (100 + 10 * index, index);
+  return Create<Packet> (&buffer[0], buffer.size ());
+}
+
+void
+LrrMacAggregationTestCase::TxStart (Ptr<const Packet> packet)
+{
+  m_frames++;
+  if (packet->GetSize () > m_maxBurstSize)
+    {
+      m_oversized++;
+    }
+}
+
+bool
+LrrMacAggregationTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received.push_back (packet);
+  return true;
+}
+
+void
+LrrMacAggregationTestCase::DoRun ()
+{
+  const uint32_t nPackets = 10;
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::Mac> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ();
+  Ptr<lrr::AccessManager> accessManager = mac->GetObject<lrr::CollisionFreeMacImpl> ()->GetAccessManager ();
+  accessManager->SetAttribute ("MaxBurstDuration", TimeValue (MilliSeconds (10)));
+  accessManager->SetAttribute ("MaxBurstSize", UintegerValue (m_maxBurstSize));
+  mac->GetPhy ()->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacAggregationTestCase::TxStart, this));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacAggregationTestCase::Receive, this));
+  for (uint32_t i = 0; i < nPackets; i++)
+    {
+      Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), CreatePayload (i), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_GT (m_frames, 1, "Packets do not fit into one frame");
+  NS_TEST_EXPECT_MSG_LT (m_frames, nPackets, "Packets are aggregated");
+  NS_TEST_EXPECT_MSG_EQ (m_oversized, 0, "Frames do not exceed MaxBurstSize");
+  NS_TEST_ASSERT_MSG_EQ (m_received.size (), nPackets, "All packets are received");
+  for (uint32_t i = 0; i < nPackets; i++)
+    {
+      Ptr<Packet> expected = CreatePayload (i);
+      NS_TEST_EXPECT_MSG_EQ (m_received[i]->GetSize (), expected->GetSize (), "Size of packet " << i);
+      std::vector<uint8_t> data (m_received[i]->GetSize ());
+      m_received[i]->CopyData (&data[0], data.size ());
+      NS_TEST_EXPECT_MSG_EQ ((std::count (data.begin (), data.end (), i) == (int) data.size ()), true, "Payload of packet " << i);
+    }
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations, the first one has traffic classes of three priorities, classes 1 and 2 share priority 1 with
+ * quanta of three frames and one frame. Checks that higher priority classes are served first and that
+ * backlogged classes of the same priority are served in turns of their quanta and get bytes in proportion to them
+ */
+class LrrMacTrafficClassTestCase : public ns3::TestCase
+{
+public:
+  LrrMacTrafficClassTestCase () : ns3::TestCase ("MAC traffic class scheduling test") {}
+  void DoRun ();
+private:
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+  void Send (Ptr<NetDevice> from, Ptr<NetDevice> to, uint16_t protocol, uint32_t n);
+private:
+  /// Protocols of received packets in order of reception
+  std::vector<uint16_t> m_received;
+  /// Received bytes per protocol
+  std::map<uint16_t, uint32_t> m_bytes;
+};
+
+bool
+LrrMacTrafficClassTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received.push_back (protocol);
+  m_bytes[protocol] += packet->GetSize ();
+  return true;
+}
+
+void
+LrrMacTrafficClassTestCase::Send (Ptr<NetDevice> from, Ptr<NetDevice> to, uint16_t protocol, uint32_t n)
+{
+  for (uint32_t i = 0; i < n; i++)
+    {
+      from->Send (Create<Packet> (500), to->GetAddress (), protocol);
+    }
+}
+
+void
+LrrMacTrafficClassTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::CollisionFreeMacImpl> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()
+    ->GetObject<lrr::CollisionFreeMacImpl> ();
+  Ptr<lrr::AccessManager> accessManager = mac->GetAccessManager ();
+  // Packets are queued with MAC header:
+  uint32_t frameSize = 500 + mac->GetMacHeaderSize ();
+  accessManager->SetProtocolClass (0x0801, accessManager->AddTrafficClass (CreateObject<DropTailQueue<Packet> > (), 1, 3 * frameSize));
+  accessManager->SetProtocolClass (0x0802, accessManager->AddTrafficClass (CreateObject<DropTailQueue<Packet> > (), 1, frameSize));
+  accessManager->SetProtocolClass (0x0803, accessManager->AddTrafficClass (CreateObject<DropTailQueue<Packet> > (), 2));
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacTrafficClassTestCase::Receive, this));
+  // Lower priorities are enqueued first:
+  Simulator::Schedule (Seconds (1), &LrrMacTrafficClassTestCase::Send, this, devices.Get (0), devices.Get (1), 0x0800, 4);
+  Simulator::Schedule (Seconds (1), &LrrMacTrafficClassTestCase::Send, this, devices.Get (0), devices.Get (1), 0x0801, 4);
+  Simulator::Schedule (Seconds (1), &LrrMacTrafficClassTestCase::Send, this, devices.Get (0), devices.Get (1), 0x0803, 4);
+  Simulator::Schedule (Seconds (2), &LrrMacTrafficClassTestCase::Send, this, devices.Get (0), devices.Get (1), 0x0801, 16);
+  Simulator::Schedule (Seconds (2), &LrrMacTrafficClassTestCase::Send, this, devices.Get (0), devices.Get (1), 0x0802, 16);
+  Simulator::Stop (Seconds (3));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_received.size (), 44, "All packets are received");
+  uint16_t priorityOrder[] = {0x0803, 0x0801, 0x0800};
+  for (uint32_t i = 0; i < 12; i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (m_received[i], priorityOrder[i / 4], "Strict priority, packet " << i);
+    }
+  // Both classes are backlogged during the first 16 packets, which make 4 full rounds:
+  m_bytes.clear ();
+  uint32_t run = 0;
+  for (uint32_t i = 12; i < 12 + 16; i++)
+    {
+      m_bytes[m_received[i]] += 500;
+      run++;
+      if ((i + 1 < m_received.size ()) && (m_received[i + 1] == m_received[i]))
+        {
+          continue;
+        }
+      NS_TEST_EXPECT_MSG_EQ (run, (m_received[i] == 0x0801 ? 3 : 1), "Turn of class of protocol " << m_received[i]
+                             << " ends at packet " << i);
+      run = 0;
+    }
+  NS_TEST_EXPECT_MSG_EQ (m_bytes[0x0801], 3 * m_bytes[0x0802], "Bytes are shared in proportion to quanta");
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations, class queue of the first one holds 3 packets, 4 packets are sent at once.
+ * Checks that the device queue is stopped when the class queue fills and is woken when a frame is dequeued
+ */
+class LrrMacQueueFlowControlTestCase : public ns3::TestCase
+{
+public:
+  LrrMacQueueFlowControlTestCase () : ns3::TestCase ("MAC device queue flow control test"), m_rejected (0), m_received (0) {}
+  void DoRun ();
+private:
+  void Send (Ptr<NetDevice> from, Ptr<NetDevice> to);
+  void CheckStopped (Ptr<NetDeviceQueue> txQueue, bool stopped, std::string message);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+private:
+  uint32_t m_rejected;
+  uint32_t m_received;
+};
+
+void
+LrrMacQueueFlowControlTestCase::Send (Ptr<NetDevice> from, Ptr<NetDevice> to)
+{
+  if (!from->Send (Create<Packet> (100), to->GetAddress (), 0x0800))
+    {
+      m_rejected++;
+    }
+}
+
+void
+LrrMacQueueFlowControlTestCase::CheckStopped (Ptr<NetDeviceQueue> txQueue, bool stopped, std::string message)
+{
+  NS_TEST_EXPECT_MSG_EQ (txQueue->IsStopped (), stopped, message);
+}
+
+bool
+LrrMacQueueFlowControlTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received++;
+  return true;
+}
+
+void
+LrrMacQueueFlowControlTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::AccessManager> accessManager = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()
+    ->GetObject<lrr::CollisionFreeMacImpl> ()->GetAccessManager ();
+  accessManager->GetQueue ()->SetAttribute ("MaxPackets", UintegerValue (3));
+  Ptr<NetDeviceQueueInterface> queueInterface = devices.Get (0)->GetObject<NetDeviceQueueInterface> ();
+  NS_TEST_ASSERT_MSG_EQ ((queueInterface != 0), true, "Device queue interface is aggregated by helper");
+  Ptr<NetDeviceQueue> txQueue = queueInterface->GetTxQueue (0);
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacQueueFlowControlTestCase::Receive, this));
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (Seconds (1), &LrrMacQueueFlowControlTestCase::Send, this, devices.Get (0), devices.Get (1));
+    }
+  // Access starts after all events of this timestamp scheduled before it:
+  Simulator::Schedule (Seconds (1), &LrrMacQueueFlowControlTestCase::CheckStopped, this, txQueue, true,
+                       "Device queue is stopped when class queue fills");
+  Simulator::Schedule (Seconds (1), &LrrMacQueueFlowControlTestCase::Send, this, devices.Get (0), devices.Get (1));
+  Simulator::Schedule (Seconds (1) + NanoSeconds (1), &LrrMacQueueFlowControlTestCase::CheckStopped, this, txQueue, false,
+                       "Device queue is woken when a frame is dequeued");
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_EXPECT_MSG_EQ (m_rejected, 1, "Packet is rejected by full class queue");
+  NS_TEST_EXPECT_MSG_EQ (m_received, 3, "Queued packets are received");
+  NS_TEST_EXPECT_MSG_EQ (txQueue->IsStopped (), false, "Device queue is not stopped after transmission");
+  Simulator::Destroy ();
+}
+
+/// Queue limits which never stop the device queue, only count bytes reported by MAC
+class LrrByteCountingQueueLimits : public QueueLimits
+{
+public:
+  static TypeId GetTypeId ()
+  {
+    static TypeId tid = TypeId ("ns3::LrrByteCountingQueueLimits")
+      .SetParent<QueueLimits> ()
+    ;
+    return tid;
+  }
+  LrrByteCountingQueueLimits () : queued (0), completed (0) {}
+  void Reset () { queued = completed = 0; }
+  void Completed (uint32_t count) { completed += count; }
+  int32_t Available () const { return 1 << 30; }
+  void Queued (uint32_t count) { queued += count; }
+
+  uint64_t queued;
+  uint64_t completed;
+};
+
+/**
+ * Two stations with CoDel, the first one sends a burst of packets taking several CoDel intervals to transmit.
+ * Checks that packets of the standing queue are dropped, the rest are received and bytes of all dequeued
+ * packets (dropped ones too) are reported to the device queue
+ */
+class LrrMacCoDelTestCase : public ns3::TestCase
+{
+public:
+  LrrMacCoDelTestCase () : ns3::TestCase ("MAC CoDel test"), m_received (0), m_dropped (0), m_maxDelay (Seconds (0)) {}
+  void DoRun ();
+private:
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from);
+  void Drop (uint32_t trafficClass, Ptr<const Packet> packet);
+  void QueueDelay (uint32_t trafficClass, Time delay);
+private:
+  uint32_t m_received;
+  uint32_t m_dropped;
+  Time m_maxDelay;
+};
+
+bool
+LrrMacCoDelTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address & from)
+{
+  m_received++;
+  return true;
+}
+
+void
+LrrMacCoDelTestCase::Drop (uint32_t trafficClass, Ptr<const Packet> packet)
+{
+  m_dropped++;
+}
+
+void
+LrrMacCoDelTestCase::QueueDelay (uint32_t trafficClass, Time delay)
+{
+  m_maxDelay = std::max (m_maxDelay, delay);
+}
+
+void
+LrrMacCoDelTestCase::DoRun ()
+{
+  const uint32_t nPackets = 80;
+  NetDeviceContainer devices = InstallTwoStations ();
+  Ptr<lrr::AccessManager> accessManager = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()
+    ->GetObject<lrr::CollisionFreeMacImpl> ()->GetAccessManager ();
+  accessManager->SetAttribute ("CoDel", BooleanValue (true));
+  accessManager->TraceConnectWithoutContext ("CoDelDrop", MakeCallback (&LrrMacCoDelTestCase::Drop, this));
+  accessManager->TraceConnectWithoutContext ("QueueDelay", MakeCallback (&LrrMacCoDelTestCase::QueueDelay, this));
+  Ptr<LrrByteCountingQueueLimits> limits = CreateObject<LrrByteCountingQueueLimits> ();
+  devices.Get (0)->GetObject<NetDeviceQueueInterface> ()->GetTxQueue (0)->SetQueueLimits (limits);
+  devices.Get (1)->SetReceiveCallback (MakeCallback (&LrrMacCoDelTestCase::Receive, this));
+  for (uint32_t i = 0; i < nPackets; i++)
+    {
+      Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), Create<Packet> (1000), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (3));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_GT (m_maxDelay, MilliSeconds (200), "Queue stands for several CoDel intervals");
+  NS_TEST_EXPECT_MSG_GT (m_dropped, 0, "CoDel drops packets of a standing queue");
+  NS_TEST_EXPECT_MSG_LT (m_dropped, nPackets, "CoDel does not drop all packets");
+  NS_TEST_EXPECT_MSG_EQ (m_received + m_dropped, nPackets, "Packets are either received or dropped by CoDel");
+  NS_TEST_EXPECT_MSG_EQ (accessManager->GetQueue ()->GetNPackets (), 0, "Queue is drained");
+  NS_TEST_EXPECT_MSG_GT (limits->queued, 0, "Queued bytes are reported");
+  NS_TEST_EXPECT_MSG_EQ (limits->completed, limits->queued, "Bytes of dropped packets are reported as transmitted");
+  Simulator::Destroy ();
+}
+
+/**
+ * Two stations 100 m apart with adaptive guard interval, the first one sends two packets at once.
+ * Checks that the gap between the frames is airtime (with SIFS and acknowledgement if ARQ is used)
+ * followed by propagation delay and Preamble, the delay is doubled with ARQ
+ */
+class LrrMacGuardIntervalTestCase : public ns3::TestCase
+{
+public:
+  LrrMacGuardIntervalTestCase (bool arq) :
+    ns3::TestCase (arq ? "MAC adaptive guard interval with ARQ test" : "MAC adaptive guard interval test"),
+    m_arq (arq) {}
+  void DoRun ();
+private:
+  void TxStart (Ptr<const Packet> packet);
+private:
+  bool m_arq;
+  /// Start time and size of each frame
+  std::vector<std::pair<Time, uint32_t> > m_frames;
+};
+
+void
+LrrMacGuardIntervalTestCase::TxStart (Ptr<const Packet> packet)
+{
+  m_frames.push_back (std::make_pair (Simulator::Now (), packet->GetSize ()));
+}
+
+void
+LrrMacGuardIntervalTestCase::DoRun ()
+{
+  NetDeviceContainer devices = InstallTwoStations ();
+  devices.Get (1)->GetNode ()->GetObject<MobilityModel> ()->SetPosition (Vector (100, 0, 0));
+  Ptr<lrr::CollisionFreeMacImpl> mac = devices.Get (0)->GetObject<lrr::NeighborAwareDeviceImpl> ()->GetMac ()
+    ->GetObject<lrr::CollisionFreeMacImpl> ();
+  Ptr<lrr::Phy> phy = mac->GetPhy ()->GetObject<lrr::Phy> ();
+  Ptr<lrr::AccessManager> accessManager = mac->GetAccessManager ();
+  Time preamble = MicroSeconds (20);
+  Time sifs = MicroSeconds (16);
+  accessManager->SetAttribute ("AdaptiveGuardInterval", BooleanValue (true));
+  accessManager->SetAttribute ("Preamble", TimeValue (preamble));
+  accessManager->SetAttribute ("Sifs", TimeValue (sifs));
+  accessManager->SetAttribute ("Arq", BooleanValue (m_arq));
+  phy->TraceConnectWithoutContext ("TxStart", MakeCallback (&LrrMacGuardIntervalTestCase::TxStart, this));
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Simulator::Schedule (Seconds (1), &NetDevice::Send, devices.Get (0), Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+    }
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_frames.size (), 2, "Both frames are sent without retransmissions");
+  Time delay = CreateObject<ConstantSpeedPropagationDelayModel> ()->GetDelay (
+      devices.Get (0)->GetNode ()->GetObject<MobilityModel> (), devices.Get (1)->GetNode ()->GetObject<MobilityModel> ());
+  NS_TEST_ASSERT_MSG_GT (delay, Seconds (0), "Propagation delay");
+  DataRate rate = phy->GetRate ();
+  Time airtime = rate.CalculateBytesTxTime (m_frames[0].second);
+  Time guardInterval = delay + preamble;
+  if (m_arq)
+    {
+      airtime += sifs + rate.CalculateBytesTxTime (mac->GetMacHeaderSize () + lrr::MacSequenceHeader ().GetSerializedSize ());
+      guardInterval += delay;
+    }
+  NS_TEST_EXPECT_MSG_EQ (m_frames[1].first - m_frames[0].first, airtime + guardInterval, "Frames are separated by guard interval");
+  Simulator::Destroy ();
+}
+
+class LrrMacTest : public ns3::TestSuite
+{
+public:
+  LrrMacTest () : ns3::TestSuite ("lrr-mac-test", UNIT)
+  {
+    AddTestCase (new LrrMacTxCopyTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacArqTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacArqLossTestCase (false), TestCase::QUICK);
+    AddTestCase (new LrrMacArqLossTestCase (true), TestCase::QUICK);
+    AddTestCase (new LrrMacTdmaTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacSpatialReuseTestCase (true, false), TestCase::QUICK);
+    AddTestCase (new LrrMacSpatialReuseTestCase (false, false), TestCase::QUICK);
+    AddTestCase (new LrrMacSpatialReuseTestCase (true, true), TestCase::QUICK);
+    AddTestCase (new LrrMacAggregationTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacTrafficClassTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacQueueFlowControlTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacCoDelTestCase, TestCase::QUICK);
+    AddTestCase (new LrrMacGuardIntervalTestCase (false), TestCase::QUICK);
+    AddTestCase (new LrrMacGuardIntervalTestCase (true), TestCase::QUICK);
+  }
+} g_lrrMacTest;
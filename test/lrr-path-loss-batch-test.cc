@@ -0,0 +1,105 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "ns3/test.h"
+#include "ns3/double.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/lrr-path-loss-batch.h"
+
+#include <cmath>
+
+using namespace ns3;
+
+/**
+ * Gains of built-in models calculated in batch are compared with the models themselves. Receivers
+ * are placed at zero distance, below reference (minimal) distance and on both sides of the TwoRayGround
+ * cross distance, their number is not a multiple of the vector width. Both scalar and (if the CPU supports
+ * it) AVX2 code is checked.
+ */
+class LrrPathLossBatchTestCase : public ns3::TestCase
+{
+public:
+  LrrPathLossBatchTestCase () : ns3::TestCase ("Batch path loss test") {}
+  void DoRun ();
+private:
+  void Check (Ptr<PropagationLossModel> model, bool vectorized);
+};
+
+void
+LrrPathLossBatchTestCase::Check (Ptr<PropagationLossModel> model, bool vectorized)
+{
+  lrr::PathLossBatch batch;
+  batch.SetVectorized (vectorized);
+  NS_TEST_ASSERT_MSG_EQ (batch.IsVectorized (), vectorized && lrr::PathLossBatch::IsVectorizationSupported (), "Vectorization");
+  NS_TEST_ASSERT_MSG_EQ (batch.Configure (model), true, "Model " << model->GetInstanceTypeId ().GetName () << " is supported");
+  Vector tx (0, 0, 1.5);
+  double distances[] = {0, 0.3, 0.9, 1, 7, 60, 150, 400, 1000, 3000, 10000};
+  uint32_t n = sizeof (distances) / sizeof (double);
+  std::vector<double> x (n), y (n), z (n), gains (n);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      x[i] = tx.x + distances[i] * 0.6;
+      y[i] = tx.y + distances[i] * 0.8;
+      z[i] = tx.z + (i % 3) * 0.5;
+    }
+  batch.CalcGains (tx, &x[0], &y[0], &z[0], n, &gains[0]);
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (tx);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      b->SetPosition (Vector (x[i], y[i], z[i]));
+      double expected = std::pow (10, model->CalcRxPower (0, a, b) / 10.0);
+      NS_TEST_EXPECT_MSG_EQ_TOL (gains[i], expected, expected * 1e-9, "Gain at " << distances[i] << " m, vectorized " << vectorized);
+    }
+}
+
+void
+LrrPathLossBatchTestCase::DoRun ()
+{
+  Ptr<FriisPropagationLossModel> friis = CreateObject<FriisPropagationLossModel> ();
+  friis->SetAttribute ("SystemLoss", DoubleValue (2));
+  friis->SetAttribute ("MinLoss", DoubleValue (30));
+  Check (friis, false);
+  Check (friis, true);
+  Ptr<LogDistancePropagationLossModel> logDistance = CreateObject<LogDistancePropagationLossModel> ();
+  logDistance->SetAttribute ("Exponent", DoubleValue (2.7));
+  Check (logDistance, false);
+  Check (logDistance, true);
+  Ptr<TwoRayGroundPropagationLossModel> twoRay = CreateObject<TwoRayGroundPropagationLossModel> ();
+  twoRay->SetAttribute ("Frequency", DoubleValue (2.4e9));
+  twoRay->SetAttribute ("HeightAboveZ", DoubleValue (1));
+  Check (twoRay, false);
+  Check (twoRay, true);
+
+  lrr::PathLossBatch batch;
+  logDistance->SetNext (CreateObject<FriisPropagationLossModel> ());
+  NS_TEST_EXPECT_MSG_EQ (batch.Configure (logDistance), false, "Chained models are not supported");
+  NS_TEST_EXPECT_MSG_EQ (batch.Configure (CreateObject<RangePropagationLossModel> ()), false, "Other models are not supported");
+}
+
+class LrrPathLossBatchTest : public ns3::TestSuite
+{
+public:
+  LrrPathLossBatchTest () : ns3::TestSuite ("lrr-path-loss-batch-test", UNIT)
+  {
+    AddTestCase (new LrrPathLossBatchTestCase, TestCase::QUICK);
+  }
+} g_lrrPathLossBatchTest;
@@ -29,6 +29,7 @@
 #include "ns3/udp-socket-factory.h"
 
 #include "ns3/lrr-mcast-group-mgt.h"
+#include "ns3/lrr-mcast-table.h"
 
 #include "ns3/lrr-channel-helper.h"
 #include "ns3/lrr-device-helper.h"
@@ -739,6 +740,149 @@ LrrMcastXTest::DoRun ()
   DestroyTest ();
 }
 
+// ===================================== Graft/prune test: =====================================
+LrrMcastGraftPruneTest::LrrMcastGraftPruneTest () :
+  LrrMcastTestCase (5, Seconds (0))
+{}
+
+void
+LrrMcastGraftPruneTest::InstallChannel ()
+{
+  LrrChannelHelper channelHelper = LrrChannelHelper::Default ();
+  Ptr<MatrixPropagationLossModel> matrix = CreateObject<MatrixPropagationLossModel> ();
+  double disabled = 216; // -200 dBm
+  double enabled = 56; // -40 dBm
+  matrix->SetDefaultLoss (disabled);
+  for (uint32_t i = 0; i + 1 < m_nodes.GetN (); i++)
+    {
+      matrix->SetLoss (m_nodes.Get (i)->GetObject <MobilityModel> (), m_nodes.Get (i + 1)->GetObject <MobilityModel> (), enabled);
+    }
+  channelHelper.SetDeterministicPropagationLoss (matrix);
+  m_channel = channelHelper.Create ();
+}
+
+void
+LrrMcastGraftPruneTest::CheckGraph ()
+{
+  for (uint32_t i = 1; i < m_addresses.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_graph->PathDistance (m_addresses[0], m_addresses[i]), i, "Node " << i << " is in line");
+    }
+}
+
+void
+LrrMcastGraftPruneTest::CheckMulticastPath ()
+{
+  for (uint32_t i = 0; i < m_addresses.size (); i++)
+    {
+      bool member = (m_members.find (m_addresses[i]) != m_members.end ());
+      NS_TEST_EXPECT_MSG_EQ (m_graph->HaveMcastPath (m_addresses[i], "227.0.0.1"), member && (m_members.size () > 1),
+                             "Multicast path of node " << i << " " << m_step);
+    }
+}
+
+void
+LrrMcastGraftPruneTest::CheckMembers ()
+{
+  for (uint32_t i = 0; i < m_addresses.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (GlobalGroupManagement::GetInstance ()->IsInMcastGroup (m_addresses[i], "227.0.0.1"),
+                             (m_members.find (m_addresses[i]) != m_members.end ()), "Membership of node " << i << " " << m_step);
+    }
+}
+
+void
+LrrMcastGraftPruneTest::CheckRetranslators ()
+{
+  Ptr<GlobalMcastTable> full = Create<GlobalMcastTable> ();
+  full->Update ();
+  for (uint32_t from = 0; from < m_addresses.size (); from++)
+    {
+      for (uint32_t local = 0; local < m_addresses.size (); local++)
+        {
+          std::set<Ipv4Address> route = m_graph->GetMulticastRoute (m_addresses[from], "227.0.0.1", m_addresses[local]);
+          NS_TEST_EXPECT_MSG_EQ ((route == full->GetMulticastRoute (m_addresses[from], "227.0.0.1", m_addresses[local])), true,
+                                 "Outgoing interfaces of node " << local << " in tree " << from << " " << m_step);
+        }
+    }
+}
+
+void
+LrrMcastGraftPruneTest::DoRun ()
+{
+  CreateNodes ();
+  InstallChannel ();
+  InstallDevices ();
+  InstallInternet ();
+  for (uint32_t i = 0; i < m_nodes.GetN (); i++)
+    {
+      m_addresses.push_back (GlobalPeering::GetMainAddress (m_nodes.Get (i)));
+    }
+  std::set <uint32_t> group;
+  group.insert (0);
+  group.insert (4);
+  AddGroup (group);
+  m_members.insert (m_addresses[0]);
+  m_members.insert (m_addresses[4]);
+  m_graph->Start ();
+  CheckGraph ();
+  GlobalGroupManagement * mgt = GlobalGroupManagement::GetInstance ();
+  Ipv4Address groupAddress ("227.0.0.1");
+
+  m_step = "after full update";
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+  NS_TEST_EXPECT_MSG_EQ (m_graph->IsMcastRetranslator (m_addresses[2], m_addresses[0], groupAddress), true, "Node 2 relays tree 0");
+
+  m_step = "after 2 has joined";
+  NS_TEST_ASSERT_MSG_EQ (mgt->Join (groupAddress, m_addresses[2]), true, "Join of 2");
+  m_members.insert (m_addresses[2]);
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+  NS_TEST_EXPECT_MSG_EQ (m_graph->IsMcastRetranslator (m_addresses[1], m_addresses[2], groupAddress), true, "Tree of 2 is grafted");
+
+  m_step = "after 1 has joined";
+  NS_TEST_ASSERT_MSG_EQ (mgt->Join (groupAddress, m_addresses[1]), true, "Join of 1");
+  m_members.insert (m_addresses[1]);
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+
+  // Branch of tree 0 to 1 is pruned, hops 0->1 and 1->2 are still used by branches to 2 and 4:
+  m_step = "after 1 has left";
+  NS_TEST_ASSERT_MSG_EQ (mgt->Leave (groupAddress, m_addresses[1]), true, "Leave of 1");
+  m_members.erase (m_addresses[1]);
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+  NS_TEST_EXPECT_MSG_EQ (m_graph->GetMulticastRoute (m_addresses[0], groupAddress, m_addresses[0]).empty (), false, "Root keeps its shared hop");
+  NS_TEST_EXPECT_MSG_EQ (m_graph->IsMcastRetranslator (m_addresses[1], m_addresses[0], groupAddress), true, "Shared hop of 1 is kept");
+
+  m_step = "after 2 has left";
+  NS_TEST_ASSERT_MSG_EQ (mgt->Leave (groupAddress, m_addresses[2]), true, "Leave of 2");
+  m_members.erase (m_addresses[2]);
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+  NS_TEST_EXPECT_MSG_EQ (m_graph->IsMcastRetranslator (m_addresses[2], m_addresses[0], groupAddress), true, "Node 2 still relays tree 0");
+  NS_TEST_EXPECT_MSG_EQ (m_graph->GetMulticastRoute (m_addresses[2], groupAddress, m_addresses[2]).empty (), true, "Tree of 2 is pruned");
+
+  m_step = "after group removal";
+  mgt->RemoveMulticastgroup (groupAddress);
+  m_members.clear ();
+  CheckMembers ();
+  CheckMulticastPath ();
+  CheckRetranslators ();
+  for (uint32_t i = 1; i < m_addresses.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (m_graph->IsMcastRetranslator (m_addresses[i], m_addresses[0], groupAddress), false, "Node " << i << " does not relay");
+    }
+  Simulator::Destroy ();
+  DestroyTest ();
+}
+
 class LrrMcastTestSuite : public ns3::TestSuite
 {
 public:
@@ -746,6 +890,7 @@ public:
   {
     AddTestCase (new LrrMcastColumnTest, TestCase::EXTENSIVE);
     AddTestCase (new LrrMcastXTest, TestCase::EXTENSIVE);
+    AddTestCase (new LrrMcastGraftPruneTest, TestCase::QUICK);
   }
 } g_lrrMcastTestSuite;
 
@@ -174,5 +174,37 @@ private:
   void DoRun ();
   ///\}
 };
+
+/**
+  * Created graph
+  *
+  * 0------1------2------3------4
+  *
+  * Multicast group {0,4}, then 2 and 1 join and leave one by one and the group is removed.
+  * Branches of tree 0 to 1, 2 and 4 share hops, which must stay while any branch uses them
+  */
+class LrrMcastGraftPruneTest : public LrrMcastTestCase
+{
+public:
+  LrrMcastGraftPruneTest ();
+private:
+  ///\name Inherited from LrrMcastTestCase:
+  ///\{
+  void InstallChannel ();
+  void CheckGraph ();
+  void CheckMulticastPath ();
+  void CheckMembers ();
+  /// Compare incrementally grafted and pruned trees with a table rebuilt by full Update ()
+  void CheckRetranslators ();
+private:
+  void DoRun ();
+  ///\}
+  /// Addresses of all nodes
+  std::vector<Ipv4Address> m_addresses;
+  /// Members expected at this step
+  std::set<Ipv4Address> m_members;
+  /// Current step of the test, used in messages
+  std::string m_step;
+};
 }
 #endif
@@ -0,0 +1,200 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2010 Telum (www.telum.ru)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Kirill Andreev <k.andreev@skoltech.ru>
+ */
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/enum.h"
+
+#include "ns3/lrr-routing-seq-cache.h"
+#include "ns3/lrr-routing-dpd.h"
+#include "ns3/lrr-routing-protocol.h"
+
+using namespace ns3;
+using namespace lrr;
+
+/**
+ * Window of 64 ids: ids ahead slide the window, ids inside it are checked exactly, ids behind it
+ * are duplicates. Ids wrap around at 2^32 and at 2^16
+ */
+struct LrrSeqCacheWindowTest : public ns3::TestCase
+{
+  LrrSeqCacheWindowTest () : ns3::TestCase ("lrr-routing-seq-cache window test") {}
+  void DoRun ()
+  {
+    SeqCache cache (Seconds (10), 64);
+    Ipv4Address origin ("10.0.0.1");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 100), false, "First id");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 100), true, "The same id");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 105), false, "Window slides");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 101), false, "Reordered id inside the window");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 101), true, "Reordered id is remembered");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 164), false, "Window slides by its size");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 100), true, "Behind the window");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 101), true, "Last id of the window is kept by slide");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 102), false, "Unseen id of the window");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 100000), false, "Jump ahead");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 99999), false, "Bits are cleared after jump");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 164), true, "Far behind the window");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (Ipv4Address ("10.0.0.2"), 164), false, "Origins have own windows");
+    NS_TEST_EXPECT_MSG_EQ (cache.GetNOrigins (), 2, "Two origins");
+
+    Ipv4Address wrapping ("10.0.0.3");
+    uint32_t ids32[] = {0xfffffffe, 0xffffffff, 0, 1};
+    for (uint32_t i = 0; i < 4; i++)
+      {
+        NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (wrapping, ids32[i]), false, "Id " << ids32[i] << " around 2^32");
+      }
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (wrapping, 0xffffffff), true, "Id before wrap around is remembered");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (wrapping, 0xfffffff0), false, "Unseen id before wrap around");
+
+    cache.SetSequenceBits (16);
+    NS_TEST_EXPECT_MSG_EQ (cache.GetNOrigins (), 0, "Origins are forgotten with new id width");
+    for (uint32_t id = 65530; id < 65536 + 10; id++)
+      {
+        NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, id & 0xffff), false, "Id " << (id & 0xffff) << " around 2^16");
+      }
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 65535), true, "Id before wrap around is remembered");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 65529), false, "Unseen id before wrap around");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 65536 + 5), true, "Ids are compared modulo 2^16");
+    NS_TEST_EXPECT_MSG_EQ (cache.IsDuplicate (origin, 9 + 32768), true, "Half of the id space away is behind");
+  }
+};
+
+/**
+ * Lifetime of 10 s, so a wheel tick is 0.625 s. Checks that a silent origin is forgotten after its lifetime,
+ * a refreshed origin is kept and that an origin re-bucketed by SetLifetime lives for the whole lifetime
+ */
+struct LrrSeqCacheExpiryTest : public ns3::TestCase
+{
+  LrrSeqCacheExpiryTest () : ns3::TestCase ("lrr-routing-seq-cache expiry test"), m_cache (0) {}
+  void DoRun ()
+  {
+    m_cache = new SeqCache (Seconds (10), 64);
+    Simulator::Schedule (Seconds (0), &LrrSeqCacheExpiryTest::Start, this);
+    Simulator::Schedule (Seconds (5), &LrrSeqCacheExpiryTest::Refresh, this);
+    Simulator::Schedule (Seconds (11), &LrrSeqCacheExpiryTest::CheckExpired, this);
+    Simulator::Schedule (Seconds (20.9), &LrrSeqCacheExpiryTest::CheckLifetime, this);
+    Simulator::Run ();
+    Simulator::Destroy ();
+    delete m_cache;
+    m_cache = 0;
+  }
+  void Start ()
+  {
+    m_cache->IsDuplicate (Ipv4Address ("10.0.0.1"), 1);
+    m_cache->IsDuplicate (Ipv4Address ("10.0.0.2"), 1);
+  }
+  void Refresh ()
+  {
+    NS_TEST_EXPECT_MSG_EQ (m_cache->IsDuplicate (Ipv4Address ("10.0.0.2"), 2), false, "New id refreshes origin");
+    NS_TEST_EXPECT_MSG_EQ (m_cache->GetNOrigins (), 2, "Both origins live");
+  }
+  void CheckExpired ()
+  {
+    NS_TEST_EXPECT_MSG_EQ (m_cache->IsDuplicate (Ipv4Address ("10.0.0.2"), 1), true, "Refreshed origin is remembered");
+    NS_TEST_EXPECT_MSG_EQ (m_cache->GetNOrigins (), 1, "Silent origin is purged");
+    NS_TEST_EXPECT_MSG_EQ (m_cache->IsDuplicate (Ipv4Address ("10.0.0.1"), 1), false, "Silent origin is forgotten");
+    m_cache->SetLifetime (Seconds (10));
+  }
+  void CheckLifetime ()
+  {
+    NS_TEST_EXPECT_MSG_EQ (m_cache->IsDuplicate (Ipv4Address ("10.0.0.1"), 1), true,
+                           "Origin re-bucketed by SetLifetime lives for the lifetime");
+  }
+  SeqCache * m_cache;
+};
+
+/**
+ * Duplicate detection by IPv4 identification: ids are kept per (source, destination, protocol, fragment offset)
+ * and wrap around at 2^16. PrepareTx adds no tag, and the mode is set by RoutingProtocol attribute
+ */
+struct LrrDpdIpIdentificationTest : public ns3::TestCase
+{
+  LrrDpdIpIdentificationTest () : ns3::TestCase ("lrr-routing-dpd IP identification test") {}
+  static Ipv4Header MakeHeader (const char * source, const char * destination, uint8_t protocol, uint16_t id,
+                                uint16_t offset = 0)
+  {
+    Ipv4Header header;
+    header.SetSource (Ipv4Address (source));
+    header.SetDestination (Ipv4Address (destination));
+    header.SetProtocol (protocol);
+    header.SetIdentification (id);
+    header.SetFragmentOffset (offset);
+    return header;
+  }
+  void DoRun ()
+  {
+    DuplicatePacketDetection dpd (Seconds (10));
+    dpd.SetMode (DuplicatePacketDetection::IP_IDENTIFICATION);
+    Ptr<Packet> p = Create<Packet> (100);
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 100)), false, "First id");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 100)), true, "The same tuple and id");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (Create<Packet> (10), MakeHeader ("10.0.0.1", "225.0.0.1", 17, 100)), true,
+                           "Packet contents do not matter");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.2", "225.0.0.1", 17, 100)), false, "Other source");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.2", 17, 100)), false, "Other destination");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 6, 100)), false, "Other protocol");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 101)), false, "Next id");
+
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 200, 1480)), false,
+                           "Fragment of a new datagram");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 200, 0)), false,
+                           "First fragment of the same datagram");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 200, 2960)), false,
+                           "Last fragment of the same datagram");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.1", "225.0.0.1", 17, 200, 1480)), true,
+                           "The same fragment");
+
+    for (uint32_t id = 65530; id < 65536 + 10; id++)
+      {
+        NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.3", "225.0.0.1", 17, id & 0xffff)), false,
+                               "Id " << (id & 0xffff) << " around 2^16");
+      }
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.3", "225.0.0.1", 17, 65535)), true,
+                           "Id before wrap around is remembered");
+    NS_TEST_EXPECT_MSG_EQ (dpd.IsDuplicate (p, MakeHeader ("10.0.0.3", "225.0.0.1", 17, 5)), true,
+                           "Id after wrap around is remembered");
+
+    Ptr<Packet> tx = Create<Packet> (100);
+    dpd.PrepareTx (tx);
+    NS_TEST_EXPECT_MSG_EQ (tx->GetPacketTagIterator ().HasNext (), false, "No sequence tag with IP identification");
+    dpd.SetMode (DuplicatePacketDetection::SEQ_TAG);
+    dpd.PrepareTx (tx);
+    NS_TEST_EXPECT_MSG_EQ (tx->GetPacketTagIterator ().HasNext (), true, "Sequence tag is added otherwise");
+
+    Ptr<RoutingProtocol> routing = CreateObject<RoutingProtocol> ();
+    NS_TEST_EXPECT_MSG_EQ (routing->GetDuplicateDetection (), DuplicatePacketDetection::SEQ_TAG, "Sequence tag by default");
+    routing->SetAttribute ("DuplicateDetection", EnumValue (DuplicatePacketDetection::IP_IDENTIFICATION));
+    NS_TEST_EXPECT_MSG_EQ (routing->GetDuplicateDetection (), DuplicatePacketDetection::IP_IDENTIFICATION,
+                           "Mode is set by attribute");
+    routing->Dispose ();
+  }
+};
+
+class LrrSeqCacheTestSuite : public TestSuite
+{
+public:
+  LrrSeqCacheTestSuite () : TestSuite ("lrr-routing-seq-cache", UNIT)
+  {
+    AddTestCase (new LrrSeqCacheWindowTest, TestCase::QUICK);
+    AddTestCase (new LrrSeqCacheExpiryTest, TestCase::QUICK);
+    AddTestCase (new LrrDpdIpIdentificationTest, TestCase::QUICK);
+  }
+} g_lrrSeqCacheTestSuite;